@@ -15,14 +15,21 @@
 #ifndef MOTIVE_ENGINE_H_
 #define MOTIVE_ENGINE_H_
 
+#include <atomic>
 #include <map>
-#include <set>
+#include <memory>
+#include <vector>
 
 #include "motive/common.h"
+#include "motive/event.h"
 #include "motive/processor.h"
+#include "motive/snapshot.h"
+#include "motive/state.h"
+#include "motive/task_graph.h"
 
 namespace motive {
 
+class WorkerPool;
 struct MotiveVersion;
 
 /// @class MotiveEngine
@@ -34,25 +41,43 @@ struct MotiveVersion;
 /// minimize the number of engines in your game. As more Motivators are added to
 /// the processors, you start to get economies of scale.
 class MotiveEngine {
-  struct ProcessorDetails {
-    MotiveProcessor* processor;
-    bool operator<(const ProcessorDetails& rhs) const {
-      return processor->Priority() < rhs.processor->Priority();
-    }
-  };
   typedef std::map<MotivatorType, MotiveProcessor*> ProcessorMap;
   typedef std::pair<MotivatorType, MotiveProcessor*> ProcessorPair;
-  typedef std::multiset<ProcessorDetails> ProcessorSet;
   typedef std::map<MotivatorType, MotiveProcessorFunctions> FunctionMap;
   typedef std::pair<MotivatorType, MotiveProcessorFunctions> FunctionPair;
 
+  /// A group of processors that don't read from one another, and can
+  /// therefore be advanced in any order, or concurrently.
+  struct ScheduleStage {
+    std::vector<MotiveProcessor*> processors;
+    /// True for the second pass over a dependency cycle. The processors are
+    /// advanced by zero time, to pick up each other's latest output.
+    bool refresh;
+  };
+  typedef std::vector<ScheduleStage> Schedule;
+
+  /// The tasks of one processor in `task_graph_`. Used to total the time
+  /// spent in each processor.
+  struct ProcessorTasks {
+    MotiveProcessor* processor;
+    /// The kBeginAdvanceFrame and kEndAdvanceFrame tasks, or -1 if the
+    /// processor is advanced as a single kAdvanceFrame task.
+    int begin_task;
+    int end_task;
+    /// The kAdvanceFrameRange or kAdvanceFrame tasks are contiguous, in
+    /// [first_advance_task, end_advance_task).
+    int first_advance_task;
+    int end_advance_task;
+  };
+
  public:
   MotiveEngine();
-  ~MotiveEngine() { Reset(); }
+  virtual ~MotiveEngine();
 
   /// Deallocate all MotiveProcessors, which, in turn, resets all Motivators
-  /// that use those MotiveProcessors.
-  void Reset();
+  /// that use those MotiveProcessors. Virtual, so that engines that keep
+  /// their own pointers to the processors can update them.
+  virtual void Reset();
 
   /// Update all the MotiveProcessors by 'delta_time'. This advances all
   /// Motivators created with this MotiveEngine.
@@ -62,7 +87,167 @@ class MotiveEngine {
   ///                   the x-axis.
   void AdvanceFrame(MotiveTime delta_time);
 
-  /// @private For internal use only.
+  /// Same as AdvanceFrame(delta_time), but the work is run by `executor`,
+  /// presumably on the host's own job system. See MotiveTaskGraph.
+  void AdvanceFrame(MotiveTime delta_time, MotiveTaskExecutor* executor);
+
+  /// Describe the work of AdvanceFrame(delta_time) as a graph of tasks, but
+  /// don't run it. Call MotiveTaskGraph::Run() for every task, and then call
+  /// EndAdvanceFrame(). Don't touch the engine or its Motivators in between.
+  ///
+  /// Processors that support MotiveProcessor::AdvanceFrameRange() are split
+  /// into tasks of at most AdvanceFrameChunkSize() indices.
+  MotiveTaskGraph* BeginAdvanceFrame(MotiveTime delta_time);
+
+  /// Finish the frame begun by BeginAdvanceFrame(). Every task of the graph
+  /// must have finished.
+  void EndAdvanceFrame();
+
+  /// Run AdvanceFrame() on `num_threads` worker threads, plus the calling
+  /// thread. MotiveProcessors that don't depend on each other (see
+  /// MotiveProcessor::ReadsFrom()) are advanced concurrently. A processor
+  /// starts only once every processor that it reads from has finished.
+  /// Pass 0 to go back to advancing every processor on the calling thread,
+  /// which is the default.
+  ///
+  /// Processors must not touch each other's data in AdvanceFrame(), except
+  /// to read the output of processors they declare in ReadsFrom(). All
+  /// built-in processors obey this rule.
+  void SetNumWorkerThreads(int num_threads);
+
+  /// Number of worker threads used by AdvanceFrame(). 0 when AdvanceFrame()
+  /// runs entirely on the calling thread.
+  int NumWorkerThreads() const;
+
+  /// When running on worker threads or a MotiveTaskExecutor, processors that
+  /// support MotiveProcessor::AdvanceFrameRange() are split into chunks of at
+  /// most `chunk_size` indices, rounded up to a multiple of
+  /// MotiveProcessor::kAdvanceFrameRangeAlignment. Idle threads claim the
+  /// next unprocessed chunk, so a single large processor is spread across
+  /// every thread. Smaller chunks balance better but cost more scheduling
+  /// overhead. Defaults to kDefaultAdvanceFrameChunkSize.
+  void SetAdvanceFrameChunkSize(MotiveIndex chunk_size);
+  MotiveIndex AdvanceFrameChunkSize() const { return chunk_size_; }
+
+  /// Default value for SetAdvanceFrameChunkSize(). Large enough to amortize
+  /// the cost of claiming a chunk, small enough for one chunk of spline data
+  /// to fit comfortably in a core's L2 cache.
+  static const MotiveIndex kDefaultAdvanceFrameChunkSize = 4096;
+
+  /// Allocate storage for `num_indices` indices in the processor of `type`,
+  /// creating the processor if necessary. Initializing Motivators of `type`
+  /// then doesn't reallocate until there are more than `num_indices`
+  /// indices. Call while loading to avoid hitches later.
+  /// See MotiveProcessor::Reserve().
+  void Reserve(MotivatorType type, MotiveIndex num_indices);
+
+  /// Cap the processor of `type` at `max_indices` indices, creating the
+  /// processor if necessary. Initializing a Motivator of `type` beyond the
+  /// cap fails, and leaves the Motivator invalid.
+  /// See MotiveProcessor::SetMaxIndices().
+  void SetMaxIndices(MotivatorType type, MotiveIndex max_indices);
+
+  /// Track which outputs of the processor of `type` change each frame,
+  /// creating the processor if necessary. Read the changes with
+  /// MotiveProcessor::ChangedIndices() after AdvanceFrame().
+  /// See MotiveProcessor::SetChangeTracking().
+  void SetChangeTracking(MotivatorType type, bool track_changes,
+                         float epsilon);
+
+  /// Limit every processor to moving about `max_moved` indices per frame
+  /// when defragmenting, so that the cost of freeing many Motivators at once
+  /// is spread over several frames.
+  /// See MotiveProcessor::SetDefragmentBudget().
+  void SetDefragmentBudget(MotiveIndex max_moved);
+  MotiveIndex DefragmentBudget() const { return defragment_budget_; }
+
+  /// Let the processor of `type` reorder its indices by locality key,
+  /// swapping at most `max_swaps` pairs of Motivators per frame, creating
+  /// the processor if necessary. Child Motivators are keyed by their parents,
+  /// so turning this on for the spline processor, for example, gathers the
+  /// splines of each matrix together, in the order of the matrices.
+  /// See MotiveProcessor::SetLocalitySortBudget().
+  void SetLocalitySortBudget(MotivatorType type, MotiveIndex max_swaps);
+
+  /// The number of indices, over every processor, that AdvanceFrame() will
+  /// compute. A rough measure of the cost of the next frame. Settled
+  /// indices, which AdvanceFrame() skips, are not counted.
+  MotiveIndex NumActiveIndices() const;
+
+  /// In snapshot mode, AdvanceFrame() finishes by copying the output of
+  /// every processor into a MotiveSnapshot, and publishing it. Another thread
+  /// can then read frame N, via AcquireSnapshot(), while AdvanceFrame()
+  /// computes frame N+1. Neither thread ever waits for the other.
+  ///
+  /// Snapshot mode pins the processors' indices (see
+  /// MotiveProcessor::SetIndicesPinned()), so that Motivators can look up
+  /// their data in a snapshot. Call Defragment() now and then to compact the
+  /// indices.
+  void SetSnapshotMode(bool snapshot_mode);
+  bool SnapshotMode() const { return snapshot_mode_; }
+
+  /// In deterministic mode, AdvanceFrame() gives bit-identical results no
+  /// matter how many worker threads it runs on, or how the frame is split
+  /// into chunks. Processors use only their plain C++ kernels, since the
+  /// assembly kernels may round differently.
+  ///
+  /// Every index is advanced independently, and the outputs are never
+  /// summed across indices, so chunking alone can't change the results.
+  /// Build with `motive_deterministic_fp` (off by default) so that the
+  /// compiler doesn't fuse multiplies and adds into FMA instructions, which
+  /// would make results depend on the target CPU.
+  void SetDeterministicMode(bool deterministic_mode);
+  bool DeterministicMode() const { return deterministic_mode_; }
+
+  /// A 64-bit hash of the output of every processor. Compare between
+  /// machines every frame to detect when lockstep simulations have diverged.
+  /// Independent of the order that processors were created in.
+  uint64_t StateHash() const;
+
+  /// Return the most recently published snapshot. Lock free; never blocks.
+  /// The returned snapshot is not modified until the next call to
+  /// AcquireSnapshot(). Only one thread may read snapshots.
+  const MotiveSnapshot& AcquireSnapshot();
+
+  /// Compact the indices of every processor, and publish a new snapshot
+  /// that reflects the new indices. Motivators may be moved, so call only
+  /// when no other thread is reading a snapshot.
+  ///
+  /// Only needed in snapshot mode. Otherwise, processors defragment
+  /// themselves in AdvanceFrame().
+  void Defragment();
+
+  /// Queue up to `capacity` events, such as splines ending or Motivators
+  /// reaching their targets. See MotiveEventType. At the end of every
+  /// AdvanceFrame(), each processor pushes an event for every Motivator that
+  /// finished in that frame, so game code can react to just those instead of
+  /// polling TimeRemaining() on every Motivator. Pop the events from
+  /// Events() between frames.
+  ///
+  /// Pass 0, the default, to turn events off. Discards any queued events.
+  void SetEventQueueCapacity(size_t capacity);
+
+  /// Events from every frame since they were last popped. Events from one
+  /// processor are in index order. Processors are in the order that they're
+  /// advanced.
+  MotiveEventQueue* Events() { return &events_; }
+
+  /// Save the simulation state of every Motivator into `state`, replacing
+  /// its contents. Reuses `state`'s memory, so saving every frame into the
+  /// same MotiveState doesn't allocate once it's warmed up.
+  void SaveState(MotiveState* state);
+
+  /// Rewind every Motivator to the state saved in `state`. Intended for
+  /// rollback: the engine must hold the same Motivators as when `state` was
+  /// saved, and they must have been initialized with the same animations,
+  /// so that every processor's layout is unchanged. Returns false, and
+  /// leaves every Motivator as it was, if `state` doesn't match the engine.
+  bool RestoreState(const MotiveState& state);
+
+  /// The processor that drives Motivators of `type`, created if necessary.
+  /// Mostly for internal use. Also the entry point for handles, which are
+  /// created and read through their processor. See
+  /// MotiveProcessor::InitializeHandle().
   MotiveProcessor* Processor(MotivatorType type);
 
   /// @private For internal use only.
@@ -70,15 +255,76 @@ class MotiveEngine {
                                        const MotiveProcessorFunctions& fns);
 
  private:
+  /// Order the processors into `schedule_`, according to the dependencies
+  /// reported by MotiveProcessor::ReadsFrom().
+  void BuildSchedule();
+
+  /// Copy every processor's output into the back snapshot, and swap it
+  /// with the ready snapshot.
+  void PublishSnapshot();
+
+  /// Restore every processor from `state`. When `verifying`, only check that
+  /// `state` matches, without changing anything.
+  bool RestoreProcessors(const MotiveState& state, bool verifying);
+
+  /// Make the most recently added task of `task_graph_` depend on every task
+  /// that finishes the previous stage.
+  void AddStageDependencies();
+
+  /// Bookkeeping shared by every way of advancing a frame.
+  void FinishFrame();
+
   /// Map from the MotivatorType to the MotiveProcessor. Only one
   /// MotiveProcessor per type per engine. This is to maximize centralization
   /// of data.
   ProcessorMap mapped_processors_;
 
-  /// Sort the MotiveProcessors by priority. Low numbered priorities run first.
-  /// This allows high number priorities to have child motivators, as long as
-  /// the child motivators have lower priority.
-  ProcessorSet sorted_processors_;
+  /// The order in which AdvanceFrame() updates the processors. A processor
+  /// appears in a later stage than every processor it reads from, so
+  /// processors can have child motivators in the processors they read from.
+  /// Rebuilt whenever a processor is created.
+  Schedule schedule_;
+  bool schedule_dirty_;
+
+  /// Optional threads used to advance several processors at once.
+  /// nullptr if AdvanceFrame() runs serially.
+  std::unique_ptr<WorkerPool> worker_pool_;
+
+  /// Work for the frame being advanced on worker threads or by a
+  /// MotiveTaskExecutor. Kept here to avoid reallocating every frame.
+  MotiveTaskGraph task_graph_;
+  std::vector<ProcessorTasks> processor_tasks_;
+  std::vector<int> stage_finish_tasks_;
+  std::vector<int> next_stage_finish_tasks_;
+
+  /// Maximum number of indices in a MotiveTaskGraph task. See
+  /// SetAdvanceFrameChunkSize().
+  MotiveIndex chunk_size_;
+
+  /// Number of calls to AdvanceFrame() since the engine was created.
+  uint64_t frame_count_;
+
+  /// See SetSnapshotMode().
+  bool snapshot_mode_;
+
+  /// See SetDefragmentBudget().
+  MotiveIndex defragment_budget_;
+
+  /// See SetDeterministicMode().
+  bool deterministic_mode_;
+
+  /// See SetEventQueueCapacity().
+  MotiveEventQueue events_;
+
+  /// Triple buffer of snapshots. AdvanceFrame() fills
+  /// `snapshots_[snapshot_back_]`, the reader holds
+  /// `snapshots_[snapshot_front_]`, and `snapshot_ready_` holds the index of
+  /// the latest published snapshot, plus kSnapshotFresh if the reader
+  /// hasn't taken it yet. Ownership is passed by atomically swapping indices.
+  MotiveSnapshot snapshots_[3];
+  int snapshot_back_;
+  int snapshot_front_;
+  std::atomic<int> snapshot_ready_;
 
   /// Current version of the Motive Animation System.
   const MotiveVersion* version_;
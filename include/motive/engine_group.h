@@ -0,0 +1,127 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_ENGINE_GROUP_H_
+#define MOTIVE_ENGINE_GROUP_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "motive/common.h"
+
+namespace motive {
+
+class MotiveEngine;
+class WorkerPool;
+
+/// @class MotiveEngineGroup
+/// @brief Advance many independent MotiveEngines on one shared set of threads.
+///
+/// Useful when a process hosts many simulations, each with its own engine,
+/// such as a server running hundreds of game sessions. Rather than giving
+/// every engine its own worker threads, add the engines to a group and call
+/// the group's AdvanceFrame() once per frame.
+///
+/// Every frame, the engines are packed into bins of roughly equal cost, with
+/// the longest-processing-time-first heuristic: engines are sorted by
+/// MotiveEngine::NumActiveIndices(), and each is added to the bin with the
+/// least work so far. Small engines end up sharing a bin, so the cost of
+/// handing a bin to a thread is paid once for all of them. There are more
+/// bins than threads, and idle threads claim the next unclaimed bin, so a
+/// poor estimate is evened out at the end of the frame.
+///
+/// Engines in a group are advanced with MotiveEngine::AdvanceFrame(), so they
+/// should not have worker threads of their own. The group doesn't own its
+/// engines.
+class MotiveEngineGroup {
+ public:
+  /// Create `num_threads` worker threads, shared by every engine in the
+  /// group. The thread that calls AdvanceFrame() also advances engines. Pass
+  /// 0 to advance every engine on the calling thread.
+  explicit MotiveEngineGroup(int num_threads);
+  ~MotiveEngineGroup();
+
+  /// Add `engine` to the group. It must not already be in the group, and
+  /// must outlive its membership.
+  void AddEngine(MotiveEngine* engine);
+
+  /// Remove `engine` from the group. Does nothing if it's not in the group.
+  void RemoveEngine(MotiveEngine* engine);
+
+  int NumEngines() const { return static_cast<int>(engines_.size()); }
+
+  /// Advance every engine in the group by `delta_time`. Blocks until every
+  /// engine has finished. Engines are independent, so each engine's results
+  /// are the same as if its AdvanceFrame() were called directly.
+  void AdvanceFrame(MotiveTime delta_time);
+
+  /// Number of worker threads, not including the thread that calls
+  /// AdvanceFrame().
+  int NumWorkerThreads() const;
+
+  /// Split the engines into at most `bins_per_thread` bins per thread.
+  /// More bins balance better when the cost estimates are poor, but each
+  /// bin must be claimed separately. Defaults to kDefaultBinsPerThread.
+  void SetBinsPerThread(int bins_per_thread);
+  int BinsPerThread() const { return bins_per_thread_; }
+  static const int kDefaultBinsPerThread = 4;
+
+  /// Estimated cost of advancing an engine with no active indices, in
+  /// indices. Covers walking the engine's schedule and its benchmarks, and
+  /// keeps idle engines from all being packed into the same bin.
+  static const MotiveIndex kEngineOverhead = 64;
+
+  /// The number of bins the engines were packed into by the last call to
+  /// AdvanceFrame().
+  int NumBins() const { return static_cast<int>(bin_starts_.size()) - 1; }
+
+ private:
+  /// An engine and its estimated cost for the coming frame.
+  typedef std::pair<MotiveIndex, MotiveEngine*> EngineLoad;
+
+  /// A bin's total estimated cost, and its index.
+  typedef std::pair<MotiveIndex, int> BinLoad;
+
+  /// Sort the engines into bins, filling `binned_engines_` and
+  /// `bin_starts_`. The heaviest bins are first, so they're claimed first.
+  void PackBins();
+
+  /// Engines in the order they were added.
+  std::vector<MotiveEngine*> engines_;
+
+  /// Threads used to advance the bins. nullptr if AdvanceFrame() runs
+  /// serially.
+  std::unique_ptr<WorkerPool> worker_pool_;
+  int bins_per_thread_;
+
+  /// The engines of bin b are
+  /// binned_engines_[bin_starts_[b]..bin_starts_[b + 1]).
+  std::vector<MotiveEngine*> binned_engines_;
+  std::vector<int> bin_starts_;
+
+  /// Scratch space for PackBins(). Kept here to avoid reallocating every
+  /// frame.
+  std::vector<EngineLoad> engine_loads_;
+  std::vector<int> engine_bins_;
+  std::vector<BinLoad> bin_heap_;
+  std::vector<BinLoad> bin_order_;
+  std::vector<int> bin_ranks_;
+
+  MOTIVE_DISALLOW_COPY_AND_ASSIGN(MotiveEngineGroup);
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_ENGINE_GROUP_H_
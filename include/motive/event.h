@@ -0,0 +1,149 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_EVENT_H_
+#define MOTIVE_EVENT_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+
+#include "motive/common.h"
+#include "motive/handle.h"
+
+namespace motive {
+
+class Motivator;
+
+/// What happened to a Motivator in MotiveEngine::AdvanceFrame().
+enum MotiveEventType {
+  kMotiveEventNone,
+
+  /// A spline that doesn't repeat has played past its end. Includes the
+  /// splines that the spline processor creates for SetTarget().
+  kMotiveEventSplineEnded,
+
+  /// A spring or ease-in-ease-out Motivator has arrived at its target, and
+  /// will stay there until it's given a new one.
+  kMotiveEventTargetReached,
+
+  /// An overshoot Motivator came within the Settled1f thresholds of
+  /// OvershootInit::at_target(), and snapped onto its target.
+  kMotiveEventSettled,
+
+  /// The animation playing on a RigMotivator has reached its end.
+  kMotiveEventRigAnimEnded,
+};
+
+/// @class MotiveEvent
+/// @brief A change in a Motivator, reported by MotiveEngine::Events().
+///
+/// Identifies either a Motivator or a handle, never both. The pointer is the
+/// Motivator's address at the end of the frame. Only compare it against your
+/// own Motivators if they may have been moved or destroyed since.
+struct MotiveEvent {
+  MotiveEvent()
+      : type(kMotiveEventNone),
+        motivator_type(kMotivatorTypeInvalid),
+        motivator(nullptr) {}
+
+  MotiveEventType type;
+
+  /// The type of the processor that reported the event. Look up the
+  /// processor with MotiveEngine::Processor() to read a handle's values.
+  MotivatorType motivator_type;
+
+  /// The Motivator that the event happened to, or nullptr for a handle.
+  Motivator* motivator;
+
+  /// The handle that the event happened to, or an invalid handle for a
+  /// Motivator.
+  MotiveHandle handle;
+};
+
+/// @class MotiveEventQueue
+/// @brief Fixed-capacity ring buffer of MotiveEvents.
+///
+/// MotiveEngine pushes events at the end of every AdvanceFrame(). Pop them
+/// between frames. When the queue is full, new events are dropped and
+/// counted, so that the caller knows to fall back to polling. Events that
+/// are already queued are never overwritten.
+class MotiveEventQueue {
+ public:
+  MotiveEventQueue() : head_(0), size_(0), num_dropped_(0) {}
+
+  /// Allocate room for `capacity` events, and discard any queued events.
+  /// A capacity of 0 turns events off.
+  void SetCapacity(size_t capacity) {
+    events_.resize(capacity);
+    Clear();
+  }
+  size_t capacity() const { return events_.size(); }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == events_.size(); }
+
+  /// Add `event` to the back of the queue. Return false, and count the
+  /// event as dropped, if the queue is full.
+  bool Push(const MotiveEvent& event) {
+    if (full()) {
+      num_dropped_++;
+      return false;
+    }
+    events_[Wrap(head_ + size_)] = event;
+    size_++;
+    return true;
+  }
+
+  /// Remove the event at the front of the queue, and write it to `event`.
+  /// Return false if the queue is empty.
+  bool Pop(MotiveEvent* event) {
+    if (empty()) return false;
+    *event = events_[head_];
+    head_ = Wrap(head_ + 1);
+    size_--;
+    return true;
+  }
+
+  /// The event `i` places from the front, without removing it.
+  const MotiveEvent& operator[](size_t i) const {
+    assert(i < size_);
+    return events_[Wrap(head_ + i)];
+  }
+
+  /// Discard every queued event, and reset the count of dropped events.
+  void Clear() {
+    head_ = 0;
+    size_ = 0;
+    num_dropped_ = 0;
+  }
+
+  /// The number of events that didn't fit since the last Clear().
+  size_t num_dropped() const { return num_dropped_; }
+
+ private:
+  size_t Wrap(size_t i) const {
+    return i >= events_.size() ? i - events_.size() : i;
+  }
+
+  std::vector<MotiveEvent> events_;
+  size_t head_;
+  size_t size_;
+  size_t num_dropped_;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_EVENT_H_
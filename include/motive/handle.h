@@ -0,0 +1,80 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_HANDLE_H_
+#define MOTIVE_HANDLE_H_
+
+#include <stdint.h>
+
+namespace motive {
+
+/// @class MotiveHandle
+/// @brief A 32-bit reference to motivator data inside a MotiveProcessor.
+///
+/// An alternative to Motivator. The processor keeps no pointer back to the
+/// handle, so a handle is plain data: it can be copied, moved with memcpy,
+/// or stored in arrays that relocate, such as component arrays in an
+/// entity-component system. The trade-off is that nothing frees the data
+/// when the handle goes away. Call MotiveProcessor::RemoveHandle() instead.
+///
+/// The low kSlotBits bits select an entry in the processor's handle table,
+/// which holds the current index of the data. Defragmenting only updates the
+/// table. The high bits are a generation count that's bumped whenever the
+/// entry is freed, so a stale handle is detected instead of reading data
+/// that now belongs to someone else.
+///
+/// Handles are only meaningful to the processor that created them.
+class MotiveHandle {
+ public:
+  static const int kSlotBits = 20;
+  static const uint32_t kSlotMask = (1u << kSlotBits) - 1;
+  static const uint32_t kGenerationMask = ~0u >> kSlotBits;
+
+  /// The largest number of handles a processor can have at once.
+  /// The all-ones slot is reserved for the invalid handle.
+  static const uint32_t kMaxSlots = kSlotMask;
+
+  /// Create an invalid handle.
+  MotiveHandle() : value_(~0u) {}
+
+  MotiveHandle(uint32_t slot, uint32_t generation)
+      : value_((generation & kGenerationMask) << kSlotBits |
+               (slot & kSlotMask)) {}
+
+  /// False for default-constructed handles, and for handles returned when
+  /// initialization fails. A true result doesn't mean the handle is still
+  /// live. See MotiveProcessor::ValidHandle() for that.
+  bool Valid() const { return value_ != ~0u; }
+
+  uint32_t slot() const { return value_ & kSlotMask; }
+  uint32_t generation() const { return value_ >> kSlotBits; }
+  uint32_t value() const { return value_; }
+
+  /// The generation that follows `generation`, wrapping around.
+  static uint32_t NextGeneration(uint32_t generation) {
+    return (generation + 1) & kGenerationMask;
+  }
+
+  bool operator==(const MotiveHandle& rhs) const {
+    return value_ == rhs.value_;
+  }
+  bool operator!=(const MotiveHandle& rhs) const { return !(*this == rhs); }
+
+ private:
+  uint32_t value_;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_HANDLE_H_
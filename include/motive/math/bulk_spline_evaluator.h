@@ -16,6 +16,8 @@
 #define MOTIVE_MATH_BULK_SPLINE_EVALUATOR_H_
 
 #include "motive/math/compact_spline.h"
+#include "motive/state.h"
+#include "motive/util/index_bit_set.h"
 #include "motive/util/optimizations.h"
 
 namespace motive {
@@ -38,11 +40,23 @@ class BulkSplineEvaluator {
  public:
   typedef int Index;
 
-  // TODO: Call BestProcessorOptimization() to initialize `optimizations_`.
-  BulkSplineEvaluator() : optimization_(kNoOptimizations) {
-    // Avoid "private member variable unused" warning on OSX.
-    (void)optimization_;
+  /// Uses the fastest kernels that the CPU supports. See SetOptimization().
+  BulkSplineEvaluator();
+
+  /// When true, always use the plain C++ kernels. The assembly kernels may
+  /// round differently, so results would depend on the platform.
+  void SetDeterministic(bool deterministic) { deterministic_ = deterministic; }
+
+  /// Choose the SIMD kernels for AdvanceFrame(). Defaults to
+  /// BestProcessorOptimization(), except on NEON, whose kernels ignore
+  /// playback rates and so must be asked for explicitly. Pass
+  /// kNoOptimizations to use the plain C++ kernels. Never pass something
+  /// better than BestProcessorOptimization(), since the CPU may not support
+  /// it.
+  void SetOptimization(ProcessorOptimization optimization) {
+    optimization_ = optimization;
   }
+  ProcessorOptimization Optimization() const { return optimization_; }
 
   /// Return the number of indices currently allocated. Each index is one
   /// spline that's being evaluated.
@@ -57,13 +71,20 @@ class BulkSplineEvaluator {
   ///   - splines are allocated or removed at the highest indices
   void SetNumIndices(const Index num_indices);
 
+  /// Allocate storage for `num_indices` splines, so that SetNumIndices()
+  /// doesn't reallocate until the number of splines exceeds `num_indices`.
+  void Reserve(const Index num_indices);
+
   /// Move the data at `old_index` into `new_index`. Move `count` indices total.
+  /// The ranges may overlap. The indices left behind have no spline.
   ///
-  /// Unused indices are still processed every frame. You can fill these index
-  /// holes with MoveIndex(), to move items from the last index into the hole.
-  /// Once all holes have been moved to the highest indices, you can call
-  /// SetNumIndices() to stop processing these highest indices. Note that this
-  /// is exactly what fplutil::IndexAllocator does. You should use that class to
+  /// Indices left without a spline, by this or by ClearSplines(), have
+  /// their active bits cleared, so AdvanceFrame() skips them. They still
+  /// take up room in every array, and split the runs that are evaluated in
+  /// bulk. You can fill these index holes with MoveIndices(), to move items
+  /// from the last index into the hole. Once all holes have been moved to the
+  /// highest indices, you can call SetNumIndices() to drop them. Note that
+  /// this is exactly what IndexAllocator does. You should use that class to
   /// keep your indices contiguous.
   void MoveIndices(const Index old_index, const Index new_index,
                    const Index count);
@@ -77,7 +98,7 @@ class BulkSplineEvaluator {
   /// MotiveIndex to delete the CompactSpline when it is no longer in use.
   template <typename AllocFn>
   void CopyIndices(Index dst, Index src, Index count, const AllocFn& alloc) {
-    MoveIndices(src, dst, count);
+    CopyIndexData(src, dst, count);
     for (int i = 0; i < count; ++i) {
       sources_[dst + i].spline = alloc(dst + i, sources_[src + i].spline);
     }
@@ -117,11 +138,51 @@ class BulkSplineEvaluator {
   /// Set repeat state for splines.
   void SetRepeating(const Index index, const Index count, bool repeat);
 
+  /// Skip `index` entirely in the next AdvanceFrame(). Its x doesn't
+  /// advance, and Y() and Derivative() keep their current values, so a held
+  /// index costs nothing. Make up the skipped time with AdvanceX() before the
+  /// next frame in which `index` is not held.
+  void SetHeld(const Index index, bool held) { held_.Assign(index, held); }
+
+  /// Move `index` along its spline by `delta_x`, scaled by its playback
+  /// rate, without evaluating it. The next AdvanceFrame() moves onto the
+  /// right segment and evaluates. See SetHeld().
+  void AdvanceX(const Index index, const float delta_x) {
+    cubic_xs_[index] += delta_x * sources_[index].rate;
+  }
+
   /// Increment x and update the Y() and Derivative() values for all indices.
   /// Process all indices in bulk to efficiently traverse memory and allow SIMD
   /// instructions to be effective.
   void AdvanceFrame(const float delta_x);
 
+  /// Same as AdvanceFrame(), but only for the indices in [begin, end).
+  /// Only data for indices in [begin, end) is touched, so non-overlapping
+  /// ranges can be advanced concurrently on separate threads, as long as
+  /// each range starts on a multiple of IndexBitSet::kBitsPerWord.
+  ///
+  /// Splines that have played past their end are not re-evaluated, since
+  /// their value is constant. If `ended` is not null, the bit of every index
+  /// whose spline played past its end in this call is set in it.
+  void AdvanceFrameRange(const float delta_x, const Index begin,
+                         const Index end, IndexBitSet* ended = nullptr);
+
+  /// Advance only the spline at `index` by `delta_x`, and update its Y() and
+  /// Derivative() values. Unlike AdvanceFrame(), this jumps straight to the
+  /// segment at the new x, so the cost does not grow with `delta_x`.
+  /// If `ended` is not null, the bit for `index` is set in it when its
+  /// spline plays past its end, as in AdvanceFrameRange().
+  void FastForward(const Index index, const float delta_x,
+                   IndexBitSet* ended = nullptr);
+
+  /// Write the state of every index to `state`. The splines themselves are
+  /// referenced by pointer, not copied.
+  void SaveState(MotiveState* state) const;
+
+  /// Read back the state written by SaveState(). NumIndices() must be the
+  /// same as when the state was saved; otherwise returns false.
+  bool RestoreState(MotiveStateReader* reader);
+
   /// Return true if the spline for `index` has valid spline data.
   bool Valid(const Index index) const;
 
@@ -205,6 +266,10 @@ class BulkSplineEvaluator {
   /// Return x-value at the end of the spline.
   float EndX(const Index index) const { return sources_[index].spline->EndX(); }
 
+  /// True once a spline that doesn't repeat has played past its end. Its
+  /// value won't change until it's given a new spline.
+  bool Ended(const Index index) const { return !active_.Test(index); }
+
   /// Return y-value at the end of the spline.
   float EndY(const Index index) const { return sources_[index].spline->EndY(); }
 
@@ -288,6 +353,10 @@ class BulkSplineEvaluator {
 
  private:
   void InitCubic(const Index index, const float start_x);
+
+  // Like MoveIndices(), but leaves the data at `old_index` as it is.
+  void CopyIndexData(const Index old_index, const Index new_index,
+                     const Index count);
   float SplineStartX(const Index index) const {
     return sources_[index].spline->StartX();
   }
@@ -304,14 +373,30 @@ class BulkSplineEvaluator {
                     const SplinePlayback& playback);
 
   // These functions have C and assembly language variants.
-  void UpdateCubicXsAndGetMask(const float delta_x, uint8_t* masks);
-  void UpdateCubicXsAndGetMask_C(const float delta_x, uint8_t* masks);
-  size_t UpdateCubicXs(const float delta_x, Index* indices_to_init);
-  size_t UpdateCubicXs_TwoSteps(const float delta_x, Index* indices_to_init);
-  size_t UpdateCubicXs_OneStep(const float delta_x, Index* indices_to_init);
+  // They operate on the indices in [begin, end).
+  void UpdateCubicXsAndGetMask(const float delta_x, const Index begin,
+                               const Index end, uint8_t* masks);
+  void UpdateCubicXsAndGetMask_C(const float delta_x, const Index begin,
+                                 const Index end, uint8_t* masks);
+  size_t UpdateCubicXs(const float delta_x, const Index begin,
+                       const Index end, Index* indices_to_init);
+  size_t UpdateCubicXs_TwoSteps(const float delta_x, const Index begin,
+                                const Index end, Index* indices_to_init);
+  size_t UpdateCubicXs_OneStep(const float delta_x, const Index begin,
+                               const Index end, Index* indices_to_init);
   void EvaluateIndex(const Index index);
-  void EvaluateCubics();
-  void EvaluateCubics_C();
+  void EvaluateCubics(const Index begin, const Index end);
+  void EvaluateCubics_C(const Index begin, const Index end);
+
+  // Which x86 kernels to run. Both are false in deterministic mode.
+  bool UseAvx2() const {
+    return optimization_ == kAvx2Optimizations && !deterministic_;
+  }
+  bool UseSse() const {
+    return (optimization_ == kSse3Optimizations ||
+            optimization_ == kSsse3Optimizations) &&
+           !deterministic_;
+  }
 
   struct Source {
     Source()
@@ -376,6 +461,7 @@ class BulkSplineEvaluator {
   // So, we`ll have a few reallocs (which are slow) until the highwater mark is
   // reached. Then the cost of reallocs disappears. In this way we have a
   // reasonable tradeoff between memory conservation and runtime performance.
+  // Call Reserve() to jump straight to the highwater mark.
 
   /// Source spline nodes and our current index into these splines.
   std::vector<Source> sources_;
@@ -403,6 +489,15 @@ class BulkSplineEvaluator {
   /// Stratch buffer used for internal calculations.
   std::vector<Index> scratch_;
 
+  /// Bit i is set if `ys_[i]` must be re-evaluated in AdvanceFrame(). Clear
+  /// once a non-repeating spline has gone past its end, since `cubics_[i]`
+  /// is then constant.
+  IndexBitSet active_;
+
+  /// Bit i is set if `ys_[i]` should keep its value this frame, even though
+  /// `cubic_xs_[i]` advances. Used to update indices at a reduced rate.
+  IndexBitSet held_;
+
   /// Call the specified optimized functions, when available, instead of the
   /// plain C++ functions. Note that we must perform this check at runtime,
   /// not compile time: some platforms may or may not support all the
@@ -411,6 +506,9 @@ class BulkSplineEvaluator {
   /// support neither. Therefore, x86 code always includes the C++ functions as
   /// a fallback, and chooses the best functions at runtime.
   ProcessorOptimization optimization_;
+
+  /// If true, ignore `optimization_`. See SetDeterministic().
+  bool deterministic_;
 };
 
 }  // namespace motive
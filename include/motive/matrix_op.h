@@ -370,6 +370,34 @@ class MatrixOperation {
     motivator_.SetSplineRepeating(repeat);
   }
 
+  void SetUpdateInterval(int interval, int phase) {
+    if (!motivator_.Valid()) return;
+    motivator_.SetUpdateInterval(interval, phase);
+  }
+
+  void SetLocalityKey(uint64_t key) {
+    if (!motivator_.Valid()) return;
+    motivator_.SetLocalityKey(key);
+  }
+
+  void FastForward(MotiveTime delta_time) {
+    if (!motivator_.Valid()) return;
+    motivator_.FastForward(delta_time);
+  }
+
+  // Save the constant value. An animated value is saved by the processor of
+  // the child motivator.
+  void SaveState(MotiveState* state) const {
+    state->Write(matrix_operation_id_);
+    state->Write(const_value_);
+  }
+
+  bool RestoreState(MotiveStateReader* reader) {
+    const MatrixOpId id = reader->Read<MatrixOpId>();
+    if (!reader->Check(id == matrix_operation_id_)) return false;
+    return reader->Read(&const_value_, 1);
+  }
+
   MotiveTime TimeRemaining() const {
     if (motivator_.Valid()) {
       // Return the time time to reach the target for the motivator.
@@ -15,8 +15,12 @@
 #ifndef MOTIVE_MATRIX_PROCESSOR_H_
 #define MOTIVE_MATRIX_PROCESSOR_H_
 
+#include <cstring>
+
 #include "motive/matrix_op.h"
 #include "motive/processor.h"
+#include "motive/snapshot.h"
+#include "motive/util/hash.h"
 
 namespace motive {
 
@@ -70,6 +74,40 @@ class MatrixProcessor4f : public MotiveProcessor {
   /// a playback rate of 0.5 will take 2s to finish.  However, TimeRemaining()
   /// at the start of the animation will return 1s.
   virtual MotiveTime TimeRemaining(MotiveIndex index) const = 0;
+
+  /// Unused indices are skipped.
+  virtual uint64_t HashOutputs(uint64_t hash) const {
+    const MotiveIndex num_indices = NumIndices();
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      if (ValidIndex(i)) hash = HashValues(&Value(i), 1, hash);
+    }
+    return hash;
+  }
+
+ protected:
+  /// The 16 floats of the matrix.
+  virtual int NumOutputFloats() const {
+    return static_cast<int>(sizeof(mathfu::mat4) / sizeof(float));
+  }
+  virtual const float* OutputFloats(MotiveIndex index) const {
+    return reinterpret_cast<const float*>(&Value(index));
+  }
+
+  /// Writes the matrix. `stride` is unused, since there's only one output.
+  virtual void WriteOutputBinding(MotiveIndex index, uint8_t* destination,
+                                  size_t /*stride*/) const {
+    memcpy(destination, &Value(index), sizeof(mathfu::mat4));
+  }
+
+  /// Unused indices are given the identity matrix.
+  virtual void WriteSnapshot(ProcessorSnapshot* snapshot) const {
+    const MotiveIndex num_indices = NumIndices();
+    snapshot->matrices.resize(num_indices);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      snapshot->matrices[i] =
+          ValidIndex(i) ? Value(i) : mathfu::mat4::Identity();
+    }
+  }
 };
 
 }  // namespace motive
@@ -85,8 +85,40 @@ class Motivator {
     }
   }
 
+  /// Initialize the `count` Motivators in `motivators` to the motion
+  /// algorithm specified by `init`, each occupying `dimensions` slots.
+  /// Equivalent to initializing each Motivator individually, but the
+  /// processor's storage grows at most once, and the per-Motivator
+  /// bookkeeping is done in one pass. Prefer this when spawning many
+  /// Motivators at once.
+  ///
+  /// Any Motivators that are already valid are invalidated first.
+  ///
+  /// @return false if the processor doesn't have room for all `count`
+  ///         Motivators under its cap (see MotiveEngine::SetMaxIndices()).
+  ///         None of the Motivators are initialized in that case.
+  static bool InitializeBatch(const MotivatorInit& init, MotiveEngine* engine,
+                              MotiveDimension dimensions,
+                              Motivator* const* motivators, MotiveIndex count);
+
+  /// Invalidate the `count` Motivators in `motivators`. Equivalent to calling
+  /// Invalidate() on each of them, but Motivators that were initialized
+  /// together with InitializeBatch() are freed together.
+  static void InvalidateBatch(Motivator* const* motivators, MotiveIndex count);
+
+  /// Write this Motivator's outputs into `destination` at the end of every
+  /// MotiveEngine::AdvanceFrame(), each `stride` bytes after the one before.
+  /// Pass nullptr to stop. The binding is dropped when the Motivator is
+  /// invalidated. See MotiveProcessor::SetOutputBinding() for details.
+  void BindOutput(void* destination, size_t stride) {
+    assert(Valid());
+    processor_->SetOutputBinding(index_, destination, stride);
+  }
+
   /// Return true if this Motivator is currently being driven by a
   /// MotiveProcessor. That is, if it has been successfully initialized.
+  /// Initialization fails if the processor is already at its cap. See
+  /// MotiveEngine::SetMaxIndices().
   bool Valid() const { return processor_ != nullptr; }
 
   /// Check consistency of internal state. Useful for debugging.
@@ -125,6 +157,51 @@ class Motivator {
     }
   }
 
+  /// Advance this Motivator only once every `interval` frames. In between,
+  /// its value is held. An interval of 1 updates every frame.
+  ///
+  /// Motivators given an interval are spread over the frames, so that their
+  /// updates don't all land on the same frame. Motivators that drive child
+  /// Motivators, such as RigMotivators, pass the interval on to their
+  /// children. See MotiveProcessor::SetUpdateInterval().
+  void SetUpdateInterval(int interval) {
+    if (Valid()) {
+      processor_->SetUpdateInterval(
+          index_, interval, processor_->StaggeredUpdatePhase(interval));
+    }
+  }
+
+  /// Same as SetUpdateInterval(interval), but the first update happens
+  /// `phase` frames from now. `phase` must be less than `interval`.
+  void SetUpdateInterval(int interval, int phase) {
+    if (Valid()) {
+      processor_->SetUpdateInterval(index_, interval, phase);
+    }
+  }
+
+  /// Return the interval set by SetUpdateInterval().
+  int UpdateInterval() const { return processor_->UpdateInterval(index_); }
+
+  /// Keep this Motivator's data near that of Motivators with nearby keys,
+  /// when the processor's reordering is on. Motivators driven by a parent
+  /// are keyed by the parent, so only call this for top-level Motivators.
+  /// See MotiveProcessor::SetLocalityKey().
+  void SetLocalityKey(uint64_t key) {
+    if (Valid()) {
+      processor_->SetLocalityKey(index_, key);
+    }
+  }
+
+  /// Jump ahead by `delta_time`, as if the engine had been advanced by
+  /// `delta_time` for this Motivator only. Takes roughly constant time, no
+  /// matter how large `delta_time` is.
+  /// See MotiveProcessor::FastForward().
+  void FastForward(MotiveTime delta_time) {
+    if (Valid()) {
+      processor_->FastForward(index_, delta_time);
+    }
+  }
+
  protected:
   Motivator(const MotivatorInit& init, MotiveEngine* engine,
             MotiveDimension dimensions)
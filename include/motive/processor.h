@@ -18,15 +18,20 @@
 #include <vector>
 
 #include "motive/common.h"
+#include "motive/event.h"
+#include "motive/handle.h"
 #include "motive/math/compact_spline.h"
 #include "motive/math/vector_converter.h"
+#include "motive/state.h"
 #include "motive/target.h"
 #include "motive/util/index_allocator.h"
+#include "motive/util/index_bit_set.h"
 
 namespace motive {
 
 class Motivator;
 class MotiveEngine;
+struct ProcessorSnapshot;
 
 /// @class MotiveProcessor
 /// @brief A MotiveProcessor processes *all* instances of one type of Motivator.
@@ -59,7 +64,20 @@ class MotiveProcessor {
       : index_allocator_(allocator_callbacks_),
         engine_(nullptr),
         benchmark_id_for_advance_frame_(-1),
-        benchmark_id_for_init_(-1) {
+        benchmark_id_for_init_(-1),
+        indices_pinned_(false),
+        defragment_budget_(kNoDefragmentBudget),
+        locality_sort_budget_(0),
+        locality_spare_(kMotiveIndexInvalid),
+        locality_spare_dimensions_(0),
+        locality_dirty_(false),
+        has_update_intervals_(false),
+        next_update_phase_(0),
+        max_indices_(kNoMaxIndices),
+        num_output_bindings_(0),
+        events_enabled_(false),
+        track_changes_(false),
+        change_epsilon_(0.0f) {
     allocator_callbacks_.set_processor(this);
   }
   virtual ~MotiveProcessor();
@@ -83,15 +101,61 @@ class MotiveProcessor {
   /// @param dimensions The number of slots to consume in the MotiveProcessor.
   ///                   For example, a 3D vector would consume three slots in
   ///                   a MotiveProcessor of floats.
-  void InitializeMotivator(const MotivatorInit& init, MotiveEngine* engine,
+  /// @return false if the processor has reached MaxIndices(). `motivator` is
+  ///         then left invalid, and the processor is unchanged.
+  bool InitializeMotivator(const MotivatorInit& init, MotiveEngine* engine,
                            Motivator* motivator, MotiveDimension dimensions);
 
+  /// Same as calling InitializeMotivator() on each of the `count` Motivators
+  /// in `motivators`, but the indices are allocated all at once, and the
+  /// per-call overhead is paid once for the batch instead of once per
+  /// Motivator. Useful when spawning many objects in the same frame.
+  ///
+  /// This function should only be called by Motivator::InitializeBatch().
+  ///
+  /// The Motivators are given adjacent indices: `motivators[i]` is given the
+  /// index returned plus `i * dimensions`. The Motivators must all be
+  /// invalid.
+  ///
+  /// @return The index of `motivators[0]`, or kMotiveIndexInvalid if the
+  ///         processor doesn't have room for all of them under MaxIndices().
+  ///         In that case, none of the Motivators are initialized.
+  MotiveIndex InitializeMotivators(const MotivatorInit& init,
+                                   MotiveEngine* engine,
+                                   Motivator* const* motivators,
+                                   MotiveIndex count,
+                                   MotiveDimension dimensions);
+
   /// Initializes `dst` to be a clone of the Motivator referenced by `src`.
+  /// `dst` is left invalid if the processor has reached MaxIndices().
   ///
   /// @param dst The Motivator to initialize.
   /// @param src The index of the Motivator to use to initialize `dst`.
   void CloneMotivator(Motivator* dst, MotiveIndex src);
 
+  /// Allocate storage for `num_indices` indices up front. Until the total
+  /// number of indices exceeds `num_indices`, initializing Motivators never
+  /// reallocates any of the processor's arrays, so the cost of growing can be
+  /// paid while loading instead of mid-game. Never shrinks storage.
+  ///
+  /// Only this processor's storage is reserved. Motivators that create child
+  /// Motivators, like MatrixMotivators, also need room reserved in the
+  /// processors of their children.
+  void Reserve(MotiveIndex num_indices);
+
+  /// Never grow beyond `max_indices` indices. Once the cap is reached,
+  /// initializing a Motivator fails, and leaves the Motivator invalid, so
+  /// check Motivator::Valid() after initializing. Freed indices are still
+  /// recycled, so Motivators can be created again once others are
+  /// invalidated. Pass kNoMaxIndices to remove the cap, which is the default.
+  ///
+  /// Doesn't affect indices that are already allocated, even if there are
+  /// more than `max_indices` of them.
+  void SetMaxIndices(MotiveIndex max_indices);
+  MotiveIndex MaxIndices() const { return max_indices_; }
+  static const MotiveIndex kNoMaxIndices =
+      std::numeric_limits<MotiveIndex>::max();
+
   /// Remove an motivator and return its index to the pile of allocatable
   /// indices.
   ///
@@ -100,6 +164,14 @@ class MotiveProcessor {
   /// @param index Reference into the MotiveProcessor's internal arrays.
   void RemoveMotivator(MotiveIndex index);
 
+  /// Same as calling RemoveMotivator() on each of the `count` Motivators in
+  /// `motivators`, which must all be driven by this processor. Motivators
+  /// with adjacent indices, like those from InitializeMotivators(), are
+  /// removed together.
+  ///
+  /// This function should only be called by Motivator::InvalidateBatch().
+  void RemoveMotivators(Motivator* const* motivators, MotiveIndex count);
+
   /// Transfer ownership of the motivator at `index` to 'new_motivator'.
   /// Resets the Motivator that currently owns `index` and initializes
   /// 'new_motivator'.
@@ -134,6 +206,40 @@ class MotiveProcessor {
     return ValidIndex(index) && motivators_[index] == motivator;
   }
 
+  /// Same as InitializeMotivator(), but the data is referenced by the
+  /// returned handle instead of by a Motivator. The processor keeps no
+  /// pointer to the owner of the handle, so the handle can be copied or
+  /// relocated freely, and Defragment() only updates the handle table.
+  ///
+  /// Use HandleIndex() to get the data's current index, and pass that index
+  /// to the processor's other functions. The index is only stable until the
+  /// next Defragment(), so don't keep it across frames.
+  ///
+  /// @return An invalid handle if the processor has reached MaxIndices(), or
+  ///         has run out of handles.
+  MotiveHandle InitializeHandle(const MotivatorInit& init,
+                                MotiveEngine* engine,
+                                MotiveDimension dimensions);
+
+  /// Free the data referenced by `handle`, which must be live. Afterwards,
+  /// ValidHandle() returns false for `handle` and all its copies.
+  void RemoveHandle(MotiveHandle handle);
+
+  /// Returns true if `handle` was created by InitializeHandle() on this
+  /// processor, and hasn't been removed.
+  bool ValidHandle(MotiveHandle handle) const {
+    return handle.slot() < handle_slots_.size() &&
+           handle_slots_[handle.slot()].generation == handle.generation() &&
+           handle_slots_[handle.slot()].index != kMotiveIndexInvalid;
+  }
+
+  /// The current index of the data referenced by `handle`, which must be
+  /// live.
+  MotiveIndex HandleIndex(MotiveHandle handle) const {
+    assert(ValidHandle(handle));
+    return handle_slots_[handle.slot()].index;
+  }
+
   /// Advance the simulation by `delta_time`.
   ///
   /// This function should only be called by MotiveEngine::AdvanceFrame.
@@ -142,6 +248,62 @@ class MotiveProcessor {
   ///                   are determined by the user.
   virtual void AdvanceFrame(MotiveTime delta_time) = 0;
 
+  /// Return true if this processor implements BeginAdvanceFrame(),
+  /// AdvanceFrameRange(), and EndAdvanceFrame(). The MotiveEngine can then
+  /// split the processor's indices into chunks and advance those chunks on
+  /// separate threads. Processors that return false are always advanced with
+  /// a single call to AdvanceFrame().
+  ///
+  /// For ranged processors, AdvanceFrame() must be equivalent to,
+  ///     BeginAdvanceFrame(delta_time);
+  ///     AdvanceFrameRange(delta_time, 0, NumIndices());
+  ///     EndAdvanceFrame(delta_time);
+  virtual bool SupportsAdvanceFrameRange() const { return false; }
+
+  /// The ranges passed to AdvanceFrameRange() start on multiples of this.
+  /// Matches IndexBitSet::kBitsPerWord.
+  static const MotiveIndex kAdvanceFrameRangeAlignment = 64;
+
+  /// Called once per frame, before any call to AdvanceFrameRange().
+  /// By default, Defragment()s the indices so that NumIndices() is fixed
+  /// for the rest of the frame.
+  ///
+  /// The ranges passed to AdvanceFrameRange() may be chosen before this is
+  /// called, so it may shrink NumIndices() but never grow it. It may run
+  /// concurrently with other processors of the same stage, so it must not
+  /// read other processors' output.
+  virtual void BeginAdvanceFrame(MotiveTime /*delta_time*/) { Defragment(); }
+
+  /// Advance the indices in [begin, end) by `delta_time`.
+  ///
+  /// May be called concurrently for non-overlapping ranges. Implementations
+  /// must only write data belonging to indices in [begin, end), and must
+  /// tolerate `begin` and `end` falling anywhere, even inside of a
+  /// multi-dimensional Motivator.
+  ///
+  /// `begin` is always a multiple of kAdvanceFrameRangeAlignment, and so is
+  /// `end` unless it's NumIndices(). Per-index bits, such as those in an
+  /// IndexBitSet, can therefore be written without synchronization.
+  virtual void AdvanceFrameRange(MotiveTime /*delta_time*/,
+                                 MotiveIndex /*begin*/, MotiveIndex /*end*/) {
+    // Hitting this assertion means SupportsAdvanceFrameRange() returned true
+    // but the processor didn't override this function.
+    assert(false);
+  }
+
+  /// Called once per frame, after all calls to AdvanceFrameRange() have
+  /// returned. Update processor-wide state, such as a global clock, here.
+  virtual void EndAdvanceFrame(MotiveTime /*delta_time*/) {}
+
+  /// The total number of indices in the processor, including indices that
+  /// are not currently driving a Motivator.
+  MotiveIndex NumIndices() const { return index_allocator_.num_indices(); }
+
+  /// The number of indices that AdvanceFrame() will actually compute. Used
+  /// to estimate how much work a processor has. Processors that skip settled
+  /// indices override this; by default, every index is counted.
+  virtual MotiveIndex NumActiveIndices() const { return NumIndices(); }
+
   /// Should return kType of the MotivatorInit class for the derived processor.
   /// kType is defined by the macro MOTIVE_INTERFACE, which is put in
   /// a processor's MotivatorInit derivation.
@@ -150,9 +312,32 @@ class MotiveProcessor {
   /// The lower the number, the sooner the MotiveProcessor gets updated.
   /// Should never change. We want a static ordering of processors.
   /// Some MotiveProcessors use the output of other MotiveProcessors, so
-  /// we impose a strict ordering here.
+  /// we impose a strict ordering here. See ReadsFrom() for a finer-grained
+  /// way to express the ordering.
   virtual int Priority() const = 0;
 
+  /// Return true if AdvanceFrame() reads the output of `other`. For example,
+  /// a processor that drives child Motivators reads from the processors of
+  /// those children. The MotiveEngine uses these dependencies to decide
+  /// which processors must run before this one, and which can run
+  /// concurrently with it.
+  ///
+  /// By default, a processor reads from every processor with a lower
+  /// Priority(). Processors that never read other processors should return
+  /// false, so that they can run alongside processors of lower Priority().
+  ///
+  /// Dependencies may form a cycle (for example, A reads B and B reads A).
+  /// In that case, every processor in the cycle is advanced by `delta_time`
+  /// and then advanced again with a `delta_time` of 0, so that each picks up
+  /// the others' latest output. Processors in a cycle must therefore treat
+  /// AdvanceFrame(0) as a re-evaluation that doesn't move time forward.
+  /// A processor reading from itself is not considered a cycle.
+  ///
+  /// Should never change once the processor has been created.
+  virtual bool ReadsFrom(const MotiveProcessor& other) const {
+    return other.Priority() < Priority();
+  }
+
   /// The number of slots occupied in the MotiveProcessor. For example,
   /// a position in 3D space would return 3. A single 4x4 matrix would return 1.
   MotiveDimension Dimensions(MotiveIndex index) const {
@@ -175,7 +360,259 @@ class MotiveProcessor {
   /// effect if it has been called before on this processor.
   void SetEngine(MotiveEngine* engine);
 
+  /// Copy the output of every index into `snapshot`, so that it can be read
+  /// by other threads while the processor continues to advance.
+  /// Called by the MotiveEngine at the end of AdvanceFrame(), in snapshot
+  /// mode.
+  void Snapshot(ProcessorSnapshot* snapshot) const;
+
+  /// Use only kernels that give bit-identical results on every platform.
+  /// Set by MotiveEngine::SetDeterministicMode(). Processors with assembly
+  /// kernels override this to fall back to their plain C++ kernels.
+  virtual void SetDeterministic(bool /*deterministic*/) {}
+
+  /// Fold the output of every index into `hash`, in index order. Called by
+  /// MotiveEngine::StateHash(). Override in the interface class for each
+  /// kind of output, as for WriteSnapshot().
+  virtual uint64_t HashOutputs(uint64_t hash) const { return hash; }
+
+  /// Append the simulation state of every index to `state`, including any
+  /// holes that Defragment() hasn't filled yet. Called by
+  /// MotiveEngine::SaveState().
+  void SaveState(MotiveState* state);
+
+  /// Read back the state written by SaveState(). The processor must hold the
+  /// same Motivators, at the same indices, as when the state was saved;
+  /// otherwise returns false. Copies into the existing arrays, so doesn't
+  /// allocate. With a verifying `reader`, only checks.
+  bool RestoreState(MotiveStateReader* reader);
+
+  /// When pinned, Defragment() does nothing, so Motivators keep their indices
+  /// from frame to frame. Set by the MotiveEngine in snapshot mode, where
+  /// readers on other threads look up data by index.
+  void SetIndicesPinned(bool pinned) { indices_pinned_ = pinned; }
+  bool IndicesPinned() const { return indices_pinned_; }
+
+  /// Move at most about `max_moved` indices in each Defragment(), so that
+  /// freeing many Motivators at once doesn't make the next frame spike. The
+  /// remaining holes are filled over the following frames. Processors skip
+  /// unused indices, so in the meantime the holes only cost a little
+  /// bookkeeping. Pass kNoDefragmentBudget, the default, to fill every hole
+  /// at once. See IndexAllocator::Defragment(Count).
+  void SetDefragmentBudget(MotiveIndex max_moved) {
+    defragment_budget_ = max_moved;
+  }
+  MotiveIndex DefragmentBudget() const { return defragment_budget_; }
+  static const MotiveIndex kNoDefragmentBudget =
+      std::numeric_limits<MotiveIndex>::max();
+
+  /// For internal use. Defragment, even if the indices are pinned.
+  /// Called by MotiveEngine::Defragment().
+  void ForceDefragment() { index_allocator_.Defragment(); }
+
+  /// Reorder the indices, a few at a time, so that Motivators with nearby
+  /// locality keys end up next to each other in the processor's arrays.
+  /// Each Defragment() swaps at most `max_swaps` pairs of Motivators, so
+  /// the cost of reordering is spread over the frames. Pass 0, the default,
+  /// to leave the indices in allocation order.
+  ///
+  /// Only Motivators and handles with a key are moved, and only into
+  /// indices held by other keyed Motivators of the same dimension. Unkeyed
+  /// indices stay where they are. See SetLocalityKey().
+  ///
+  /// Swaps go through a spare block of indices, as big as the biggest keyed
+  /// Motivator. The spare is allocated like any other block, so it counts
+  /// towards MaxIndices(), and is kept until reordering is turned off again.
+  /// Sorting only runs after keys have changed or indices have moved.
+  void SetLocalitySortBudget(MotiveIndex max_swaps);
+  MotiveIndex LocalitySortBudget() const { return locality_sort_budget_; }
+
+  /// Sort the Motivator or handle at `index` by `key`, when reordering is on.
+  /// Motivators that are read together should get nearby keys: for example,
+  /// the address of the CompactSpline they follow, or of the object that
+  /// owns them. Processors that drive child Motivators key the children by
+  /// the parent's index, so that the children end up in their parents'
+  /// order. See SetChildLocalityKeys(). The key is dropped when the index is
+  /// freed.
+  void SetLocalityKey(MotiveIndex index, uint64_t key) {
+    assert(ValidIndex(index));
+    if (locality_keys_[index] == key) return;
+    locality_keys_[index] = key;
+    locality_dirty_ = true;
+  }
+  uint64_t LocalityKey(MotiveIndex index) const {
+    return locality_keys_[index];
+  }
+  static const uint64_t kNoLocalityKey = ~static_cast<uint64_t>(0);
+
+  /// Swap at most `max_swaps` pairs of keyed Motivators towards their sorted
+  /// order. Returns true if the keyed indices are now fully sorted. Called by
+  /// Defragment() when LocalitySortBudget() is non-zero and the order may
+  /// have changed. Returns false, without moving anything, if there's no room
+  /// under MaxIndices() for the spare block.
+  bool SortByLocality(MotiveIndex max_swaps);
+
+  /// Advance the Motivator at `index` only once every `interval` frames, by
+  /// the time accumulated since its last update. In between, its value is
+  /// held. Useful for Motivators that don't need to be smooth, such as those
+  /// animating distant characters.
+  ///
+  /// The first update happens `phase` frames from now. Motivators that set
+  /// the same interval at the same time get different phases from
+  /// StaggeredUpdatePhase(), so that their updates are spread evenly over
+  /// the frames.
+  ///
+  /// Processors that drive child Motivators override this to pass the
+  /// interval and phase on to their children, so that the children update on
+  /// the same frames as their parent.
+  virtual void SetUpdateInterval(MotiveIndex index, int interval, int phase);
+  int UpdateInterval(MotiveIndex index) const {
+    return update_rates_[index].interval;
+  }
+
+  /// The number of frames until `index` is next updated, when it has an
+  /// update interval.
+  int UpdatePhase(MotiveIndex index) const {
+    return update_rates_[index].countdown;
+  }
+
+  /// A phase for a new update interval that avoids the phases given out
+  /// recently.
+  int StaggeredUpdatePhase(int interval) {
+    return next_update_phase_++ % interval;
+  }
+
+  /// Jump the Motivator at `index` ahead by `delta_time`, without advancing
+  /// the other Motivators. Useful for catching up Motivators that were
+  /// suspended while offscreen.
+  ///
+  /// Unlike calling AdvanceFrame(), the cost does not grow with `delta_time`.
+  /// Processors evaluate their curves at the new time directly where they
+  /// can. Simulated processors (e.g. overshoot) simulate short jumps, and
+  /// snap onto their target when the jump is long enough that the motion
+  /// has died out.
+  ///
+  /// A Motivator that finishes during the jump is reported, with the same
+  /// event as AdvanceFrame() would give it, by the next CollectEvents().
+  ///
+  /// The default does nothing, which is correct for Motivators whose value
+  /// doesn't change with time.
+  virtual void FastForward(MotiveIndex /*index*/, MotiveTime /*delta_time*/) {}
+
+  /// Write the outputs of the Motivator at `index` into `destination` at the
+  /// end of every frame, so that they don't have to be read back after
+  /// MotiveEngine::AdvanceFrame(). Each output is written `stride` bytes
+  /// after the one before it. What the outputs are depends on the processor:
+  /// MotiveProcessorNf writes one float per dimension, MatrixProcessor4f one
+  /// mathfu::mat4, and RigProcessor one mathfu::AffineTransform per bone.
+  ///
+  /// `destination` must stay valid until the binding is removed, either by
+  /// passing nullptr here, or by removing the Motivator. Values set between
+  /// frames, by SetTargets() for example, are not written until the next
+  /// frame.
+  void SetOutputBinding(MotiveIndex index, void* destination, size_t stride);
+
+  /// Write the outputs of every bound Motivator. See SetOutputBinding().
+  ///
+  /// This function should only be called by MotiveEngine, once this
+  /// processor has finished advancing.
+  void WriteOutputBindings() const;
+
+  /// Track the events described in MotiveEventType. Off by default, so that
+  /// processors don't track events that nobody reads.
+  /// This function should only be called by MotiveEngine.
+  void SetEventsEnabled(bool enabled) { events_enabled_ = enabled; }
+  bool EventsEnabled() const { return events_enabled_; }
+
+  /// Push an event onto `queue` for every Motivator and handle that finished
+  /// in the frame just advanced, or in a FastForward() since the frame
+  /// before.
+  ///
+  /// This function should only be called by MotiveEngine, once every
+  /// processor has finished advancing.
+  void CollectEvents(MotiveEventQueue* queue);
+
+  /// Track which outputs change each frame, so that consumers such as
+  /// renderers can skip the ones that didn't. After every frame,
+  /// ChangedIndices() holds the indices whose output moved by more than
+  /// `epsilon` since they were last reported. Comparing against the last
+  /// reported output, instead of the previous frame's, means slow drift is
+  /// reported once it adds up to `epsilon`.
+  ///
+  /// Const and settled Motivators aren't reported. Newly initialized ones
+  /// are reported in their first frame. Off by default.
+  void SetChangeTracking(bool track_changes, float epsilon);
+  bool ChangeTracking() const { return track_changes_; }
+  float ChangeEpsilon() const { return change_epsilon_; }
+
+  /// One bit per index, set if the output at that index changed in the last
+  /// frame. See SetChangeTracking(). Iterate with IndexBitSet::NextSet().
+  /// Bits of multi-dimensional Motivators are set per dimension.
+  const IndexBitSet& ChangedIndices() const { return changed_indices_; }
+
+  /// True if any dimension of the Motivator at `index` changed in the last
+  /// frame.
+  bool Changed(MotiveIndex index) const {
+    const MotiveIndex end = index + Dimensions(index);
+    return changed_indices_.NextSet(index, end) != end;
+  }
+
+  /// Recalculate ChangedIndices().
+  ///
+  /// This function should only be called by MotiveEngine, once this
+  /// processor has finished advancing.
+  void UpdateChangedIndices();
+
  protected:
+  /// Write the outputs of the Motivator at `index` to `destination`, each
+  /// `stride` bytes apart. See SetOutputBinding(). Override in the interface
+  /// class for each kind of output, as for WriteSnapshot().
+  virtual void WriteOutputBinding(MotiveIndex /*index*/,
+                                  uint8_t* /*destination*/,
+                                  size_t /*stride*/) const {
+    assert(false);
+  }
+
+  /// The event to report for the Motivator at `index`, one of whose
+  /// dimensions was passed to MarkEvent() this frame. Return
+  /// kMotiveEventNone if the event isn't complete yet, for example because
+  /// other dimensions are still moving. Marking those later asks again.
+  virtual MotiveEventType EventForIndex(MotiveIndex /*index*/,
+                                        MotiveDimension /*dimensions*/) const {
+    return kMotiveEventNone;
+  }
+
+  /// The number of floats of output at each index, as compared by
+  /// FindChangedIndices(). Processors that return 0 and don't override
+  /// FindChangedIndices() report every index as changed, every frame.
+  virtual int NumOutputFloats() const { return 0; }
+
+  /// The NumOutputFloats() floats of output at `index`.
+  virtual const float* OutputFloats(MotiveIndex /*index*/) const {
+    return nullptr;
+  }
+
+  /// Set the bit in `changed` of every index whose output has moved by more
+  /// than `epsilon` since it was last reported, and clear the others. The
+  /// default compares OutputFloats() against a copy taken whenever an index
+  /// is reported. Processors whose output size varies per index override
+  /// this, and keep their own copies.
+  virtual void FindChangedIndices(float epsilon, IndexBitSet* changed);
+
+  /// Called whenever the Motivators at [index, index + dimensions) are
+  /// initialized, cloned, or moved. Processors that drive child Motivators
+  /// override this to give each child a key from ChildLocalityKey(), so that
+  /// reordering keeps children in the order of their parents. Processors
+  /// that create children later, when blending to new ops for example, call
+  /// it again themselves.
+  virtual void SetChildLocalityKeys(MotiveIndex /*index*/,
+                                    MotiveDimension /*dimensions*/) {}
+
+  /// The locality key for the `child`th child of the Motivator at `index`.
+  static uint64_t ChildLocalityKey(MotiveIndex index, uint32_t child) {
+    return static_cast<uint64_t>(index) << 32 | child;
+  }
+
   /// Initialize data at [index, index + dimensions).
   /// The meaning of `index` is determined by the MotiveProcessor
   /// implementation (most likely it is the index into one or more data_ arrays
@@ -212,7 +649,9 @@ class MotiveProcessor {
   /// Move the data chunk of length `dimensions` from `old_index` into
   /// `new_index`. Used by Defragment().
   /// Note that the index range starting at `new_index` is guaranteed to be
-  /// inactive.
+  /// inactive, except where it overlaps the end of the old range.
+  /// The chunk can hold many Motivators, so move each array in one call.
+  /// See MoveRangeBytes() and MoveRangeObjects() in util/move_range.h.
   virtual void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                            MotiveDimension dimensions) = 0;
 
@@ -222,11 +661,83 @@ class MotiveProcessor {
   /// new items in the arrays should be initialized as reset.
   virtual void SetNumIndices(MotiveIndex num_indices) = 0;
 
+  /// Reserve room in internal arrays for `num_indices` indices, so that
+  /// calls to SetNumIndices() up to that size don't reallocate.
+  /// See Reserve().
+  virtual void ReserveIndices(MotiveIndex /*num_indices*/) {}
+
+  /// Write the state of indices [0, num_indices) to `state`. Everything that
+  /// AdvanceFrame() or a Motivator call can change must be written, so that
+  /// RestoreIndices() can rewind to it. Output that's recalculated every
+  /// frame may be skipped.
+  virtual void SaveIndices(MotiveState* /*state*/,
+                           MotiveIndex /*num_indices*/) const {}
+
+  /// Read back, in the same order, the state written by SaveIndices().
+  /// Report a mismatch with MotiveStateReader::Check(), and with a verifying
+  /// `reader`, don't change anything.
+  virtual void RestoreIndices(MotiveStateReader* /*reader*/,
+                              MotiveIndex /*num_indices*/) {}
+
+  /// Copy the processor's output into `snapshot`. Override in the interface
+  /// class for each kind of output; see MotiveProcessorNf, for example.
+  /// Only the output needs to be copied, not the simulation state.
+  virtual void WriteSnapshot(ProcessorSnapshot* /*snapshot*/) const {}
+
   /// When an index is moved, the Motivator that references that index is
   /// updated. Can be called at the discretion of your MotiveProcessor,
   /// but normally called at the beginning of your
   /// MotiveProcessor::AdvanceFrame.
-  void Defragment() { index_allocator_.Defragment(); }
+  /// Does nothing if the indices are pinned. See SetIndicesPinned().
+  /// Moves at most about DefragmentBudget() indices.
+  /// Also reorders the indices, if SetLocalitySortBudget() was given one.
+  void Defragment() {
+    if (indices_pinned_) return;
+    index_allocator_.Defragment(defragment_budget_);
+    if (locality_sort_budget_ > 0 && locality_dirty_) {
+      SortByLocality(locality_sort_budget_);
+    }
+  }
+
+  /// Call once per frame for each index in AdvanceFrameRange(). Returns true
+  /// if `index` should be advanced this frame. In that case `delta_time` is
+  /// increased to include the time skipped since `index` was last advanced.
+  /// Returns false if the index should be held. See SetUpdateInterval().
+  ///
+  /// Frames with a `delta_time` of 0 don't count towards the interval.
+  bool UpdateDue(MotiveIndex index, MotiveTime* delta_time) {
+    if (!has_update_intervals_) return true;
+    UpdateRate& rate = update_rates_[index];
+    if (rate.interval <= 1 && rate.skipped_time == 0) return true;
+    if (*delta_time == 0) return false;
+    if (rate.countdown > 0) {
+      rate.countdown--;
+      rate.skipped_time += *delta_time;
+      return false;
+    }
+    *delta_time += rate.skipped_time;
+    rate.countdown = static_cast<uint16_t>(rate.interval - 1);
+    rate.skipped_time = 0;
+    return true;
+  }
+
+  /// True if any index has ever been given an update interval. Processors
+  /// can skip calling UpdateDue() when false.
+  bool HasUpdateIntervals() const { return has_update_intervals_; }
+
+  /// Call from AdvanceFrameRange() or FastForward() when something happens
+  /// to `index` that may complete an event. At the end of the frame,
+  /// EventForIndex() is asked which event. Like the other bit sets, safe to
+  /// call concurrently for indices in different chunks.
+  void MarkEvent(MotiveIndex index) {
+    if (events_enabled_) pending_events_.Set(index);
+  }
+
+  /// The bits set by MarkEvent(), or nullptr if events are off. For
+  /// processors that hand the marking off to a bulk evaluator.
+  IndexBitSet* PendingEvents() {
+    return events_enabled_ ? &pending_events_ : nullptr;
+  }
 
   /// Return a handle to the MotiveEngine instance that owns this processor.
   MotiveEngine* Engine() { return engine_; }
@@ -236,16 +747,102 @@ class MotiveProcessor {
   typedef IndexAllocator<MotiveIndex> MotiveIndexAllocator;
   typedef MotiveIndexAllocator::IndexRange IndexRange;
 
+  /// Level-of-detail state for one index. See SetUpdateInterval().
+  struct UpdateRate {
+    UpdateRate() : interval(1), countdown(0), skipped_time(0) {}
+
+    /// Advance once every `interval` frames.
+    uint16_t interval;
+
+    /// Frames remaining until the next update.
+    uint16_t countdown;
+
+    /// Time accumulated over the frames that were skipped.
+    MotiveTime skipped_time;
+  };
+
   /// Allocate an index for `motivator` and initialize it to that index. Returns
-  /// the newly allocated index.
+  /// the newly allocated index, or kMotiveIndexInvalid if the processor has
+  /// reached `max_indices_`.
   MotiveIndex AllocateMotivatorIndices(Motivator* motivator,
                                        MotiveDimension dimensions);
 
   /// Don't notify derived class.
   void RemoveMotivatorWithoutNotifying(MotiveIndex index);
+  void RemoveHandleWithoutNotifying(uint32_t slot);
+
+  /// Where to write the outputs of one Motivator. See SetOutputBinding().
+  struct OutputBinding {
+    OutputBinding() : destination(nullptr), stride(0) {}
+    uint8_t* destination;
+    size_t stride;
+  };
+
+  /// Drop the output binding at `index`, if there is one.
+  void ClearOutputBinding(MotiveIndex index);
+
+  /// Forget the reported outputs of [index, index + dimensions), which are
+  /// no longer in use, so that the next Motivator there is reported as
+  /// changed.
+  void ResetChangedIndices(MotiveIndex index, MotiveDimension dimensions);
+
+  /// One entry in the handle table. See InitializeHandle().
+  struct HandleSlot {
+    HandleSlot() : index(kMotiveIndexInvalid), generation(0) {}
+
+    /// Current index of the handle's data, or kMotiveIndexInvalid if the
+    /// slot is free.
+    MotiveIndex index;
+
+    /// Handles whose generation doesn't match are stale.
+    uint32_t generation;
+  };
 
   /// Handle callbacks from IndexAllocator.
   void MoveIndexRangeBase(const IndexRange& source, MotiveIndex target);
+
+  /// Point the Motivator or handle that owns the block at `index` to
+  /// `new_index`, before its data is moved there.
+  void SetOwnerIndex(MotiveIndex index, MotiveIndex new_index);
+
+  /// Move the data, in this class and the derived class, of the indices
+  /// [source, source + count) to `target`. The owners must already point to
+  /// `target`. The indices left behind are cleared.
+  void MoveIndexData(MotiveIndex source, MotiveIndex target,
+                     MotiveIndex count);
+
+  /// Exchange the data and owners of the blocks of `dimensions` indices at
+  /// `a` and `b`, via the spare block, which must have room for them. See
+  /// SortByLocality().
+  void SwapIndexBlocks(MotiveIndex a, MotiveIndex b,
+                       MotiveDimension dimensions);
+
+  /// Make sure the spare block has at least `dimensions` indices. Returns
+  /// false if it can't grow without going over MaxIndices().
+  bool ReserveLocalitySpare(MotiveDimension dimensions);
+
+  /// Free the spare block, if there is one.
+  void ReleaseLocalitySpare();
+
+  /// Returns true if `index` is part of the spare block.
+  bool InLocalitySpare(MotiveIndex index) const {
+    return locality_spare_ <= index &&
+           index < locality_spare_ + locality_spare_dimensions_;
+  }
+
+  /// A keyed block of indices, gathered by SortByLocality().
+  struct LocalityBlock {
+    MotiveDimension dimensions;
+    uint64_t key;
+    MotiveIndex index;
+
+    bool operator<(const LocalityBlock& rhs) const {
+      if (dimensions != rhs.dimensions) return dimensions < rhs.dimensions;
+      if (key != rhs.key) return key < rhs.key;
+      return index < rhs.index;
+    }
+  };
+
   void SetNumIndicesBase(MotiveIndex num_indices);
 
   /// Proxy callbacks from IndexAllocator into MotiveProcessor.
@@ -273,6 +870,17 @@ class MotiveProcessor {
   /// here is updated.
   std::vector<Motivator*> motivators_;
 
+  /// For indices referenced by a MotiveHandle instead of a Motivator, the
+  /// slot in `handle_slots_`. kMotiveIndexInvalid everywhere else.
+  /// One per index, like `motivators_`.
+  std::vector<MotiveIndex> index_handle_slots_;
+
+  /// The handle table. Indexed by MotiveHandle::slot().
+  std::vector<HandleSlot> handle_slots_;
+
+  /// Slots in `handle_slots_` that are free to be reused.
+  std::vector<uint32_t> free_handle_slots_;
+
   /// Proxy calbacks into MotiveProcessor. The other option is to derive
   /// MotiveProcessor from IndexAllocator::CallbackInterface, but that would
   /// create a messier API, and not be great OOP.
@@ -292,6 +900,75 @@ class MotiveProcessor {
 
   int benchmark_id_for_advance_frame_;
   int benchmark_id_for_init_;
+
+  /// If true, Defragment() is a no-op. See SetIndicesPinned().
+  bool indices_pinned_;
+
+  /// See SetDefragmentBudget().
+  MotiveIndex defragment_budget_;
+
+  /// See SetLocalitySortBudget().
+  MotiveIndex locality_sort_budget_;
+
+  /// One per index. Only the first index of each Motivator is used.
+  /// See SetLocalityKey().
+  std::vector<uint64_t> locality_keys_;
+
+  /// First index of the owner-less block that SwapIndexBlocks() moves
+  /// through, or kMotiveIndexInvalid. See SetLocalitySortBudget().
+  MotiveIndex locality_spare_;
+  MotiveDimension locality_spare_dimensions_;
+
+  /// True if a key has changed or an index has moved since the last
+  /// SortByLocality() that finished.
+  bool locality_dirty_;
+
+  /// Scratch space for SortByLocality(), kept to avoid reallocating.
+  std::vector<LocalityBlock> locality_blocks_;
+  std::vector<MotiveIndex> locality_positions_;
+  std::vector<MotiveIndex> locality_block_at_;
+
+  /// One per index. See SetUpdateInterval().
+  std::vector<UpdateRate> update_rates_;
+
+  /// True once any index has an update interval greater than 1.
+  bool has_update_intervals_;
+
+  /// See StaggeredUpdatePhase().
+  int next_update_phase_;
+
+  /// See SetMaxIndices().
+  MotiveIndex max_indices_;
+
+  /// One per index. Only the first index of each Motivator is used.
+  /// See SetOutputBinding().
+  std::vector<OutputBinding> output_bindings_;
+
+  /// The number of non-null entries in `output_bindings_`, so that
+  /// WriteOutputBindings() costs nothing when nothing is bound.
+  MotiveIndex num_output_bindings_;
+
+  /// Bit i is set if MarkEvent(i) was called since the last CollectEvents().
+  /// FastForward() can mark indices between frames, so the bits follow
+  /// Defragment() like the other per-index data.
+  IndexBitSet pending_events_;
+
+  /// See SetEventsEnabled().
+  bool events_enabled_;
+
+  /// See SetChangeTracking().
+  bool track_changes_;
+  float change_epsilon_;
+  IndexBitSet changed_indices_;
+
+  /// One bit per index held by a Motivator or handle, so that
+  /// FindChangedIndices() can skip the holes without looking at the owners.
+  IndexBitSet live_indices_;
+
+  /// NumOutputFloats() per index, holding each index's output as it was
+  /// last reported by FindChangedIndices(). NaN for indices that haven't
+  /// been reported yet. Empty unless change tracking is on.
+  std::vector<float> reported_outputs_;
 };
 
 /// Static functions in MotiveProcessor-derived classes.
@@ -17,10 +17,35 @@
 
 #include "motive/engine.h"
 #include "motive/simple_init_template.h"
+#include "motive/util/index_bit_set.h"
+#include "motive/util/move_range.h"
 #include "motive/vector_processor.h"
 
 namespace motive {
 
+/// Save the per-index data, values, and active bits of a simple processor.
+/// Shared with processors that hold the same arrays without deriving from
+/// SimpleProcessorTemplate.
+template <class T>
+void SaveSimpleIndices(const std::vector<T>& data,
+                       const std::vector<float>& values,
+                       const IndexBitSet& active, MotiveIndex num_indices,
+                       MotiveState* state) {
+  state->Write(data.data(), num_indices);
+  state->Write(values.data(), num_indices);
+  state->Write(active.words(), active.num_words());
+}
+
+/// Read back the arrays written by SaveSimpleIndices().
+template <class T>
+void RestoreSimpleIndices(MotiveStateReader* reader, MotiveIndex num_indices,
+                          std::vector<T>* data, std::vector<float>* values,
+                          IndexBitSet* active) {
+  reader->Read(data->data(), num_indices);
+  reader->Read(values->data(), num_indices);
+  reader->Read(active->words(), active->num_words());
+}
+
 template <class T>
 class SimpleProcessorTemplate : public MotiveProcessorNf {
   template <typename F>
@@ -36,6 +61,8 @@ class SimpleProcessorTemplate : public MotiveProcessorNf {
  public:
   virtual ~SimpleProcessorTemplate() {}
 
+  virtual MotiveIndex NumActiveIndices() const { return active_.Count(); }
+
   // Accessors to allow the user to get and set simluation values.
   virtual const float* Values(MotiveIndex index) const {
     return &values_[index];
@@ -88,6 +115,22 @@ class SimpleProcessorTemplate : public MotiveProcessorNf {
       const MotiveIndex processor_index = i + index;
       Data(processor_index) = T(simple_init, i);
       values_[processor_index] = simple_init.start_values[i];
+      active_.Set(processor_index);
+    }
+  }
+
+  virtual void GatherVelocitiesAtIndices(const MotiveIndex* indices,
+                                         MotiveIndex count,
+                                         MotiveDimension dimensions,
+                                         float* out, size_t item_stride,
+                                         size_t dimension_stride) const {
+    for (MotiveDimension d = 0; d < dimensions; ++d) {
+      float* out_d = out + d * dimension_stride;
+      for (MotiveIndex i = 0; i < count; ++i) {
+        const MotiveIndex data_idx = indices[i] + d;
+        out_d[i * item_stride] =
+            SimpleVelocity(Data(data_idx), values_[data_idx]);
+      }
     }
   }
 
@@ -95,22 +138,61 @@ class SimpleProcessorTemplate : public MotiveProcessorNf {
     for (MotiveIndex i = index; i < index + dimensions; ++i) {
       Data(i) = T();
       values_[i] = 0.0f;
+      active_.Clear(i);
     }
   }
 
   virtual void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                            MotiveDimension dimensions) {
-    MotiveIndex old_i = old_index;
-    MotiveIndex new_i = new_index;
-    for (MotiveDimension i = 0; i < dimensions; ++i, ++new_i, ++old_i) {
-      data_[new_i] = data_[old_i];
-      values_[new_i] = values_[old_i];
+    MoveRangeBytes(&data_, old_index, new_index, dimensions);
+    MoveRangeBytes(&values_, old_index, new_index, dimensions);
+    active_.Move(old_index, new_index, dimensions);
+
+    // The vacated indices may be handed out again without being removed, so
+    // leave them as RemoveIndices() would.
+    MotiveIndex vacated_end;
+    for (MotiveIndex i = VacatedRange(old_index, new_index, dimensions,
+                                      &vacated_end);
+         i < vacated_end; ++i) {
+      data_[i] = T();
+      values_[i] = 0.0f;
+      active_.Clear(i);
     }
   }
 
   virtual void SetNumIndices(MotiveIndex num_indices) {
     data_.resize(num_indices);
     values_.resize(num_indices);
+    active_.Resize(num_indices, false);
+    SetValuesArray(values_.data());
+  }
+
+  virtual void ReserveIndices(MotiveIndex num_indices) {
+    data_.reserve(num_indices);
+    values_.reserve(num_indices);
+    active_.Reserve(num_indices);
+
+    // Reserving can move the values, so repoint FastValues() at them.
+    SetValuesArray(values_.data());
+  }
+
+  virtual void SaveIndices(MotiveState* state,
+                           MotiveIndex num_indices) const {
+    SaveSimpleIndices(data_, values_, active_, num_indices, state);
+  }
+
+  virtual void RestoreIndices(MotiveStateReader* reader,
+                              MotiveIndex num_indices) {
+    RestoreSimpleIndices(reader, num_indices, &data_, &values_, &active_);
+  }
+
+  // Derived classes mark indices as they go idle. The Motivator has reached
+  // its target once every dimension is idle.
+  virtual MotiveEventType EventForIndex(MotiveIndex index,
+                                        MotiveDimension dimensions) const {
+    const MotiveIndex end = index + dimensions;
+    return active_.NextSet(index, end) == end ? kMotiveEventTargetReached
+                                              : kMotiveEventNone;
   }
 
   const T& Data(MotiveIndex index) const {
@@ -125,6 +207,11 @@ class SimpleProcessorTemplate : public MotiveProcessorNf {
 
   std::vector<T> data_;
   std::vector<float> values_;
+
+  /// Bit i is set if index i is still moving. Derived classes skip the
+  /// other indices in AdvanceFrameRange(), and set the bit again when a new
+  /// target wakes the index.
+  IndexBitSet active_;
 };
 
 }  // namespace motive
@@ -0,0 +1,129 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_SNAPSHOT_H_
+#define MOTIVE_SNAPSHOT_H_
+
+#include <map>
+#include <vector>
+
+#include "mathfu/glsl_mappings.h"
+#include "mathfu/utilities.h"
+#include "motive/common.h"
+
+namespace motive {
+
+class Motivator;
+class MotiveProcessor;
+
+/// @class ProcessorSnapshot
+/// @brief The output of one MotiveProcessor, copied at the end of a frame.
+///
+/// Filled by MotiveProcessor::Snapshot(). Each kind of processor fills only
+/// the members that match its output.
+struct ProcessorSnapshot {
+  /// The Motivator that owned each index. Used to reject lookups from
+  /// Motivators that weren't around when the snapshot was taken.
+  std::vector<const Motivator*> motivators;
+
+  /// One float per index. Filled by MotiveProcessorNf.
+  std::vector<float> values;
+
+  /// One matrix per index. Filled by MatrixProcessor4f.
+  std::vector<mathfu::mat4, mathfu::simd_allocator<mathfu::mat4>> matrices;
+
+  /// The global transforms of every index, one after the other. The
+  /// transforms for index i are in
+  /// [transform_starts[i], transform_starts[i + 1]).
+  /// Filled by RigProcessor.
+  std::vector<mathfu::AffineTransform,
+              mathfu::simd_allocator<mathfu::AffineTransform>> transforms;
+  std::vector<size_t> transform_starts;
+};
+
+/// @class MotiveSnapshot
+/// @brief Immutable copy of every processor's output at the end of a frame.
+///
+/// Obtain with MotiveEngine::AcquireSnapshot(), when the engine is in
+/// snapshot mode. A snapshot is never modified while it is held by the
+/// reader, so it can be read on one thread while the next frame is being
+/// computed on another.
+///
+/// Motivators are looked up by address, in a table of the indices they held
+/// when the snapshot was taken. Lookups don't read the Motivator itself, so
+/// they stay correct while the simulation thread moves it, in
+/// MotiveEngine::Defragment() for example. Lookups return nullptr for
+/// Motivators that were not initialized when the snapshot was taken.
+///
+/// The reading thread must not Initialize(), Invalidate(), or move a
+/// Motivator while the simulation thread might also be using it.
+class MotiveSnapshot {
+ public:
+  typedef std::map<const MotiveProcessor*, ProcessorSnapshot> ProcessorMap;
+
+  MotiveSnapshot() : frame_(0) {}
+
+  /// The number of frames that had been advanced when this snapshot was
+  /// taken. 0 if no frame has been published yet.
+  uint64_t frame() const { return frame_; }
+
+  /// The values of a Motivator1f, Motivator2f, etc. There are
+  /// `motivator.Dimensions()` values.
+  const float* Values(const Motivator& motivator) const;
+
+  /// The value of a MatrixMotivator4f.
+  const mathfu::mat4* Matrix(const Motivator& motivator) const;
+
+  /// The global transforms of a RigMotivator, one per bone. Returns the
+  /// number of bones in `num_transforms`.
+  const mathfu::AffineTransform* GlobalTransforms(const Motivator& motivator,
+                                                  int* num_transforms) const;
+
+  /// @private For internal use. Called by MotiveEngine to refill the
+  /// snapshot.
+  ProcessorSnapshot& ForProcessor(const MotiveProcessor* processor) {
+    return processors_[processor];
+  }
+  void set_frame(uint64_t frame) { frame_ = frame; }
+  void Clear() {
+    processors_.clear();
+    entries_.clear();
+    frame_ = 0;
+  }
+
+  /// @private For internal use. Called by MotiveEngine once every processor
+  /// has been copied, to rebuild the table that Find() searches.
+  void IndexMotivators();
+
+ private:
+  /// Where a Motivator's data was when the snapshot was taken.
+  struct Entry {
+    const Motivator* motivator;
+    const ProcessorSnapshot* processor;
+    MotiveIndex index;
+  };
+
+  const ProcessorSnapshot* Find(const Motivator& motivator,
+                                MotiveIndex* index) const;
+
+  ProcessorMap processors_;
+
+  /// One entry per Motivator, sorted by address.
+  std::vector<Entry> entries_;
+  uint64_t frame_;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_SNAPSHOT_H_
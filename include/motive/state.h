@@ -0,0 +1,131 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_STATE_H_
+#define MOTIVE_STATE_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace motive {
+
+/// @class MotiveState
+/// @brief The simulation state of a MotiveEngine, as a raw blob of bytes.
+///
+/// Filled by MotiveEngine::SaveState() and read back by
+/// MotiveEngine::RestoreState(). Useful for rollback and rewinding.
+///
+/// The blob holds raw pointers to splines, animations, and Motivators, so it
+/// is only valid in the process that saved it. It cannot be written to disk
+/// or sent over the network.
+///
+/// Saving into the same MotiveState repeatedly reuses its memory, so once
+/// the blob has grown to its working size, saving doesn't allocate.
+class MotiveState {
+ public:
+  /// Empty the blob, but keep its memory.
+  void Clear() { bytes_.clear(); }
+
+  const uint8_t* data() const { return bytes_.data(); }
+  size_t size() const { return bytes_.size(); }
+
+  /// Append the raw bytes of `count` plain-data values.
+  template <class T>
+  void Write(const T* values, size_t count) {
+    const size_t num_bytes = count * sizeof(T);
+    if (num_bytes == 0) return;
+    const size_t offset = bytes_.size();
+    bytes_.resize(offset + num_bytes);
+    memcpy(&bytes_[offset], values, num_bytes);
+  }
+
+  template <class T>
+  void Write(const T& value) {
+    Write(&value, 1);
+  }
+
+ private:
+  std::vector<uint8_t> bytes_;
+};
+
+/// @class MotiveStateReader
+/// @brief Reads values from a MotiveState, in the order they were written.
+///
+/// The blob may not match the engine it's restored into, so every read is
+/// bounds checked. Reading past the end, or a failed Check(), marks the
+/// reader as failed, and every later read copies nothing.
+///
+/// A verifying reader walks the blob without copying into the arrays passed
+/// to Read(values, count), so that a restore can be checked in full before
+/// anything is overwritten. Single values from Read<T>() are still returned.
+class MotiveStateReader {
+ public:
+  explicit MotiveStateReader(const MotiveState& state, bool verifying = false)
+      : state_(&state), offset_(0), verifying_(verifying), ok_(true) {}
+
+  /// Copy the next `count` values into `values`, which must already have
+  /// room for them. Returns false, and copies nothing, if the blob is too
+  /// short or the reader has already failed.
+  template <class T>
+  bool Read(T* values, size_t count) {
+    return ReadBytes(values, count, sizeof(T), !verifying_);
+  }
+
+  /// Return the next value, or a value-initialized T if the read fails.
+  template <class T>
+  T Read() {
+    T value = T();
+    ReadBytes(&value, 1, sizeof(T), true);
+    return value;
+  }
+
+  /// Fail the read if `condition` is false. Returns true while the reader
+  /// hasn't failed, so callers can stop at the first mismatch.
+  bool Check(bool condition) {
+    if (!condition) ok_ = false;
+    return ok_;
+  }
+
+  /// True if no read or Check() has failed.
+  bool ok() const { return ok_; }
+
+  /// True if Read(values, count) only checks, and doesn't copy.
+  bool verifying() const { return verifying_; }
+
+  /// True once every byte has been read.
+  bool AtEnd() const { return offset_ == state_->size(); }
+
+ private:
+  bool ReadBytes(void* values, size_t count, size_t value_size, bool copy) {
+    if (!ok_ || count > (state_->size() - offset_) / value_size) {
+      ok_ = false;
+      return false;
+    }
+    const size_t num_bytes = count * value_size;
+    if (num_bytes == 0) return true;
+    if (copy) memcpy(values, state_->data() + offset_, num_bytes);
+    offset_ += num_bytes;
+    return true;
+  }
+
+  const MotiveState* state_;
+  size_t offset_;
+  bool verifying_;
+  bool ok_;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_STATE_H_
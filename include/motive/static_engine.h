@@ -0,0 +1,106 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_STATIC_ENGINE_H_
+#define MOTIVE_STATIC_ENGINE_H_
+
+#include <assert.h>
+
+#include "motive/engine.h"
+
+namespace motive {
+
+/// @private For internal use only.
+/// `value` is the position of `InitT` in `InitTs`. Fails to compile if
+/// `InitT` isn't in the list.
+template <class InitT, class... InitTs>
+struct MotiveTypeId;
+
+template <class InitT, class... Rest>
+struct MotiveTypeId<InitT, InitT, Rest...> {
+  static const int value = 0;
+};
+
+template <class InitT, class First, class... Rest>
+struct MotiveTypeId<InitT, First, Rest...> {
+  static const int value = 1 + MotiveTypeId<InitT, Rest...>::value;
+};
+
+/// @class StaticMotiveEngine
+/// @brief A MotiveEngine whose set of processors is fixed at compile time.
+///
+/// List the MotivatorInit types the engine will hold, for example,
+///     StaticMotiveEngine<OvershootInit, SplineInit> engine;
+/// Every listed type must have been registered with its Register() function
+/// before the engine is created.
+///
+/// All processors are created up front, in the constructor, so the first
+/// Motivator of each type doesn't pay for creating its processor, or for
+/// rebuilding the engine's schedule. Each listed type gets a dense integer
+/// ID, its position in the list, and Processor<InitT>() is an array access
+/// at that ID, rather than a lookup in the engine's map. The processor is
+/// still returned as a MotiveProcessor, so calls through it stay virtual,
+/// and Motivators read their values exactly as with a MotiveEngine.
+///
+/// The engine behaves like a MotiveEngine in every other way, and can still
+/// create processors for types that aren't in the list.
+template <class... InitTs>
+class StaticMotiveEngine : public MotiveEngine {
+ public:
+  static const int kNumProcessors = static_cast<int>(sizeof...(InitTs));
+  static_assert(kNumProcessors > 0, "List at least one MotivatorInit type.");
+
+  StaticMotiveEngine() { CreateProcessors(); }
+
+  /// Same as MotiveEngine::Reset(), but then recreates the listed
+  /// processors, which are always present. Also called through a
+  /// MotiveEngine pointer or reference, so the cached processors never
+  /// dangle.
+  void Reset() override {
+    MotiveEngine::Reset();
+    CreateProcessors();
+  }
+
+  /// The dense ID of `InitT`. That is, its position in the list of types.
+  template <class InitT>
+  static int TypeId() {
+    return MotiveTypeId<InitT, InitTs...>::value;
+  }
+
+  /// The processor for `InitT`, without a map lookup.
+  template <class InitT>
+  MotiveProcessor* Processor() {
+    return processors_[MotiveTypeId<InitT, InitTs...>::value];
+  }
+
+  using MotiveEngine::Processor;
+
+ private:
+  void CreateProcessors() {
+    const MotivatorType types[] = {InitTs::kType...};
+    for (int i = 0; i < kNumProcessors; ++i) {
+      processors_[i] = MotiveEngine::Processor(types[i]);
+
+      // If this fires, the type hasn't been registered. Call its Register()
+      // function before creating the engine.
+      assert(processors_[i] != nullptr);
+    }
+  }
+
+  MotiveProcessor* processors_[sizeof...(InitTs)];
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_STATIC_ENGINE_H_
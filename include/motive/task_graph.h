@@ -0,0 +1,115 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_TASK_GRAPH_H_
+#define MOTIVE_TASK_GRAPH_H_
+
+#include <vector>
+
+#include "motive/common.h"
+#include "motive/util/benchmark.h"
+
+namespace motive {
+
+class MotiveProcessor;
+
+/// @class MotiveTaskGraph
+/// @brief The work of one MotiveEngine::AdvanceFrame(), as a graph of tasks.
+///
+/// Lets a host job system run Motive's frame on its own threads or fibers.
+/// Get the graph from MotiveEngine::BeginAdvanceFrame(), call Run() exactly
+/// once for every task, and then call MotiveEngine::EndAdvanceFrame().
+///
+/// A task may only start once all of its Dependencies() have finished.
+/// Dependencies always have lower task indices, so running the tasks in index
+/// order on one thread is valid.
+///
+/// Tasks are also sorted into phases. Every dependency of a task is in an
+/// earlier phase, so an executor can ignore the dependency lists and instead
+/// run all the tasks of one phase concurrently, wait for them, and then move
+/// on to the next phase.
+class MotiveTaskGraph {
+ public:
+  enum TaskType {
+    /// Call MotiveProcessor::BeginAdvanceFrame().
+    kBeginAdvanceFrame,
+    /// Call MotiveProcessor::AdvanceFrameRange() on [begin, end).
+    kAdvanceFrameRange,
+    /// Call MotiveProcessor::EndAdvanceFrame().
+    kEndAdvanceFrame,
+    /// Call MotiveProcessor::AdvanceFrame(), for processors that can't be
+    /// split into ranges.
+    kAdvanceFrame,
+  };
+
+  struct Task {
+    MotiveProcessor* processor;
+    TaskType type;
+    MotiveIndex begin;
+    MotiveIndex end;
+    MotiveTime delta_time;
+    int phase;
+
+    /// Time spent in Run(). Recorded for benchmarks.
+    BenchmarkTime duration;
+  };
+
+  MotiveTaskGraph() : num_phases_(0) {}
+
+  int NumTasks() const { return static_cast<int>(tasks_.size()); }
+  int NumPhases() const { return num_phases_; }
+  const Task& task(int i) const { return tasks_[i]; }
+
+  /// The tasks that must finish before task `i` can start. Returns an array
+  /// of `num_dependencies` task indices, each less than `i`.
+  const int* Dependencies(int i, int* num_dependencies) const;
+
+  /// Execute task `i`. May be called concurrently for any tasks whose
+  /// dependencies have finished.
+  void Run(int i);
+
+  /// @private For internal use. Called by MotiveEngine to build the graph.
+  void Clear();
+  int AddTask(MotiveProcessor* processor, TaskType type, MotiveIndex begin,
+              MotiveIndex end, MotiveTime delta_time, int phase);
+  void AddDependency(int dependency);
+
+ private:
+  std::vector<Task> tasks_;
+
+  /// The dependencies of task i are
+  /// dependencies_[dependency_starts_[i]..dependency_starts_[i + 1]), where
+  /// the end of the last task is dependencies_.size().
+  std::vector<int> dependency_starts_;
+  std::vector<int> dependencies_;
+  int num_phases_;
+};
+
+/// @class MotiveTaskExecutor
+/// @brief Interface for running a MotiveTaskGraph on a host's job system.
+///
+/// Pass to MotiveEngine::AdvanceFrame() so that the frame runs on your threads.
+/// Motive creates no threads of its own when advanced this way.
+class MotiveTaskExecutor {
+ public:
+  virtual ~MotiveTaskExecutor() {}
+
+  /// Call graph->Run(i) once for every task i, respecting the dependencies
+  /// described in MotiveTaskGraph. Return only when every task has finished.
+  virtual void Execute(MotiveTaskGraph* graph) = 0;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_TASK_GRAPH_H_
@@ -44,6 +44,12 @@ int RegisterBenchmark(const char* name);
 /// Dump an analysis of the samples to stdout.
 void OutputBenchmarks();
 
+/// Record a sample that was timed manually, for example by summing the times
+/// of several pieces of work that were done on separate threads.
+/// As with `Benchmark`, samples for one `id` must not be recorded from several
+/// threads at once.
+void AddBenchmarkSample(int id, BenchmarkTime sample);
+
 /// @class Benchmark
 /// @brief Record the time for the scope of this variable.
 ///
@@ -66,10 +72,13 @@ class Benchmark {
 #else // not defined(BENCHMARK_MOTIVE)
 
 // Stub out these calls so that they don't generate any code.
+typedef unsigned long long BenchmarkTime;
+inline BenchmarkTime GetBenchmarkTime() { return 0; }
 inline void InitBenchmarks(int /*num_ids*/) {}
 inline void ClearBenchmarks() {}
 inline int RegisterBenchmark(const char* /*name*/) { return -1; }
 inline void OutputBenchmarks() {}
+inline void AddBenchmarkSample(int /*id*/, BenchmarkTime /*sample*/) {}
 class Benchmark {
  public:
   explicit Benchmark(int /*id*/) {}
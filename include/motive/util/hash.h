@@ -0,0 +1,51 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_UTIL_HASH_H
+#define MOTIVE_UTIL_HASH_H
+
+/// @file
+/// Header (and all code) for the 64-bit FNV-1a hash.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace motive {
+
+/// Initial value for HashBytes().
+static const uint64_t kHashSeed = 14695981039346656037ULL;
+
+/// Fold `size` bytes from `data` into `hash`, with the FNV-1a algorithm.
+/// Not cryptographic, but fast, and enough to detect that two runs differ.
+/// To hash several buffers, pass the result of one call as the `hash` of the
+/// next.
+inline uint64_t HashBytes(const void* data, size_t size,
+                          uint64_t hash = kHashSeed) {
+  static const uint64_t kFnvPrime = 1099511628211ULL;
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+/// Fold the raw bytes of `count` plain-data values into `hash`.
+template <class T>
+inline uint64_t HashValues(const T* values, size_t count, uint64_t hash) {
+  return HashBytes(values, count * sizeof(T), hash);
+}
+
+}  // namespace motive
+
+#endif  // MOTIVE_UTIL_HASH_H
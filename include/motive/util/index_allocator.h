@@ -25,7 +25,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <cstring>
+#include <limits>
+#include <stdint.h>
 #include <type_traits>
+#include <vector>
 
 // Define this to 0 in the build file to disable sanity checks.
 #ifndef MOTIVE_INDEX_ALLOCATOR_VERIFY_INTERNAL_STATE
@@ -66,6 +69,11 @@ namespace motive {
 /// Whenever the array size is increased (durring Alloc()) or decreased (during
 /// Defragment()), a callback CallbackInterface::SetNumIndices() is called so
 /// that the user can grow or shrink the corresponding data.
+///
+/// Freed blocks are kept in segregated free lists, one per block size up to
+/// kMaxListedCount, so that recycling a block of a common size is O(1).
+/// Larger blocks share one list, which is searched. Adjacent freed blocks are
+/// only coalesced in Defragment().
 template <class Index>
 class IndexAllocator {
  public:
@@ -110,65 +118,110 @@ class IndexAllocator {
   ///              allocated indices is kept contiguous during Defragment()
   ///              calls. The index returned is the first index in the block.
   Index Alloc(Count count) {
-    // Recycle an unused index, if one exists and has the correct count.
-    typename std::vector<Index>::iterator least_excess_it = unused_indices_.end();
-    Count least_excess = std::numeric_limits<Count>::max();
-    for (auto it = unused_indices_.begin(); it != unused_indices_.end(); ++it) {
-      const Index unused_index = *it;
-      const Count excess = CountForIndex(unused_index) - count;
+    return Alloc(count, std::numeric_limits<Index>::max());
+  }
 
-      // Not big enough.
-      if (excess < 0)
-        continue;
+  /// Same as Alloc(count), but fails if the total number of indices would
+  /// have to grow beyond `max_num_indices`. Returns kInvalidIndex on failure,
+  /// and leaves the allocator unchanged.
+  Index Alloc(Count count, Index max_num_indices) {
+    assert(count > 0);
+
+    // Recycle an unused block of exactly the right size, if one exists.
+    if (count <= kMaxListedCount && !free_lists_[count].empty()) {
+      const Index unused_index = free_lists_[count].back();
+      free_lists_[count].pop_back();
+      return TakeUnused(unused_index);
+    }
 
-      // Perfect size. Remove from `unused_indices_` pool.
-      if (excess == 0) {
-        unused_indices_.erase(it);
-        return unused_index;
+    // Otherwise, split the unused block with the least excess size. The
+    // smaller listed sizes are all better fits than any large block.
+    for (Count c = count + 1; c <= kMaxListedCount; ++c) {
+      if (!free_lists_[c].empty()) {
+        const Index unused_index = free_lists_[c].back();
+        free_lists_[c].pop_back();
+        return SplitUnused(TakeUnused(unused_index), count);
       }
+    }
 
-      // Too big. We'll return the one with the least excess size.
-      if (excess < least_excess) {
+    std::vector<Index>& large = free_lists_[kLargeList];
+    typename std::vector<Index>::iterator least_excess_it = large.end();
+    Count least_excess = std::numeric_limits<Count>::max();
+    for (auto it = large.begin(); it != large.end(); ++it) {
+      const Count excess = CountForIndex(*it) - count;
+      if (0 <= excess && excess < least_excess) {
         least_excess = excess;
         least_excess_it = it;
+        if (excess == 0) break;
       }
     }
-
-    // The unused index has a count that's too high.
-    if (least_excess_it != unused_indices_.end()) {
-      // Return the first `count` indices.
-      const Index excess_index = *least_excess_it;
-      InitializeIndex(excess_index, count);
-
-      // Put the remainder in the `unused_indices_` pool.
-      const Index remainder_index = excess_index + count;
-      InitializeIndex(remainder_index, least_excess);
-      *least_excess_it = remainder_index;
-
-      return excess_index;
+    if (least_excess_it != large.end()) {
+      const Index unused_index = *least_excess_it;
+      *least_excess_it = large.back();
+      large.pop_back();
+      return SplitUnused(TakeUnused(unused_index), count);
     }
 
-    // Allocate a new index.
+    // Allocate a new index, if there's room.
     const Index new_index = num_indices();
+    if (new_index > max_num_indices - count) return kInvalidIndex;
     SetNumIndices(new_index + count);
     InitializeIndex(new_index, count);
     return new_index;
   }
 
+  /// Same as calling Alloc(count, max_num_indices) `num_blocks` times, except
+  /// that the blocks are adjacent, and are found in a single pass. Either one
+  /// unused block is carved up, or the number of indices grows with a single
+  /// SetNumIndices() callback. Returns the first index of the first block.
+  /// The n'th block starts at that index plus `n * count`. Returns
+  /// kInvalidIndex on failure, and leaves the allocator unchanged.
+  Index AllocBlocks(Count count, Count num_blocks, Index max_num_indices) {
+    assert(count > 0 && num_blocks > 0);
+    if (num_blocks > std::numeric_limits<Count>::max() / count)
+      return kInvalidIndex;
+
+    const Index first = Alloc(count * num_blocks, max_num_indices);
+    if (first == kInvalidIndex) return kInvalidIndex;
+
+    // Split the allocation into blocks, so that each can be freed on its own.
+    for (Count i = 0; i < num_blocks; ++i) {
+      InitializeIndex(first + i * count, count);
+    }
+    return first;
+  }
+
+  /// Allocate storage for `num_indices` indices, so that allocating and
+  /// freeing up to that many doesn't reallocate the allocator's own arrays.
+  /// Each free list gets room for as many blocks of its size as fit.
+  void Reserve(Index num_indices) {
+    counts_.reserve(num_indices);
+    unused_flags_.reserve(num_indices);
+    unused_indices_.reserve(num_indices);
+    for (Count c = 1; c <= kMaxListedCount; ++c) {
+      free_lists_[c].reserve(num_indices / c);
+    }
+    free_lists_[kLargeList].reserve(num_indices / (kMaxListedCount + 1));
+  }
+
   /// Recycle 'index'. It will be used in the next allocation, or backfilled in
   /// the next call to Defragment().
   /// @param index Index to be freed. Must be in the range
   ///              [0, num_indices_ - 1].
   void Free(Index index) {
     assert(ValidIndex(index));
-    unused_indices_.push_back(index);
+    AddUnused(index);
   }
 
   // Only one block of unused indices left, and they're at the end of the
   // array.
   bool UnusedAtEnd() const {
-    return unused_indices_.size() == 1 &&
-           NextIndex(unused_indices_[0]) == num_indices();
+    if (NumUnusedBlocks() != 1) return false;
+    for (Count c = 0; c <= kMaxListedCount; ++c) {
+      if (!free_lists_[c].empty())
+        return NextIndex(free_lists_[c][0]) == num_indices();
+    }
+    return false;
   }
 
   /// Backfill all unused index blocks. That is, move index blocks around
@@ -215,28 +268,70 @@ class IndexAllocator {
   /// function, so the final call to SetNumIndices() will never result in a
   /// reallocation of the underlying array (which would be slow).
   ///
-  void Defragment() {
+  void Defragment() { Defragment(std::numeric_limits<Count>::max()); }
+
+  /// Same as Defragment(), but stop once about `max_moved` indices have been
+  /// moved, and leave the remaining holes for the next call. Spreads the
+  /// cost of a burst of Free() calls over several calls.
+  ///
+  /// Every call moves at least one block, so repeated calls always finish.
+  /// A call can overshoot `max_moved` by less than the size of one block.
+  /// Holes at the end of the array are always trimmed, since that costs no
+  /// moves.
+  ///
+  /// Returns true if there are no holes left.
+  bool Defragment(Count max_moved) {
     // Quick check. An optimization.
-    if (unused_indices_.size() == 0) return;
+    if (NumUnusedBlocks() == 0) return true;
+
+    // Pull every hole out of the free lists, so that they can be sorted and
+    // coalesced. Holes that are left over go back through AddUnused().
+    for (Count c = 0; c <= kMaxListedCount; ++c) {
+      const std::vector<Index>& list = free_lists_[c];
+      for (ConstIndexIterator it = list.begin(); it != list.end(); ++it) {
+        TakeUnused(*it);
+      }
+      unused_indices_.insert(unused_indices_.end(), list.begin(), list.end());
+      free_lists_[c].clear();
+    }
 
+    Count num_moved = 0;
     for (;;) {
       // We check if unused index is the last index, so must be in sorted order.
       ConsolidateUnusedIndices();
 
       // If all the holes have been pushed to the end, we are done and can
       // trim the number of indices.
-      const bool unused_at_end = unused_indices_.size() == 1 &&
-                                 NextIndex(unused_indices_[0]) == num_indices();
-      if (unused_at_end) break;
+      if (unused_indices_.size() == 1 &&
+          NextIndex(unused_indices_[0]) == num_indices())
+        break;
+
+      // Out of budget. Trim the last hole, if it's at the end, and leave the
+      // rest for next time.
+      if (num_moved > 0 && num_moved >= max_moved) {
+        const Index last_unused = unused_indices_.back();
+        if (NextIndex(last_unused) == num_indices()) {
+          SetNumIndices(last_unused);
+          unused_indices_.pop_back();
+        }
+
+        // Return the coalesced holes to the free lists.
+        for (size_t i = 0; i < unused_indices_.size(); ++i) {
+          AddUnused(unused_indices_[i]);
+        }
+        unused_indices_.clear();
+        return false;
+      }
 
       // Find range of indices that will fit into the first block of
       // unused indices and move them into it.
-      BackfillFirstUnused();
+      num_moved += BackfillFirstUnused(max_moved - num_moved);
     }
 
     // Remove hole at end.
     SetNumIndices(unused_indices_[0]);
     unused_indices_.clear();
+    return true;
   }
 
   /// Returns true if there are no indices allocated.
@@ -252,20 +347,19 @@ class IndexAllocator {
     if (counts_[index] == 0)
       return false;
 
-    for (ConstIndexIterator it = unused_indices_.begin();
-         it != unused_indices_.end(); ++it) {
-      if (index == *it) return false;
-    }
-
-    return true;
+    return !unused_flags_[index];
   }
 
   /// Returns the number of wasted indices. These holes will be plugged when
   /// Degragment() is called.
   Index NumUnusedIndices() const {
     Count count = 0;
-    for (size_t i = 0; i < unused_indices_.size(); ++i) {
-      count += CountForIndex(unused_indices_[i]);
+    for (Count c = 1; c <= kMaxListedCount; ++c) {
+      count += c * static_cast<Count>(free_lists_[c].size());
+    }
+    const std::vector<Index>& large = free_lists_[kLargeList];
+    for (size_t i = 0; i < large.size(); ++i) {
+      count += CountForIndex(large[i]);
     }
     return count;
   }
@@ -301,9 +395,52 @@ class IndexAllocator {
   /// This includes all the indices that have been free.
   Index num_indices() const { return static_cast<Index>(counts_.size()); }
 
+  /// Returned by Alloc() when the allocation fails.
+  static const Index kInvalidIndex = static_cast<Index>(-1);
+
+  /// Freed blocks of up to this many indices get a free list of their own.
+  static const Count kMaxListedCount = 16;
+
  private:
   typedef typename std::vector<Index>::const_iterator ConstIndexIterator;
-  static const Index kInvalidIndex = static_cast<Index>(-1);
+
+  /// `free_lists_[kLargeList]` holds the blocks bigger than kMaxListedCount.
+  static const Count kLargeList = 0;
+
+  /// Put the unused block at `index` into the free list for its size.
+  void AddUnused(Index index) {
+    const Count count = CountForIndex(index);
+    free_lists_[count <= kMaxListedCount ? count : kLargeList].push_back(index);
+    unused_flags_[index] = 1;
+  }
+
+  /// Note that the block at `index` has been taken out of the free lists.
+  /// Returns `index`.
+  Index TakeUnused(Index index) {
+    unused_flags_[index] = 0;
+    return index;
+  }
+
+  /// Shrink the unused block at `index` to `count` indices, and return the
+  /// remainder, if any, to the free lists. Returns `index`.
+  Index SplitUnused(Index index, Count count) {
+    const Count excess = CountForIndex(index) - count;
+    if (excess > 0) {
+      InitializeIndex(index, count);
+      InitializeIndex(index + count, excess);
+      AddUnused(index + count);
+    }
+    return index;
+  }
+
+  /// The number of unused blocks in all the free lists.
+  size_t NumUnusedBlocks() const {
+    size_t num_blocks = 0;
+    for (Count c = 0; c <= kMaxListedCount; ++c) {
+      num_blocks += free_lists_[c].size();
+    }
+    return num_blocks;
+  }
 
   /// Returns the next allocated index. Skips over all indices associated
   /// with `index`.
@@ -338,6 +475,7 @@ class IndexAllocator {
   void SetNumIndices(Index new_num_indices) {
     // Increase (or decrease) the count logger.
     counts_.resize(new_num_indices, 0);
+    unused_flags_.resize(new_num_indices, 0);
 
     // Report size change.
     callbacks_->SetNumIndices(new_num_indices);
@@ -382,7 +520,9 @@ class IndexAllocator {
 
   /// Move later blocks of indices into the first hole in `unused_indices_`.
   /// That is, move the first hole farther back in the index array.
-  void BackfillFirstUnused() {
+  /// Moves at most `max_moved` indices, but always at least one block.
+  /// Returns the number of indices moved.
+  Count BackfillFirstUnused(Count max_moved) {
     assert(unused_indices_.size() > 0);
     const IndexRange unused_range(
         unused_indices_[0],
@@ -413,12 +553,27 @@ class IndexAllocator {
     //
     IndexRange fill_range = LastIndexRangeSmallerThanHole(unused_range.start());
     const bool is_fill = fill_range.Valid();
-    if (!is_fill) {
+    if (is_fill) {
+      // Over budget. Fill with only the last blocks of the range.
+      Index start = fill_range.start();
+      while (fill_range.end() - start > max_moved &&
+             NextIndex(start) < fill_range.end()) {
+        start = NextIndex(start);
+      }
+      fill_range = IndexRange(start, fill_range.end());
+    } else {
       // If there's no index range that will fit into the hole, shift over
-      // all the indices between this hole and the next.
+      // all the indices between this hole and the next. Over budget, shift
+      // only the first blocks. The hole then ends up after them.
       const Index next_hole_index =
           unused_indices_.size() > 1 ? unused_indices_[1] : num_indices();
-      fill_range = IndexRange(NextIndex(unused_range.start()), next_hole_index);
+      const Index start = NextIndex(unused_range.start());
+      Index end = NextIndex(start);
+      while (end < next_hole_index &&
+             NextIndex(end) - start <= max_moved) {
+        end = NextIndex(end);
+      }
+      fill_range = IndexRange(start, end);
     }
 
     // Allow the callback to move data associated with the indices.
@@ -450,6 +605,7 @@ class IndexAllocator {
     }
 
     VerifyInternalState();
+    return fill_range.Length();
   }
 
   IndexRange LastIndexRangeSmallerThanHole(Index index) const {
@@ -502,11 +658,20 @@ class IndexAllocator {
   //                     offset to the actual index
   std::vector<Count> counts_;
 
-  // When an index is freed, we keep track of it here. When an index is
-  // allocated, we use one off this array, if one exists.
-  // When Defragment() is called, we empty this array by filling all the
-  // unused indices with the highest allocated indices. This reduces the total
-  // size of the data arrays.
+  // When an index is freed, we keep track of it here, in the list for its
+  // count. When an index is allocated, we use one off these lists, if a big
+  // enough one exists. Blocks bigger than kMaxListedCount all go into
+  // `free_lists_[kLargeList]`.
+  std::vector<Index> free_lists_[kMaxListedCount + 1];
+
+  // 1 at the first index of every block in `free_lists_`, so that
+  // ValidIndex() doesn't have to search the lists. 0 everywhere else.
+  std::vector<uint8_t> unused_flags_;
+
+  // When Defragment() is called, we move every unused index here, sorted and
+  // coalesced, and empty this array by filling all the unused indices with
+  // the highest allocated indices. This reduces the total size of the data
+  // arrays.
   std::vector<Index> unused_indices_;
 };
 
@@ -0,0 +1,212 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_UTIL_INDEX_BIT_SET_H
+#define MOTIVE_UTIL_INDEX_BIT_SET_H
+
+/// @file
+/// Header (and all code) for IndexBitSet.
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+
+namespace motive {
+
+/// @class IndexBitSet
+/// @brief One bit per array index, with fast iteration over the set bits.
+///
+/// Processors use this to remember which of their indices are still moving.
+/// Settled indices have their bit cleared, and are skipped in AdvanceFrame().
+/// Since whole words of zeros are skipped at once, iterating over a set that's
+/// mostly clear costs little more than iterating over the bits that are set.
+///
+/// Bits are packed into words of kBitsPerWord bits. Bits in different words
+/// can be modified concurrently, but bits in the same word cannot.
+class IndexBitSet {
+ public:
+  typedef int Index;
+  typedef uint64_t Word;
+  static const Index kBitsPerWord = 64;
+
+  IndexBitSet() : size_(0) {}
+
+  Index size() const { return size_; }
+
+  /// Grow or shrink to `size` bits. New bits are initialized to `value`.
+  void Resize(Index size, bool value) {
+    const Index old_size = size_;
+    size_ = size;
+    words_.resize(NumWords(size), 0);
+    for (Index i = old_size; i < size; ++i) {
+      Assign(i, value);
+    }
+  }
+
+  /// Allocate storage for `size` bits, so that growing to that size doesn't
+  /// reallocate.
+  void Reserve(Index size) { words_.reserve(NumWords(size)); }
+
+  bool Test(Index i) const {
+    assert(0 <= i && i < size_);
+    return (words_[i / kBitsPerWord] & Bit(i)) != 0;
+  }
+
+  void Set(Index i) {
+    assert(0 <= i && i < size_);
+    words_[i / kBitsPerWord] |= Bit(i);
+  }
+
+  void Clear(Index i) {
+    assert(0 <= i && i < size_);
+    words_[i / kBitsPerWord] &= ~Bit(i);
+  }
+
+  void Assign(Index i, bool value) {
+    if (value) {
+      Set(i);
+    } else {
+      Clear(i);
+    }
+  }
+
+  /// Copy `count` bits from `old_index` to `new_index`, as when the
+  /// corresponding array data is moved. The ranges may overlap. Copies a
+  /// word's worth of bits at a time.
+  void Move(Index old_index, Index new_index, Index count) {
+    assert(0 <= count && 0 <= old_index && 0 <= new_index &&
+           std::max(old_index, new_index) + count <= size_);
+
+    // Copy in the direction that reads each bit before it's overwritten.
+    if (new_index <= old_index) {
+      for (Index i = 0; i < count; i += kBitsPerWord) {
+        const Index n = count - i < kBitsPerWord ? count - i : kBitsPerWord;
+        WriteBits(new_index + i, n, ReadBits(old_index + i, n));
+      }
+    } else {
+      for (Index end = count; end > 0; end -= kBitsPerWord) {
+        const Index n = end < kBitsPerWord ? end : kBitsPerWord;
+        WriteBits(new_index + end - n, n, ReadBits(old_index + end - n, n));
+      }
+    }
+  }
+
+  /// Return the first set bit in [i, end), or `end` if there are none.
+  Index NextSet(Index i, Index end) const { return Next(i, end, 0); }
+
+  /// Return the first clear bit in [i, end), or `end` if there are none.
+  Index NextClear(Index i, Index end) const { return Next(i, end, ~Word(0)); }
+
+  /// Return the number of set bits.
+  Index Count() const {
+    Index count = 0;
+    const Index num = num_words();
+    for (Index w = 0; w < num; ++w) {
+      Word word = words_[w];
+      // Shrinking leaves stale bits past the end of the last word.
+      const Index num_bits = size_ - w * kBitsPerWord;
+      if (num_bits < kBitsPerWord) word &= (Word(1) << num_bits) - 1;
+      count += PopCount(word);
+    }
+    return count;
+  }
+
+  /// The words that hold bits [0, size()), for saving and restoring in bulk.
+  const Word* words() const { return words_.data(); }
+  Word* words() { return words_.data(); }
+  Index num_words() const { return NumWords(size_); }
+
+ private:
+  static Index NumWords(Index size) {
+    return (size + kBitsPerWord - 1) / kBitsPerWord;
+  }
+
+  static Word Bit(Index i) { return Word(1) << (i % kBitsPerWord); }
+
+  // A word with the lowest `n` bits set.
+  static Word LowBits(Index n) {
+    return n >= kBitsPerWord ? ~Word(0) : (Word(1) << n) - 1;
+  }
+
+  // Return bits [i, i + n) in the lowest `n` bits. `n` is at most one word,
+  // but the bits can straddle two words.
+  Word ReadBits(Index i, Index n) const {
+    const Index w = i / kBitsPerWord;
+    const Index shift = i % kBitsPerWord;
+    Word bits = words_[w] >> shift;
+    if (shift + n > kBitsPerWord) {
+      bits |= words_[w + 1] << (kBitsPerWord - shift);
+    }
+    return bits & LowBits(n);
+  }
+
+  // Overwrite bits [i, i + n) with the lowest `n` bits of `bits`.
+  void WriteBits(Index i, Index n, Word bits) {
+    const Index w = i / kBitsPerWord;
+    const Index shift = i % kBitsPerWord;
+    const Word mask = LowBits(n);
+    words_[w] = (words_[w] & ~(mask << shift)) | (bits << shift);
+    if (shift + n > kBitsPerWord) {
+      const Index high_shift = kBitsPerWord - shift;
+      words_[w + 1] =
+          (words_[w + 1] & ~(mask >> high_shift)) | (bits >> high_shift);
+    }
+  }
+
+  // Return the first bit in [i, end) that's not the same as the bits in
+  // `skip`. `skip` is all zeros or all ones.
+  Index Next(Index i, Index end, Word skip) const {
+    assert(0 <= i && end <= size_);
+    while (i < end) {
+      const Word word = (words_[i / kBitsPerWord] ^ skip) >> (i % kBitsPerWord);
+      if (word == 0) {
+        // Nothing left in this word. Jump to the start of the next one.
+        i = (i / kBitsPerWord + 1) * kBitsPerWord;
+        continue;
+      }
+      return std::min(i + LowestBit(word), end);
+    }
+    return end;
+  }
+
+  // The position of the lowest set bit in `word`, which must be non-zero.
+  static Index LowestBit(Word word) {
+    assert(word != 0);
+#if defined(__GNUC__)
+    return static_cast<Index>(__builtin_ctzll(word));
+#else
+    Index bit = 0;
+    for (; (word & 1) == 0; word >>= 1) ++bit;
+    return bit;
+#endif
+  }
+
+  static Index PopCount(Word word) {
+#if defined(__GNUC__)
+    return static_cast<Index>(__builtin_popcountll(word));
+#else
+    Index count = 0;
+    for (; word != 0; word &= word - 1) ++count;
+    return count;
+#endif
+  }
+
+  std::vector<Word> words_;
+  Index size_;
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_UTIL_INDEX_BIT_SET_H
@@ -0,0 +1,104 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_UTIL_MOVE_RANGE_H
+#define MOTIVE_UTIL_MOVE_RANGE_H
+
+/// @file
+/// Header (and all code) for moving ranges of struct-of-arrays data.
+///
+/// IndexAllocator::Defragment() hands out whole ranges of indices to move.
+/// These functions move a range of one array in a single call, so that a
+/// processor's MoveIndices() costs one block copy per array, instead of a
+/// loop over every index. The source and destination ranges may overlap.
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace motive {
+
+/// Move-assign `count` elements of `v` from `old_index` to `new_index`.
+/// The elements left behind in the old range are in their moved-from state.
+template <class T, class Index>
+inline void MoveRangeObjects(std::vector<T>* v, Index old_index,
+                             Index new_index, Index count) {
+  assert(0 <= count && 0 <= old_index && 0 <= new_index &&
+         static_cast<size_t>(std::max(old_index, new_index) + count) <=
+             v->size());
+  T* data = v->data();
+  if (new_index < old_index) {
+    std::move(data + old_index, data + old_index + count, data + new_index);
+  } else if (new_index > old_index) {
+    std::move_backward(data + old_index, data + old_index + count,
+                       data + new_index + count);
+  }
+}
+
+namespace detail {
+
+template <class T, class Index>
+inline void MoveRangeBytes(std::vector<T>* v, Index old_index,
+                           Index new_index, Index count,
+                           std::true_type /*trivially_copyable*/) {
+  assert(0 <= count && 0 <= old_index && 0 <= new_index &&
+         static_cast<size_t>(std::max(old_index, new_index) + count) <=
+             v->size());
+  memmove(v->data() + new_index, v->data() + old_index, count * sizeof(T));
+}
+
+template <class T, class Index>
+inline void MoveRangeBytes(std::vector<T>* v, Index old_index,
+                           Index new_index, Index count,
+                           std::false_type /*trivially_copyable*/) {
+  MoveRangeObjects(v, old_index, new_index, count);
+}
+
+}  // namespace detail
+
+/// Move `count` elements of `v` from `old_index` to `new_index`, with a
+/// single memmove(). The elements left behind in the old range keep their
+/// values.
+///
+/// Meant for plain numbers, pointers, and structs of them, like the
+/// per-index data of most processors. Types that aren't trivially copyable
+/// can't be relocated byte by byte, so they're moved with
+/// MoveRangeObjects() instead.
+template <class T, class Index>
+inline void MoveRangeBytes(std::vector<T>* v, Index old_index,
+                           Index new_index, Index count) {
+  detail::MoveRangeBytes(v, old_index, new_index, count,
+                         std::is_trivially_copyable<T>());
+}
+
+/// Find the part of [old_index, old_index + count) that isn't overwritten by
+/// moving it to `new_index`. Since both ranges have the same length, that
+/// part is contiguous. Returns its start, and writes its end to `end`.
+template <class Index>
+inline Index VacatedRange(Index old_index, Index new_index, Index count,
+                          Index* end) {
+  const Index old_end = old_index + count;
+  if (new_index <= old_index) {
+    *end = old_end;
+    return std::min(std::max(old_index, new_index + count), old_end);
+  }
+  *end = std::min(old_end, new_index);
+  return old_index;
+}
+
+}  // namespace motive
+
+#endif  // MOTIVE_UTIL_MOVE_RANGE_H
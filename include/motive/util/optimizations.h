@@ -15,23 +15,29 @@
 #ifndef MOTIVE_UTIL_OPTIMIZATIONS_H_
 #define MOTIVE_UTIL_OPTIMIZATIONS_H_
 
+// The SSE kernels need only SSE2, which every x86-64 CPU has.
+#if defined(__x86_64__) || defined(_M_X64)
+#define MOTIVE_X86_64
+#endif
+
 namespace motive {
 
 enum ProcessorOptimization {
   kNoOptimizations,
   kNeonOptimizations,  /// NEON is a SIMD instruction set for ARM processors
   kSse3Optimizations,  /// SSE is a SIMD instruction set for x86 processors
-  kSsse3Optimizations  /// SSSE3 is an extension of SSE3
+  kSsse3Optimizations,  /// SSSE3 is an extension of SSE3
+  kAvx2Optimizations    /// AVX2 has eight-wide versions of most SSE operations
 };
 
 /// Look at the capabilities of the CPU and return the most performant set of
 /// processor optimizations. For example, on Android, return kNeonOptimizations
-/// if the CPU supports the NEON instruction set. On x86 (once we have x86
-/// optimizations), return kSse2Optimizations if it's supported, or if it's not,
-/// return kSse2Optimizations if it's supported. If none of the processors are
-/// supported, return kNoOptimizations.
+/// if the CPU supports the NEON instruction set. On x86, return
+/// kAvx2Optimizations if both the CPU and the operating system support AVX2,
+/// or if not, the best of kSsse3Optimizations and kSse3Optimizations. If none
+/// of the processors are supported, return kNoOptimizations.
 ProcessorOptimization BestProcessorOptimization();
 
 }  // namespace motive
 
-#endif  // MOTIVE_UTIL_OPTIMIZATIONS_H_
\ No newline at end of file
+#endif  // MOTIVE_UTIL_OPTIMIZATIONS_H_
@@ -0,0 +1,90 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MOTIVE_UTIL_WORKER_POOL_H_
+#define MOTIVE_UTIL_WORKER_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "motive/common.h"
+
+namespace motive {
+
+/// @class WorkerPool
+/// @brief A fixed set of threads that execute batches of independent tasks.
+///
+/// Run() hands out task indices to the worker threads *and* to the calling
+/// thread, and returns only once every task has finished. That is, every call
+/// to Run() is a barrier. Tasks are claimed one-by-one from a shared counter,
+/// so a thread that finishes early simply takes the next unclaimed task.
+///
+/// The pool is not reentrant: tasks must not call Run() on the same pool.
+class WorkerPool {
+ public:
+  typedef std::function<void(int task_index)> Task;
+
+  /// Create `num_threads` worker threads. The thread that calls Run() also
+  /// executes tasks, so `num_threads` should be one less than the number of
+  /// cores you want to use.
+  explicit WorkerPool(int num_threads);
+  ~WorkerPool();
+
+  /// Call `task` once for every index in [0, num_tasks), spread across all
+  /// threads. Blocks until every call has returned.
+  void Run(int num_tasks, const Task& task);
+
+  /// The number of threads owned by the pool. Does not include the thread
+  /// that calls Run().
+  int num_threads() const { return static_cast<int>(threads_.size()); }
+
+ private:
+  void WorkerLoop();
+  void ExecuteTasks(const Task& task, int num_tasks);
+
+  std::vector<std::thread> threads_;
+
+  /// Guards all of the members below, except `next_task_`.
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+
+  /// The batch currently being executed by Run(). Only valid while
+  /// `num_active_workers_` is non-zero.
+  const Task* task_;
+  int num_tasks_;
+
+  /// Incremented every time Run() publishes a new batch. Workers compare
+  /// against the last generation they executed to detect new work.
+  uint32_t generation_;
+
+  /// The number of workers that have not yet finished the current batch.
+  /// Run() does not return until this reaches zero, so no worker can ever
+  /// execute a stale `task_`.
+  int num_active_workers_;
+  bool shutdown_;
+
+  /// The next task index to be claimed by any thread.
+  std::atomic<int> next_task_;
+
+  MOTIVE_DISALLOW_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace motive
+
+#endif  // MOTIVE_UTIL_WORKER_POOL_H_
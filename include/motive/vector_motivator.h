@@ -40,7 +40,7 @@ class MotivatorNf : public Motivator {
   MotivatorNf(const MotivatorInit& init, MotiveEngine* engine,
               MotiveDimension dimensions, const MotiveTarget1f* ts)
       : Motivator(init, engine, dimensions) {
-    SetTargets(ts);
+    if (Valid()) SetTargets(ts);
   }
 
   /// Initialize this Motivator to the type specified in init.type.
@@ -61,7 +61,7 @@ class MotivatorNf : public Motivator {
                              MotiveDimension dimensions,
                              const MotiveTarget1f* targets) {
     Initialize(init, engine, dimensions);
-    SetTargets(targets);
+    if (Valid()) SetTargets(targets);
   }
 
   /// Initialize to the motion algorithm specified by `init`.
@@ -75,7 +75,7 @@ class MotivatorNf : public Motivator {
                                  const float* target_values,
                                  const float* target_velocities) {
     InitializeWithDimension(init, engine, dimensions);
-    SetTargetWithShape(target_values, target_velocities, shape);
+    if (Valid()) SetTargetWithShape(target_values, target_velocities, shape);
   }
 
   /// Initialize to the motion algorithm specified by `init`.
@@ -86,11 +86,126 @@ class MotivatorNf : public Motivator {
                              const CompactSpline* splines,
                              const SplinePlayback& playback) {
     Initialize(init, engine, dimensions);
-    SetSplines(splines, playback);
+    if (Valid()) SetSplines(splines, playback);
+  }
+
+  /// Same as calling InitializeWithTargets() on each of the `count`
+  /// Motivators in `motivators`, but in one pass. See
+  /// Motivator::InitializeBatch(). Each element of `motivators` must be a
+  /// MotivatorNf, or derived from it.
+  /// @param targets `dimensions` targets for each Motivator, back to back,
+  ///                so `count * dimensions` in total.
+  static bool InitializeBatchWithTargets(const MotivatorInit& init,
+                                         MotiveEngine* engine,
+                                         MotiveDimension dimensions,
+                                         Motivator* const* motivators,
+                                         MotiveIndex count,
+                                         const MotiveTarget1f* targets) {
+    if (!InitializeBatch(init, engine, dimensions, motivators, count))
+      return false;
+
+    // The batch is given adjacent indices, so one call sets every target.
+    if (count > 0) {
+      MotivatorNf* first = static_cast<MotivatorNf*>(motivators[0]);
+      first->Processor().SetTargets(first->index_, count * dimensions,
+                                    targets);
+    }
+    return true;
+  }
+
+  /// Same as calling InitializeWithSplines() on each of the `count`
+  /// Motivators in `motivators`, but in one pass. See
+  /// Motivator::InitializeBatch(). Each element of `motivators` must be a
+  /// MotivatorNf, or derived from it.
+  /// @param splines `dimensions` splines for each Motivator, back to back,
+  ///                so `count * dimensions` in total.
+  static bool InitializeBatchWithSplines(const MotivatorInit& init,
+                                         MotiveEngine* engine,
+                                         MotiveDimension dimensions,
+                                         Motivator* const* motivators,
+                                         MotiveIndex count,
+                                         const CompactSpline* splines,
+                                         const SplinePlayback& playback) {
+    if (!InitializeBatch(init, engine, dimensions, motivators, count))
+      return false;
+
+    // The batch is given adjacent indices, so one call sets every spline.
+    if (count > 0) {
+      MotivatorNf* first = static_cast<MotivatorNf*>(motivators[0]);
+      first->Processor().SetSplines(first->index_, count * dimensions, splines,
+                                    playback);
+    }
+    return true;
+  }
+
+  /// Write the values of the `count` Motivators in `motivators` into `out`,
+  /// in one call to their processor. The Motivators must all be valid, with
+  /// the same type and dimensions. See MotiveProcessorNf::GatherValues() for
+  /// the meaning of the strides.
+  template <class MotivatorT>
+  static void GatherValues(const MotivatorT* const* motivators,
+                           MotiveIndex count, float* out, size_t item_stride,
+                           size_t dimension_stride) {
+    if (count <= 0) return;
+    const MotiveProcessorNf& p = motivators[0]->Processor();
+    ForEachIndexChunk(motivators, count, [&](const MotiveIndex* indices,
+                                             MotiveIndex start, MotiveIndex n,
+                                             MotiveDimension dimensions) {
+      p.GatherValues(indices, n, dimensions, out + start * item_stride,
+                     item_stride, dimension_stride);
+    });
+  }
+
+  /// Same as GatherValues(), but writes the velocities.
+  template <class MotivatorT>
+  static void GatherVelocities(const MotivatorT* const* motivators,
+                               MotiveIndex count, float* out,
+                               size_t item_stride, size_t dimension_stride) {
+    if (count <= 0) return;
+    const MotiveProcessorNf& p = motivators[0]->Processor();
+    ForEachIndexChunk(motivators, count, [&](const MotiveIndex* indices,
+                                             MotiveIndex start, MotiveIndex n,
+                                             MotiveDimension dimensions) {
+      p.GatherVelocities(indices, n, dimensions, out + start * item_stride,
+                         item_stride, dimension_stride);
+    });
+  }
+
+  /// Same as calling SetTargets() on each of the `count` Motivators in
+  /// `motivators`, but with one call to their processor per 64 Motivators.
+  /// `targets` holds `Dimensions()` targets per Motivator, back to back.
+  /// The Motivators must all be valid, with the same type and dimensions.
+  /// See MotiveProcessorNf::SetTargetsBatch().
+  template <class MotivatorT>
+  static void SetTargetsBatch(MotivatorT* const* motivators, MotiveIndex count,
+                              const MotiveTarget1f* targets) {
+    if (count <= 0) return;
+    MotiveProcessorNf& p = motivators[0]->Processor();
+    ForEachIndexChunk(motivators, count, [&](const MotiveIndex* indices,
+                                             MotiveIndex start, MotiveIndex n,
+                                             MotiveDimension dimensions) {
+      p.SetTargetsBatch(indices, n, dimensions, targets + start * dimensions);
+    });
+  }
+
+  /// Same as SetTargetsBatch(), but for splines. `splines` holds
+  /// `Dimensions()` spline pointers per Motivator, back to back.
+  template <class MotivatorT>
+  static void SetSplinesBatch(MotivatorT* const* motivators, MotiveIndex count,
+                              const CompactSpline* const* splines,
+                              const SplinePlayback& playback) {
+    if (count <= 0) return;
+    MotiveProcessorNf& p = motivators[0]->Processor();
+    ForEachIndexChunk(motivators, count, [&](const MotiveIndex* indices,
+                                             MotiveIndex start, MotiveIndex n,
+                                             MotiveDimension dimensions) {
+      p.SetSplinesBatch(indices, n, dimensions, splines + start * dimensions,
+                        playback);
+    });
   }
 
   // Get array of length `dimensions`.
-  const float* Values() const { return Processor().Values(index_); }
+  const float* Values() const { return Processor().FastValues(index_); }
   void Velocities(float* out) const {
     return Processor().Velocities(index_, Dimensions(), out);
   }
@@ -225,6 +340,30 @@ class MotivatorNf : public Motivator {
   const MotiveProcessorNf& Processor() const {
     return *static_cast<const MotiveProcessorNf*>(processor_);
   }
+
+ private:
+  // Call `fn` on the indices of `motivators`, a chunk at a time, so that
+  // batching a list of Motivators doesn't allocate.
+  template <class MotivatorT, class F>
+  static void ForEachIndexChunk(MotivatorT* const* motivators,
+                                MotiveIndex count, const F& fn) {
+    static const MotiveIndex kChunkSize = 64;
+    const MotiveProcessorNf* processor = &motivators[0]->Processor();
+    const MotiveDimension dimensions = motivators[0]->Dimensions();
+    MotiveIndex indices[kChunkSize];
+    for (MotiveIndex start = 0; start < count; start += kChunkSize) {
+      const MotiveIndex remaining = count - start;
+      const MotiveIndex n = remaining < kChunkSize ? remaining : kChunkSize;
+      for (MotiveIndex i = 0; i < n; ++i) {
+        MotivatorT* motivator = motivators[start + i];
+        assert(&motivator->Processor() == processor &&
+               motivator->Dimensions() == dimensions);
+        indices[i] = motivator->index_;
+      }
+      fn(indices, start, n, dimensions);
+    }
+    (void)processor;
+  }
 };
 
 /// @class MotivatorXfTemplate
@@ -261,7 +400,7 @@ class MotivatorXfTemplate : public MotivatorNf {
   MotivatorXfTemplate(const MotivatorInit& init, MotiveEngine* engine,
                       const Target& t)
       : MotivatorNf(init, engine, kDimensions) {
-    SetTarget(t);
+    if (Valid()) SetTarget(t);
   }
 
   /// Initialize to the motion algorithm specified by `init`.
@@ -274,7 +413,7 @@ class MotivatorXfTemplate : public MotivatorNf {
   void InitializeWithTarget(const MotivatorInit& init, MotiveEngine* engine,
                             const Target& t) {
     InitializeWithDimension(init, engine, kDimensions);
-    SetTarget(t);
+    if (Valid()) SetTarget(t);
   }
 
   /// Initialize to the motion algorithm specified by `init`.
@@ -288,7 +427,7 @@ class MotivatorXfTemplate : public MotivatorNf {
                                  const Vec& target_values,
                                  const Vec& target_velocities) {
     InitializeWithDimension(init, engine, dimensions);
-    SetTargetWithShape(target_values, target_velocities, shape);
+    if (Valid()) SetTargetWithShape(target_values, target_velocities, shape);
   }
 
   /// Returns the current motivator value. The current value is updated when
@@ -296,7 +435,9 @@ class MotivatorXfTemplate : public MotivatorNf {
   /// Motivator.
   /// Note that the "Vec()" parameter is just a syntactic hack used to access
   /// the correct overloaded function in the processor.
-  Vec Value() const { return C::FromPtr(Processor().Values(index_), Vec()); }
+  Vec Value() const {
+    return C::FromPtr(Processor().FastValues(index_), Vec());
+  }
 
   /// Returns the current rate of change of this motivator. For example,
   /// if this Motivator is being driven by a spline, returns the derivative
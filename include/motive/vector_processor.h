@@ -15,7 +15,13 @@
 #ifndef MOTIVE_VECTOR_PROCESSOR_H_
 #define MOTIVE_VECTOR_PROCESSOR_H_
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 #include "motive/processor.h"
+#include "motive/snapshot.h"
+#include "motive/util/hash.h"
 
 namespace motive {
 
@@ -29,7 +35,7 @@ class MotiveProcessorNf : public MotiveProcessor {
   // Convenience functions for getting a single value. Prefer calling the
   // bulk values, especially when inside a loop. They avoid the virtual
   // function call overhead, and offer more opportunities for optimizations.
-  float Value(MotiveIndex index) const { return Values(index)[0]; }
+  float Value(MotiveIndex index) const { return FastValues(index)[0]; }
   float Velocity(MotiveIndex index) const {
     float v;
     Velocities(index, 1, &v);
@@ -57,6 +63,14 @@ class MotiveProcessorNf : public MotiveProcessor {
   }
 
   virtual const float* Values(MotiveIndex index) const = 0;
+
+  /// Same as Values(), but inlined when the processor has published its
+  /// values array with SetValuesArray(). Motivators read their values
+  /// through here, so reading a value costs no virtual call.
+  const float* FastValues(MotiveIndex index) const {
+    return values_array_ != nullptr ? values_array_ + index : Values(index);
+  }
+
   virtual void Velocities(MotiveIndex index, MotiveDimension dimensions,
                           float* out) const = 0;
   virtual void Directions(MotiveIndex index, MotiveDimension dimensions,
@@ -123,6 +137,273 @@ class MotiveProcessorNf : public MotiveProcessor {
   virtual void SetSplineRepeating(MotiveIndex /*index*/,
                                   MotiveDimension /*dimensions*/,
                                   bool /*repeat*/) {}
+
+  /// Write the current values of `count` Motivators into `out`, in one call.
+  /// Value `d` of `indices[i]` goes to
+  /// `out[i * item_stride + d * dimension_stride]`, so the same call can fill
+  /// an array of structures (`dimension_stride` = 1, `item_stride` = size of
+  /// the structure in floats), or a structure of arrays (`item_stride` = 1,
+  /// `dimension_stride` = length of each array).
+  ///
+  /// Every index must be the first index of a Motivator with `dimensions`
+  /// dimensions. Much cheaper than calling Value() per Motivator, since
+  /// there's no virtual call per Motivator, and the reads are batched.
+  void GatherValues(const MotiveIndex* indices, MotiveIndex count,
+                    MotiveDimension dimensions, float* out,
+                    size_t item_stride, size_t dimension_stride) const {
+    if (values_array_ != nullptr) {
+      GatherStrided(values_array_, indices, count, dimensions, out,
+                    item_stride, dimension_stride);
+      return;
+    }
+    for (MotiveIndex i = 0; i < count; ++i) {
+      const float* values = Values(indices[i]);
+      for (MotiveDimension d = 0; d < dimensions; ++d) {
+        out[i * item_stride + d * dimension_stride] = values[d];
+      }
+    }
+  }
+
+  /// Same as GatherValues() above, but for the Motivators referenced by
+  /// `handles`. See MotiveProcessor::InitializeHandle().
+  void GatherValues(const MotiveHandle* handles, MotiveIndex count,
+                    MotiveDimension dimensions, float* out,
+                    size_t item_stride, size_t dimension_stride) const {
+    ForEachHandleChunk(handles, count, [&](const MotiveIndex* indices,
+                                           MotiveIndex start, MotiveIndex n) {
+      GatherValues(indices, n, dimensions, out + start * item_stride,
+                   item_stride, dimension_stride);
+    });
+  }
+
+  /// Same as GatherValues(), but writes the velocities, as returned by
+  /// Velocities().
+  void GatherVelocities(const MotiveIndex* indices, MotiveIndex count,
+                        MotiveDimension dimensions, float* out,
+                        size_t item_stride, size_t dimension_stride) const {
+    GatherVelocitiesAtIndices(indices, count, dimensions, out, item_stride,
+                              dimension_stride);
+  }
+
+  void GatherVelocities(const MotiveHandle* handles, MotiveIndex count,
+                        MotiveDimension dimensions, float* out,
+                        size_t item_stride, size_t dimension_stride) const {
+    ForEachHandleChunk(handles, count, [&](const MotiveIndex* indices,
+                                           MotiveIndex start, MotiveIndex n) {
+      GatherVelocitiesAtIndices(indices, n, dimensions,
+                                out + start * item_stride, item_stride,
+                                dimension_stride);
+    });
+  }
+
+  /// Same as calling SetTargets() for each of the `count` Motivators in
+  /// `indices`, but in one call. `targets` holds `dimensions` targets per
+  /// Motivator, in the same order as `indices`. The batch is applied in
+  /// index order, so memory is walked forwards, and the processor applies it
+  /// with its own loop instead of one virtual call per Motivator.
+  /// Each index must appear at most once.
+  void SetTargetsBatch(const MotiveIndex* indices, MotiveIndex count,
+                       MotiveDimension dimensions,
+                       const MotiveTarget1f* targets) {
+    SortBatch(count, [indices](MotiveIndex i) { return indices[i]; });
+    SetTargetsAtIndices(batch_.data(), count, dimensions, targets);
+  }
+
+  /// Same as SetTargetsBatch() above, but for the Motivators referenced by
+  /// `handles`.
+  void SetTargetsBatch(const MotiveHandle* handles, MotiveIndex count,
+                       MotiveDimension dimensions,
+                       const MotiveTarget1f* targets) {
+    SortBatch(count, [this, handles](MotiveIndex i) {
+      return HandleIndex(handles[i]);
+    });
+    SetTargetsAtIndices(batch_.data(), count, dimensions, targets);
+  }
+
+  /// Same as SetTargetsBatch(), but calls SetSplines(). `splines` holds
+  /// `dimensions` spline pointers per Motivator, in the same order as
+  /// `indices`.
+  void SetSplinesBatch(const MotiveIndex* indices, MotiveIndex count,
+                       MotiveDimension dimensions,
+                       const CompactSpline* const* splines,
+                       const SplinePlayback& playback) {
+    SortBatch(count, [indices](MotiveIndex i) { return indices[i]; });
+    SetSplinesAtIndices(batch_.data(), count, dimensions, splines, playback);
+  }
+
+  void SetSplinesBatch(const MotiveHandle* handles, MotiveIndex count,
+                       MotiveDimension dimensions,
+                       const CompactSpline* const* splines,
+                       const SplinePlayback& playback) {
+    SortBatch(count, [this, handles](MotiveIndex i) {
+      return HandleIndex(handles[i]);
+    });
+    SetSplinesAtIndices(batch_.data(), count, dimensions, splines, playback);
+  }
+
+  // Unused indices hold whatever was left behind, so skip them, as
+  // MatrixProcessor does.
+  virtual uint64_t HashOutputs(uint64_t hash) const {
+    const MotiveIndex num_indices = NumIndices();
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      if (ValidIndex(i)) hash = HashValues(Values(i), 1, hash);
+    }
+    return hash;
+  }
+
+ protected:
+  MotiveProcessorNf() : values_array_(nullptr) {}
+
+  /// Processors that hold the values of all their indices in one array
+  /// should call this whenever the array is reallocated. Values(index) must
+  /// then always equal `values + index`.
+  void SetValuesArray(const float* values) { values_array_ = values; }
+
+  /// One Motivator in a SetTargetsBatch() or SetSplinesBatch() call.
+  struct BatchEntry {
+    /// First index of the Motivator.
+    MotiveIndex index;
+
+    /// Position of the Motivator in the caller's arrays. Its targets or
+    /// splines start at `source * dimensions`.
+    MotiveIndex source;
+
+    bool operator<(const BatchEntry& rhs) const { return index < rhs.index; }
+  };
+
+  /// Implementation of SetTargetsBatch(). `entries` is sorted by index.
+  /// The default calls SetTargets() once per entry. Override to skip the
+  /// virtual calls.
+  virtual void SetTargetsAtIndices(const BatchEntry* entries,
+                                   MotiveIndex count,
+                                   MotiveDimension dimensions,
+                                   const MotiveTarget1f* targets) {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      SetTargets(entries[i].index, dimensions,
+                 targets + entries[i].source * dimensions);
+    }
+  }
+
+  /// Implementation of SetSplinesBatch(). `entries` is sorted by index.
+  virtual void SetSplinesAtIndices(const BatchEntry* entries,
+                                   MotiveIndex count,
+                                   MotiveDimension dimensions,
+                                   const CompactSpline* const* splines,
+                                   const SplinePlayback& playback) {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      const CompactSpline* const* s = splines + entries[i].source * dimensions;
+      for (MotiveDimension d = 0; d < dimensions; ++d) {
+        SetSplines(entries[i].index + d, 1, s[d], playback);
+      }
+    }
+  }
+
+  /// One float per dimension, so one per index.
+  virtual int NumOutputFloats() const { return 1; }
+  virtual const float* OutputFloats(MotiveIndex index) const {
+    return FastValues(index);
+  }
+
+  /// Writes one float per dimension.
+  virtual void WriteOutputBinding(MotiveIndex index, uint8_t* destination,
+                                  size_t stride) const {
+    const float* values = FastValues(index);
+    const MotiveDimension dimensions = Dimensions(index);
+    for (MotiveDimension i = 0; i < dimensions; ++i) {
+      memcpy(destination + i * stride, &values[i], sizeof(float));
+    }
+  }
+
+  /// Implementation of GatherVelocities(). The default calls Velocities()
+  /// once per dimension. Override to skip the virtual calls.
+  virtual void GatherVelocitiesAtIndices(const MotiveIndex* indices,
+                                         MotiveIndex count,
+                                         MotiveDimension dimensions,
+                                         float* out, size_t item_stride,
+                                         size_t dimension_stride) const {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      for (MotiveDimension d = 0; d < dimensions; ++d) {
+        Velocities(indices[i] + d, 1,
+                   &out[i * item_stride + d * dimension_stride]);
+      }
+    }
+  }
+
+  /// Copy `source[indices[i] + d]` to `out[i * item_stride + d *
+  /// dimension_stride]`. The loops are kept simple so that the compiler can
+  /// turn them into vector gathers, where the target supports them.
+  static void GatherStrided(const float* source, const MotiveIndex* indices,
+                            MotiveIndex count, MotiveDimension dimensions,
+                            float* out, size_t item_stride,
+                            size_t dimension_stride) {
+    // The common case: one float per Motivator, into a packed array.
+    if (dimensions == 1 && item_stride == 1) {
+      for (MotiveIndex i = 0; i < count; ++i) {
+        out[i] = source[indices[i]];
+      }
+      return;
+    }
+    for (MotiveDimension d = 0; d < dimensions; ++d) {
+      const float* source_d = source + d;
+      float* out_d = out + d * dimension_stride;
+      for (MotiveIndex i = 0; i < count; ++i) {
+        out_d[i * item_stride] = source_d[indices[i]];
+      }
+    }
+  }
+
+  // Assumes the Values() of consecutive indices are consecutive in memory,
+  // as they are for every built-in processor. Override if that's not true.
+  virtual void WriteSnapshot(ProcessorSnapshot* snapshot) const {
+    const MotiveIndex num_indices = NumIndices();
+    if (num_indices == 0) {
+      snapshot->values.clear();
+      return;
+    }
+    const float* values = Values(0);
+    snapshot->values.assign(values, values + num_indices);
+  }
+
+ private:
+  /// Handles are converted to indices this many at a time, on the stack.
+  static const MotiveIndex kHandleChunkSize = 64;
+
+  /// Call `fn(indices, start, n)` for each run of up to kHandleChunkSize
+  /// handles, where `indices` holds the current indices of
+  /// `handles[start, start + n)`.
+  template <class F>
+  void ForEachHandleChunk(const MotiveHandle* handles, MotiveIndex count,
+                          const F& fn) const {
+    MotiveIndex indices[kHandleChunkSize];
+    for (MotiveIndex start = 0; start < count; start += kHandleChunkSize) {
+      const MotiveIndex remaining = count - start;
+      const MotiveIndex n =
+          remaining < kHandleChunkSize ? remaining : kHandleChunkSize;
+      for (MotiveIndex i = 0; i < n; ++i) {
+        indices[i] = HandleIndex(handles[start + i]);
+      }
+      fn(indices, start, n);
+    }
+  }
+
+  /// Fill `batch_` with the `count` indices returned by `index_fn(i)`, and
+  /// sort them. `batch_` keeps its memory, so batches don't allocate once
+  /// it has grown to the largest batch size.
+  template <class F>
+  void SortBatch(MotiveIndex count, const F& index_fn) {
+    batch_.resize(count);
+    for (MotiveIndex i = 0; i < count; ++i) {
+      batch_[i].index = index_fn(i);
+      batch_[i].source = i;
+    }
+    std::sort(batch_.begin(), batch_.end());
+  }
+
+  /// See SetValuesArray(). nullptr if FastValues() must call Values().
+  const float* values_array_;
+
+  /// Scratch space for SetTargetsBatch() and SetSplinesBatch().
+  std::vector<BatchEntry> batch_;
 };
 
 }  // namespace motive
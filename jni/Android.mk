@@ -41,10 +41,12 @@ MOTIVE_SRC_FILES := \
   $(MOTIVE_RELATIVE_DIR)/src/motive/anim.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/anim_table.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/engine.cpp \
+  $(MOTIVE_RELATIVE_DIR)/src/motive/engine_group.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/init.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/io/flatbuffers.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/math/angle.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/math/bulk_spline_evaluator.cpp \
+  $(MOTIVE_RELATIVE_DIR)/src/motive/math/bulk_spline_evaluator_x86.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/math/compact_spline.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/math/curve.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/math/curve_util.cpp \
@@ -59,12 +61,23 @@ MOTIVE_SRC_FILES := \
   $(MOTIVE_RELATIVE_DIR)/src/motive/processor/spline_processor.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/processor/spring_processor.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/processor.cpp \
+  $(MOTIVE_RELATIVE_DIR)/src/motive/snapshot.cpp \
+  $(MOTIVE_RELATIVE_DIR)/src/motive/task_graph.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/util/benchmark.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/util/optimizations.cpp \
+  $(MOTIVE_RELATIVE_DIR)/src/motive/util/worker_pool.cpp \
   $(MOTIVE_RELATIVE_DIR)/src/motive/version.cpp
 
 MOTIVE_CFLAGS:=
 
+# Set to 1 to stop multiplies and adds from being contracted into FMAs, so
+# that results are identical across CPUs. See
+# MotiveEngine::SetDeterministicMode().
+MOTIVE_DETERMINISTIC_FP ?= 0
+ifneq ($(MOTIVE_DETERMINISTIC_FP),0)
+  MOTIVE_CFLAGS += -ffp-contract=off
+endif
+
 MOTIVE_ENABLE_ASSEMBLY ?= 1
 MOTIVE_TEST_ASSEMBLY ?= 0
 ifneq ($(MOTIVE_ENABLE_ASSEMBLY),0)
@@ -20,6 +20,8 @@
 #include "motive/math/curve.h"
 #include "motive/math/compact_spline.h"
 #include "motive/init.h"
+#include "motive/overshoot_init.h"
+#include "motive/vector_motivator.h"
 #include "motive/util/benchmark.h"
 
 using motive::CompactSpline;
@@ -37,6 +39,9 @@ using motive::MotiveEngine;
 using motive::MatrixInit;
 using motive::MatrixOpArray;
 using motive::MatrixMotivator4f;
+using motive::Motivator1f;
+using motive::MotiveProcessorNf;
+using motive::OvershootInit;
 using motive::SplineInit;
 
 static const SplineInit kRotateInit(kAngleRange);
@@ -165,8 +170,82 @@ class MotiveBenchmarker {
   MatrixMotivator4f matrices_[kNumMatrices];
 };
 
+// Create a very large number of small, one dimensional motivators, and
+// measure the cost of reading their values. Compares reading through the
+// processor's virtual Values() with reading through Motivator::Value(), which
+// is inlined.
+class AccessorBenchmarker {
+ public:
+  AccessorBenchmarker()
+      : advance_frame_id_(motive::RegisterBenchmark("Advance 100k")),
+        virtual_values_id_(motive::RegisterBenchmark("Virtual Values 100k")),
+        inline_values_id_(motive::RegisterBenchmark("Inline Values 100k")),
+        sum_(0.0f),
+        motivators_(kNumMotivators) {
+    OvershootInit init;
+    init.set_range(Range(0.0f, 100.0f));
+    init.set_max_velocity(1.0f);
+    init.set_max_delta(10.0f);
+    init.set_accel_per_difference(0.01f);
+    init.set_wrong_direction_multiplier(4.0f);
+    init.set_max_delta_time(10);
+    for (size_t i = 0; i < kNumMotivators; ++i) {
+      const motive::MotiveTarget1f target = motive::CurrentToTarget1f(
+          0.0f, 0.0f, static_cast<float>(i % 100), 0.0f, 1000);
+      motivators_[i].InitializeWithTarget(init, &engine_, target);
+    }
+  }
+
+  void Run() {
+    const MotiveProcessorNf& processor = *static_cast<MotiveProcessorNf*>(
+        engine_.Processor(OvershootInit::kType));
+    for (int i = 0; i < kNumReports; ++i) {
+      for (int j = 0; j < kNumIterationsPerReport; ++j) {
+        {
+          const motive::Benchmark b(advance_frame_id_);
+          engine_.AdvanceFrame(1);
+        }
+        {
+          const motive::Benchmark b(virtual_values_id_);
+          for (size_t k = 0; k < kNumMotivators; ++k) {
+            sum_ += processor.Values(static_cast<motive::MotiveIndex>(k))[0];
+          }
+        }
+        {
+          const motive::Benchmark b(inline_values_id_);
+          for (size_t k = 0; k < kNumMotivators; ++k) {
+            sum_ += motivators_[k].Value();
+          }
+        }
+      }
+
+      // Print the sum so that the reads can't be optimized away.
+      printf("Accessor checksum: %f\n", sum_);
+      motive::OutputBenchmarks();
+      motive::ClearBenchmarks();
+    }
+  }
+
+ private:
+  static const size_t kNumMotivators = 100000;
+  static const int kNumReports = 10;
+  static const int kNumIterationsPerReport = 100;
+
+  int advance_frame_id_;
+  int virtual_values_id_;
+  int inline_values_id_;
+  float sum_;
+  MotiveEngine engine_;
+  std::vector<Motivator1f> motivators_;
+};
+
 int main() {
   motive::InitBenchmarks(kNumBenchmarkIds);
+  {
+    OvershootInit::Register();
+    AccessorBenchmarker accessor_benchmarker;
+    accessor_benchmarker.Run();
+  }
   MotiveBenchmarker benchmarker;
   benchmarker.Run();
   return 0;
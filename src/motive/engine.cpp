@@ -12,13 +12,47 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <string.h>
+
 #include "motive/engine.h"
 #include "motive/processor.h"
 #include "motive/version.h"
 #include "motive/util/benchmark.h"
+#include "motive/util/hash.h"
+#include "motive/util/worker_pool.h"
 
 namespace motive {
 
+// Set in `snapshot_ready_` when a snapshot is published. Cleared when the
+// reader takes it.
+static const int kSnapshotFresh = 4;
+static const int kSnapshotIndexMask = 3;
+
+// Runs a MotiveTaskGraph on the engine's own WorkerPool, one phase at a time.
+// Every dependency of a task is in an earlier phase, so the barrier at the
+// end of WorkerPool::Run() is all the synchronization we need. Threads claim
+// tasks from a shared counter, so a thread that finishes early takes over the
+// remaining chunks of a large processor.
+class WorkerPoolExecutor : public MotiveTaskExecutor {
+ public:
+  explicit WorkerPoolExecutor(WorkerPool* pool) : pool_(pool) {}
+
+  virtual void Execute(MotiveTaskGraph* graph) {
+    const int num_tasks = graph->NumTasks();
+    for (int first = 0; first < num_tasks;) {
+      const int phase = graph->task(first).phase;
+      int end = first + 1;
+      while (end < num_tasks && graph->task(end).phase == phase) ++end;
+      pool_->Run(end - first, [graph, first](int i) { graph->Run(first + i); });
+      first = end;
+    }
+  }
+
+ private:
+  WorkerPool* pool_;
+};
+
 // static
 MotiveEngine::FunctionMap MotiveEngine::function_map_;
 
@@ -30,7 +64,19 @@ void MotiveEngine::RegisterProcessorFactory(
 
 // Prevent the version string from being stripped from the binary by keeping
 // a reference to it here.
-MotiveEngine::MotiveEngine() : version_(&Version()) {}
+MotiveEngine::MotiveEngine()
+    : schedule_dirty_(false),
+      chunk_size_(kDefaultAdvanceFrameChunkSize),
+      frame_count_(0),
+      snapshot_mode_(false),
+      defragment_budget_(MotiveProcessor::kNoDefragmentBudget),
+      deterministic_mode_(false),
+      snapshot_back_(0),
+      snapshot_front_(1),
+      snapshot_ready_(2),
+      version_(&Version()) {}
+
+MotiveEngine::~MotiveEngine() { Reset(); }
 
 void MotiveEngine::Reset() {
   for (ProcessorMap::iterator it = mapped_processors_.begin();
@@ -46,6 +92,14 @@ void MotiveEngine::Reset() {
 
   // Remove all elements from the map. Their processors have all been destroyed.
   mapped_processors_.clear();
+  schedule_.clear();
+  schedule_dirty_ = false;
+
+  // Snapshots are keyed by processor, so they're now invalid.
+  for (int i = 0; i < 3; ++i) {
+    snapshots_[i].Clear();
+  }
+  snapshot_ready_.fetch_and(kSnapshotIndexMask);
 }
 
 MotiveProcessor* MotiveEngine::Processor(MotivatorType type) {
@@ -60,27 +114,454 @@ MotiveProcessor* MotiveEngine::Processor(MotivatorType type) {
 
   // Remember processor for next time. We only want at most one processor per
   // type in an engine
-  ProcessorDetails details;
-  details.processor = fns.create();
-  details.processor->SetEngine(this);
-  details.processor->RegisterBenchmarks();
-  mapped_processors_.insert(ProcessorPair(type, details.processor));
-  sorted_processors_.insert(details);
+  MotiveProcessor* processor = fns.create();
+  processor->SetEngine(this);
+  processor->RegisterBenchmarks();
+  processor->SetIndicesPinned(snapshot_mode_);
+  processor->SetDefragmentBudget(defragment_budget_);
+  processor->SetDeterministic(deterministic_mode_);
+  processor->SetEventsEnabled(events_.capacity() > 0);
+  mapped_processors_.insert(ProcessorPair(type, processor));
+  schedule_dirty_ = true;
+
+  return processor;
+}
+
+void MotiveEngine::SetNumWorkerThreads(int num_threads) {
+  assert(num_threads >= 0);
+  worker_pool_.reset(num_threads > 0 ? new WorkerPool(num_threads) : nullptr);
+}
+
+int MotiveEngine::NumWorkerThreads() const {
+  return worker_pool_ ? worker_pool_->num_threads() : 0;
+}
+
+void MotiveEngine::Reserve(MotivatorType type, MotiveIndex num_indices) {
+  MotiveProcessor* processor = Processor(type);
+  assert(processor != nullptr);
+  processor->Reserve(num_indices);
+}
+
+void MotiveEngine::SetMaxIndices(MotivatorType type, MotiveIndex max_indices) {
+  MotiveProcessor* processor = Processor(type);
+  assert(processor != nullptr);
+  processor->SetMaxIndices(max_indices);
+}
+
+void MotiveEngine::SetChangeTracking(MotivatorType type, bool track_changes,
+                                     float epsilon) {
+  MotiveProcessor* processor = Processor(type);
+  assert(processor != nullptr);
+  processor->SetChangeTracking(track_changes, epsilon);
+}
+
+void MotiveEngine::SetDefragmentBudget(MotiveIndex max_moved) {
+  defragment_budget_ = max_moved;
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->SetDefragmentBudget(max_moved);
+  }
+}
+
+void MotiveEngine::SetLocalitySortBudget(MotivatorType type,
+                                         MotiveIndex max_swaps) {
+  MotiveProcessor* processor = Processor(type);
+  assert(processor != nullptr);
+  processor->SetLocalitySortBudget(max_swaps);
+}
+
+MotiveIndex MotiveEngine::NumActiveIndices() const {
+  MotiveIndex num_indices = 0;
+  for (ProcessorMap::const_iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    num_indices += it->second->NumActiveIndices();
+  }
+  return num_indices;
+}
+
+void MotiveEngine::SetSnapshotMode(bool snapshot_mode) {
+  snapshot_mode_ = snapshot_mode;
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->SetIndicesPinned(snapshot_mode);
+  }
+}
+
+const MotiveSnapshot& MotiveEngine::AcquireSnapshot() {
+  // Only swap if there's something new. Otherwise we'd take back the stale
+  // snapshot that we just handed over.
+  if (snapshot_ready_.load() & kSnapshotFresh) {
+    snapshot_front_ =
+        snapshot_ready_.exchange(snapshot_front_) & kSnapshotIndexMask;
+  }
+  return snapshots_[snapshot_front_];
+}
+
+void MotiveEngine::Defragment() {
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->ForceDefragment();
+  }
+  if (snapshot_mode_) {
+    PublishSnapshot();
+  }
+}
+
+void MotiveEngine::SetDeterministicMode(bool deterministic_mode) {
+  deterministic_mode_ = deterministic_mode;
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->SetDeterministic(deterministic_mode);
+  }
+}
+
+void MotiveEngine::SetEventQueueCapacity(size_t capacity) {
+  events_.SetCapacity(capacity);
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->SetEventsEnabled(capacity > 0);
+  }
+}
+
+uint64_t MotiveEngine::StateHash() const {
+  // The map is sorted by address, which differs between machines. Hash each
+  // processor separately, seeded with its name, and combine the hashes with
+  // an operation that doesn't depend on order.
+  uint64_t hash = 0;
+  for (ProcessorMap::const_iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    const char* name = *it->first;
+    hash ^= it->second->HashOutputs(HashBytes(name, strlen(name)));
+  }
+  return hash;
+}
+
+void MotiveEngine::SaveState(MotiveState* state) {
+  state->Clear();
+  state->Write(static_cast<int>(mapped_processors_.size()));
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    state->Write(it->first);
+    it->second->SaveState(state);
+  }
+}
+
+bool MotiveEngine::RestoreState(const MotiveState& state) {
+  // Walk the whole blob once without copying, so that a blob that doesn't
+  // match leaves every processor untouched.
+  if (!RestoreProcessors(state, true)) return false;
+  const bool restored = RestoreProcessors(state, false);
+  assert(restored);
+  (void)restored;
+  if (snapshot_mode_) {
+    PublishSnapshot();
+  }
+  return true;
+}
+
+bool MotiveEngine::RestoreProcessors(const MotiveState& state,
+                                     bool verifying) {
+  MotiveStateReader reader(state, verifying);
+  const int num_processors = reader.Read<int>();
+  if (!reader.Check(num_processors ==
+                    static_cast<int>(mapped_processors_.size()))) {
+    return false;
+  }
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    const MotivatorType type = reader.Read<MotivatorType>();
+    if (!reader.Check(type == it->first)) return false;
+    if (!it->second->RestoreState(&reader)) return false;
+  }
+  return reader.Check(reader.AtEnd());
+}
+
+void MotiveEngine::PublishSnapshot() {
+  MotiveSnapshot& snapshot = snapshots_[snapshot_back_];
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    it->second->Snapshot(&snapshot.ForProcessor(it->second));
+  }
+  snapshot.IndexMotivators();
+  snapshot.set_frame(frame_count_);
+
+  // Hand the snapshot over and take back whichever one the reader has
+  // released, if any.
+  snapshot_back_ = snapshot_ready_.exchange(snapshot_back_ | kSnapshotFresh) &
+                   kSnapshotIndexMask;
+}
+
+void MotiveEngine::SetAdvanceFrameChunkSize(MotiveIndex chunk_size) {
+  assert(chunk_size > 0);
+  chunk_size_ = chunk_size;
+}
 
-  return details.processor;
+// Sort by priority, then by name, so that the schedule doesn't depend on
+// where the processors happen to be allocated.
+static bool ProcessorLess(const MotiveProcessor* a, const MotiveProcessor* b) {
+  if (a->Priority() != b->Priority()) return a->Priority() < b->Priority();
+  return strcmp(*a->Type(), *b->Type()) < 0;
+}
+
+void MotiveEngine::BuildSchedule() {
+  std::vector<MotiveProcessor*> nodes;
+  nodes.reserve(mapped_processors_.size());
+  for (ProcessorMap::iterator it = mapped_processors_.begin();
+       it != mapped_processors_.end(); ++it) {
+    nodes.push_back(it->second);
+  }
+  std::sort(nodes.begin(), nodes.end(), ProcessorLess);
+
+  // There are only ever a handful of processors, so use the simplest
+  // algorithms available. reaches[i * n + j] is true if processor i reads,
+  // directly or indirectly, the output of processor j.
+  const size_t n = nodes.size();
+  std::vector<bool> reaches(n * n, false);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      reaches[i * n + j] = i != j && nodes[i]->ReadsFrom(*nodes[j]);
+    }
+  }
+  for (size_t k = 0; k < n; ++k) {
+    for (size_t i = 0; i < n; ++i) {
+      if (!reaches[i * n + k]) continue;
+      for (size_t j = 0; j < n; ++j) {
+        if (reaches[k * n + j]) reaches[i * n + j] = true;
+      }
+    }
+  }
+
+  // Processors that read each other, directly or indirectly, form a cycle.
+  // Represent each cycle by its first member.
+  std::vector<size_t> cycle(n);
+  std::vector<size_t> cycle_size(n, 0);
+  for (size_t i = 0; i < n; ++i) {
+    cycle[i] = i;
+    for (size_t j = 0; j < i; ++j) {
+      if (reaches[i * n + j] && reaches[j * n + i]) {
+        cycle[i] = cycle[j];
+        break;
+      }
+    }
+    cycle_size[cycle[i]]++;
+  }
+
+  // A processor's level is one more than the level of any processor it reads
+  // from outside of its own cycle. Processors of the same level are
+  // independent. Relax until nothing changes; the number of passes is
+  // bounded by the length of the longest dependency chain.
+  std::vector<int> level(n, 0);
+  int num_levels = n > 0 ? 1 : 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = 0; j < n; ++j) {
+        if (cycle[i] == cycle[j] || !reaches[i * n + j]) continue;
+        if (level[cycle[i]] <= level[cycle[j]]) {
+          level[cycle[i]] = level[cycle[j]] + 1;
+          num_levels = std::max(num_levels, level[cycle[i]] + 1);
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // Processors not in a cycle are advanced together. Each cycle is advanced
+  // one processor at a time, and then once more with zero time so that every
+  // member sees the latest output of the others.
+  schedule_.clear();
+  for (int l = 0; l < num_levels; ++l) {
+    ScheduleStage independent;
+    independent.refresh = false;
+    for (size_t i = 0; i < n; ++i) {
+      if (level[cycle[i]] == l && cycle_size[cycle[i]] == 1) {
+        independent.processors.push_back(nodes[i]);
+      }
+    }
+    if (!independent.processors.empty()) schedule_.push_back(independent);
+
+    for (size_t c = 0; c < n; ++c) {
+      if (cycle[c] != c || level[c] != l || cycle_size[c] == 1) continue;
+      for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < n; ++i) {
+          if (cycle[i] != c) continue;
+          ScheduleStage member;
+          member.processors.push_back(nodes[i]);
+          member.refresh = pass > 0;
+          schedule_.push_back(member);
+        }
+      }
+    }
+  }
+  schedule_dirty_ = false;
 }
 
 void MotiveEngine::AdvanceFrame(MotiveTime delta_time) {
-  // Advance the simulation in each processor.
-  // TODO: At some point, we'll want to do several passes. An item in
-  // processor A might depend on the output of an item in processor B,
-  // which might in turn depend on the output of a *different* item in
-  // processor A. In this case, we have to do two passes. For now, just
-  // assume that one pass is sufficient.
-  for (ProcessorSet::iterator it = sorted_processors_.begin();
-       it != sorted_processors_.end(); ++it) {
-    const motive::Benchmark b(it->processor->benchmark_id_for_advance_frame());
-    it->processor->AdvanceFrame(delta_time);
+  if (worker_pool_) {
+    WorkerPoolExecutor executor(worker_pool_.get());
+    AdvanceFrame(delta_time, &executor);
+    return;
+  }
+
+  if (schedule_dirty_) {
+    BuildSchedule();
+  }
+
+  // Advance the simulation in each processor. A stage runs only once all
+  // the stages before it have finished, so each processor sees the output
+  // of every processor it reads from.
+  for (Schedule::const_iterator stage = schedule_.begin();
+       stage != schedule_.end(); ++stage) {
+    const MotiveTime stage_time = stage->refresh ? 0 : delta_time;
+    for (auto it = stage->processors.begin(); it != stage->processors.end();
+         ++it) {
+      const motive::Benchmark b((*it)->benchmark_id_for_advance_frame());
+      (*it)->AdvanceFrame(stage_time);
+      (*it)->UpdateChangedIndices();
+      (*it)->WriteOutputBindings();
+    }
+  }
+  FinishFrame();
+}
+
+void MotiveEngine::AdvanceFrame(MotiveTime delta_time,
+                                MotiveTaskExecutor* executor) {
+  MotiveTaskGraph* graph = BeginAdvanceFrame(delta_time);
+  executor->Execute(graph);
+  EndAdvanceFrame();
+}
+
+MotiveTaskGraph* MotiveEngine::BeginAdvanceFrame(MotiveTime delta_time) {
+  if (schedule_dirty_) {
+    BuildSchedule();
+  }
+
+  task_graph_.Clear();
+  processor_tasks_.clear();
+  stage_finish_tasks_.clear();
+
+  const MotiveIndex alignment = MotiveProcessor::kAdvanceFrameRangeAlignment;
+  const MotiveIndex chunk_size =
+      (chunk_size_ + alignment - 1) / alignment * alignment;
+
+  // Each stage occupies three phases: BeginAdvanceFrame(), the work itself,
+  // and EndAdvanceFrame(). Every task that starts a stage depends on every
+  // task that finishes the stage before it.
+  for (size_t s = 0; s < schedule_.size(); ++s) {
+    const ScheduleStage& stage = schedule_[s];
+    const MotiveTime stage_time = stage.refresh ? 0 : delta_time;
+    const int phase = static_cast<int>(3 * s);
+    const size_t first_record = processor_tasks_.size();
+    next_stage_finish_tasks_.clear();
+
+    // Let each processor prepare for the frame, for example by
+    // defragmenting its indices.
+    for (size_t i = 0; i < stage.processors.size(); ++i) {
+      MotiveProcessor* processor = stage.processors[i];
+      ProcessorTasks record = {processor, -1, -1, 0, 0};
+      if (processor->SupportsAdvanceFrameRange()) {
+        record.begin_task = task_graph_.AddTask(
+            processor, MotiveTaskGraph::kBeginAdvanceFrame, 0, 0, stage_time,
+            phase);
+        AddStageDependencies();
+      }
+      processor_tasks_.push_back(record);
+    }
+
+    // Processors that can't be split become a single task. Queue those
+    // first, since they're likely to be the longest running tasks. The cheap
+    // chunks after them then fill in the gaps.
+    for (size_t r = first_record; r < processor_tasks_.size(); ++r) {
+      ProcessorTasks& record = processor_tasks_[r];
+      if (record.begin_task >= 0) continue;
+      record.first_advance_task = task_graph_.AddTask(
+          record.processor, MotiveTaskGraph::kAdvanceFrame, 0, 0, stage_time,
+          phase + 1);
+      record.end_advance_task = record.first_advance_task + 1;
+      AddStageDependencies();
+      next_stage_finish_tasks_.push_back(record.first_advance_task);
+    }
+
+    // Chunks are sized from the indices in use now. BeginAdvanceFrame() may
+    // only shrink that, so MotiveTaskGraph::Run() clamps each chunk.
+    // Chunks start on aligned indices, so that no two chunks write to the
+    // same word of a processor's bit sets.
+    for (size_t r = first_record; r < processor_tasks_.size(); ++r) {
+      ProcessorTasks& record = processor_tasks_[r];
+      if (record.begin_task < 0) continue;
+      const MotiveIndex num_indices = record.processor->NumIndices();
+      record.first_advance_task = task_graph_.NumTasks();
+      for (MotiveIndex begin = 0; begin < num_indices; begin += chunk_size) {
+        const MotiveIndex end = std::min(begin + chunk_size, num_indices);
+        task_graph_.AddTask(record.processor,
+                            MotiveTaskGraph::kAdvanceFrameRange, begin, end,
+                            stage_time, phase + 1);
+        task_graph_.AddDependency(record.begin_task);
+      }
+      record.end_advance_task = task_graph_.NumTasks();
+    }
+
+    for (size_t r = first_record; r < processor_tasks_.size(); ++r) {
+      ProcessorTasks& record = processor_tasks_[r];
+      if (record.begin_task < 0) continue;
+      record.end_task = task_graph_.AddTask(
+          record.processor, MotiveTaskGraph::kEndAdvanceFrame, 0, 0,
+          stage_time, phase + 2);
+      if (record.first_advance_task == record.end_advance_task) {
+        task_graph_.AddDependency(record.begin_task);
+      }
+      for (int t = record.first_advance_task; t < record.end_advance_task;
+           ++t) {
+        task_graph_.AddDependency(t);
+      }
+      next_stage_finish_tasks_.push_back(record.end_task);
+    }
+
+    stage_finish_tasks_.swap(next_stage_finish_tasks_);
+  }
+  return &task_graph_;
+}
+
+void MotiveEngine::AddStageDependencies() {
+  for (size_t i = 0; i < stage_finish_tasks_.size(); ++i) {
+    task_graph_.AddDependency(stage_finish_tasks_[i]);
+  }
+}
+
+void MotiveEngine::EndAdvanceFrame() {
+  // Record the total time each processor spent, summed over every thread.
+  for (size_t r = 0; r < processor_tasks_.size(); ++r) {
+    const ProcessorTasks& record = processor_tasks_[r];
+    BenchmarkTime duration = 0;
+    if (record.begin_task >= 0) {
+      duration += task_graph_.task(record.begin_task).duration +
+                  task_graph_.task(record.end_task).duration;
+    }
+    for (int t = record.first_advance_task; t < record.end_advance_task; ++t) {
+      duration += task_graph_.task(t).duration;
+    }
+    AddBenchmarkSample(record.processor->benchmark_id_for_advance_frame(),
+                       duration);
+  }
+  FinishFrame();
+}
+
+void MotiveEngine::FinishFrame() {
+  // Every processor has finished, so collect events in schedule order, on
+  // this thread.
+  if (events_.capacity() > 0) {
+    for (Schedule::const_iterator stage = schedule_.begin();
+         stage != schedule_.end(); ++stage) {
+      for (auto it = stage->processors.begin(); it != stage->processors.end();
+           ++it) {
+        (*it)->CollectEvents(&events_);
+      }
+    }
+  }
+
+  frame_count_++;
+  if (snapshot_mode_) {
+    PublishSnapshot();
   }
 }
 
@@ -0,0 +1,140 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <functional>
+
+#include "motive/engine.h"
+#include "motive/engine_group.h"
+#include "motive/util/worker_pool.h"
+
+namespace motive {
+
+MotiveEngineGroup::MotiveEngineGroup(int num_threads)
+    : bins_per_thread_(kDefaultBinsPerThread), bin_starts_(1, 0) {
+  assert(num_threads >= 0);
+  if (num_threads > 0) {
+    worker_pool_.reset(new WorkerPool(num_threads));
+  }
+}
+
+MotiveEngineGroup::~MotiveEngineGroup() {}
+
+void MotiveEngineGroup::AddEngine(MotiveEngine* engine) {
+  assert(engine != nullptr);
+  assert(std::find(engines_.begin(), engines_.end(), engine) ==
+         engines_.end());
+  engines_.push_back(engine);
+}
+
+void MotiveEngineGroup::RemoveEngine(MotiveEngine* engine) {
+  engines_.erase(std::remove(engines_.begin(), engines_.end(), engine),
+                 engines_.end());
+}
+
+int MotiveEngineGroup::NumWorkerThreads() const {
+  return worker_pool_ ? worker_pool_->num_threads() : 0;
+}
+
+void MotiveEngineGroup::SetBinsPerThread(int bins_per_thread) {
+  assert(bins_per_thread > 0);
+  bins_per_thread_ = bins_per_thread;
+}
+
+void MotiveEngineGroup::AdvanceFrame(MotiveTime delta_time) {
+  // With no threads to balance across, packing would be wasted effort.
+  if (!worker_pool_) {
+    for (size_t i = 0; i < engines_.size(); ++i) {
+      engines_[i]->AdvanceFrame(delta_time);
+    }
+    bin_starts_.assign(1, 0);
+    bin_starts_.push_back(NumEngines());
+    return;
+  }
+
+  PackBins();
+  worker_pool_->Run(NumBins(), [this, delta_time](int bin) {
+    for (int i = bin_starts_[bin]; i < bin_starts_[bin + 1]; ++i) {
+      binned_engines_[i]->AdvanceFrame(delta_time);
+    }
+  });
+}
+
+void MotiveEngineGroup::PackBins() {
+  const int num_engines = NumEngines();
+  const int num_bins =
+      std::min(num_engines, (NumWorkerThreads() + 1) * bins_per_thread_);
+
+  // Heaviest engines first. The sort is stable so that engines with equal
+  // loads are always packed the same way.
+  engine_loads_.clear();
+  for (int i = 0; i < num_engines; ++i) {
+    engine_loads_.push_back(EngineLoad(
+        engines_[i]->NumActiveIndices() + kEngineOverhead, engines_[i]));
+  }
+  std::stable_sort(engine_loads_.begin(), engine_loads_.end(),
+                   [](const EngineLoad& a, const EngineLoad& b) {
+                     return a.first > b.first;
+                   });
+
+  // Add each engine to the bin with the least work so far. `bin_heap_` is a
+  // min-heap, so the lightest bin is always at the front.
+  const std::greater<BinLoad> heavier;
+  bin_heap_.clear();
+  for (int b = 0; b < num_bins; ++b) {
+    bin_heap_.push_back(BinLoad(0, b));
+  }
+  std::make_heap(bin_heap_.begin(), bin_heap_.end(), heavier);
+  engine_bins_.resize(num_engines);
+  for (int i = 0; i < num_engines; ++i) {
+    std::pop_heap(bin_heap_.begin(), bin_heap_.end(), heavier);
+    BinLoad& lightest = bin_heap_.back();
+    engine_bins_[i] = lightest.second;
+    lightest.first += engine_loads_[i].first;
+    std::push_heap(bin_heap_.begin(), bin_heap_.end(), heavier);
+  }
+
+  // Rank the bins from heaviest to lightest. The WorkerPool hands out bins
+  // in order, so the longest bins start first and the short ones fill in the
+  // gaps at the end of the frame.
+  bin_order_ = bin_heap_;
+  std::sort(bin_order_.begin(), bin_order_.end(),
+            [](const BinLoad& a, const BinLoad& b) {
+              return a.first != b.first ? a.first > b.first
+                                        : a.second < b.second;
+            });
+  bin_ranks_.resize(num_bins);
+  for (int r = 0; r < num_bins; ++r) {
+    bin_ranks_[bin_order_[r].second] = r;
+  }
+
+  // Counting sort the engines by the rank of their bin. First set
+  // bin_starts_[r] to the end of bin r, then fill each bin from the back,
+  // which leaves bin_starts_[r] at the start of bin r.
+  bin_starts_.assign(num_bins + 1, 0);
+  for (int i = 0; i < num_engines; ++i) {
+    bin_starts_[bin_ranks_[engine_bins_[i]]]++;
+  }
+  for (int r = 1; r < num_bins; ++r) {
+    bin_starts_[r] += bin_starts_[r - 1];
+  }
+  bin_starts_[num_bins] = num_engines;
+  binned_engines_.resize(num_engines);
+  for (int i = num_engines - 1; i >= 0; --i) {
+    const int rank = bin_ranks_[engine_bins_[i]];
+    binned_engines_[--bin_starts_[rank]] = engine_loads_[i].second;
+  }
+}
+
+}  // namespace motive
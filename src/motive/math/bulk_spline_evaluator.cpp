@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -19,6 +22,7 @@
 #include "motive/math/bulk_spline_evaluator.h"
 #include "motive/math/dual_cubic.h"
 #include "motive/util/benchmark.h"
+#include "motive/util/move_range.h"
 
 using mathfu::Lerp;
 
@@ -35,6 +39,37 @@ extern "C" void EvaluateCubics_Neon(const CubicCurve* curves, const float* xs,
                                     const void* y_ranges, int num_curves,
                                     float* ys);
 
+#if defined(MOTIVE_X86_64)
+// These functions are implemented with intrinsics, in
+// bulk_spline_evaluator_x86.cpp. Unlike the NEON version, the x update takes
+// each index's playback rate, `rate_stride` floats apart.
+void UpdateCubicXsAndGetMask_Sse(float delta_x, const float* rates,
+                                 int rate_stride, const float* x_ends,
+                                 int num_xs, float* xs, uint8_t* masks);
+void EvaluateCubics_Sse(const CubicCurve* curves, const float* xs,
+                        int num_curves, float* ys);
+void UpdateCubicXsAndGetMask_Avx2(float delta_x, const float* rates,
+                                  int rate_stride, const float* x_ends,
+                                  int num_xs, float* xs, uint8_t* masks);
+void EvaluateCubics_Avx2(const CubicCurve* curves, const float* xs,
+                         int num_curves, float* ys);
+#endif  // defined(MOTIVE_X86_64)
+
+// Check the CPU once, rather than once per evaluator.
+static ProcessorOptimization DefaultOptimization() {
+  static const ProcessorOptimization kBest = BestProcessorOptimization();
+
+  // The NEON x update predates playback rates, so it's only used on request.
+  return kBest == kNeonOptimizations ? kNoOptimizations : kBest;
+}
+
+BulkSplineEvaluator::BulkSplineEvaluator()
+    : optimization_(DefaultOptimization()), deterministic_(false) {
+  // Avoid "private member variable unused" warning on OSX.
+  (void)optimization_;
+  (void)deterministic_;
+}
+
 void BulkSplineEvaluator::SetNumIndices(const Index num_indices) {
   sources_.resize(num_indices);
   y_ranges_.resize(num_indices);
@@ -43,22 +78,56 @@ void BulkSplineEvaluator::SetNumIndices(const Index num_indices) {
   cubics_.resize(num_indices);
   ys_.resize(num_indices, 0.0f);
   scratch_.resize(num_indices, 0);
+  active_.Resize(num_indices, true);
+  held_.Resize(num_indices, false);
+}
+
+void BulkSplineEvaluator::Reserve(const Index num_indices) {
+  sources_.reserve(num_indices);
+  y_ranges_.reserve(num_indices);
+  cubic_xs_.reserve(num_indices);
+  cubic_x_ends_.reserve(num_indices);
+  cubics_.reserve(num_indices);
+  ys_.reserve(num_indices);
+  scratch_.reserve(num_indices);
+  active_.Reserve(num_indices);
+  held_.Reserve(num_indices);
 }
 
 void BulkSplineEvaluator::MoveIndices(
     const Index old_index, const Index new_index, const Index count) {
-  for (Index i = 0; i < count; ++i) {
-    const Index old_i = old_index + i;
-    const Index new_i = new_index + i;
-    sources_[new_i] = sources_[old_i];
-    y_ranges_[new_i] = y_ranges_[old_i];
-    cubic_xs_[new_i] = cubic_xs_[old_i];
-    cubic_x_ends_[new_i] = cubic_x_ends_[old_i];
-    cubics_[new_i] = cubics_[old_i];
-    ys_[new_i] = ys_[old_i];
+  CopyIndexData(old_index, new_index, count);
+
+  // The vacated indices may be handed out again without being cleared, so
+  // leave them without a spline, and inactive.
+  Index vacated_end;
+  const Index vacated_start =
+      VacatedRange(old_index, new_index, count, &vacated_end);
+  for (Index i = vacated_start; i < vacated_end; ++i) {
+    sources_[i] = Source();
+    y_ranges_[i] = YRange();
+    cubics_[i] = CubicCurve();
+    cubic_xs_[i] = 0.0f;
+    cubic_x_ends_[i] = std::numeric_limits<float>::infinity();
+    ys_[i] = 0.0f;
+    active_.Clear(i);
+    held_.Clear(i);
   }
 }
 
+void BulkSplineEvaluator::CopyIndexData(
+    const Index old_index, const Index new_index, const Index count) {
+  // Every array is plain data, so copy each with one block copy.
+  MoveRangeBytes(&sources_, old_index, new_index, count);
+  MoveRangeBytes(&y_ranges_, old_index, new_index, count);
+  MoveRangeBytes(&cubic_xs_, old_index, new_index, count);
+  MoveRangeBytes(&cubic_x_ends_, old_index, new_index, count);
+  MoveRangeBytes(&cubics_, old_index, new_index, count);
+  MoveRangeBytes(&ys_, old_index, new_index, count);
+  active_.Move(old_index, new_index, count);
+  held_.Move(old_index, new_index, count);
+}
+
 void BulkSplineEvaluator::SetYRanges(const Index index, const Index count,
                                      const Range& modular_range) {
   for (int i = index; i < index + count; ++i) {
@@ -148,6 +217,7 @@ void BulkSplineEvaluator::BlendToSpline(const Index index,
       cubic_start_x + playback.blend_x * playback.playback_rate;
   cubics_[index].Init(blend_init);
   cubics_[index].ShiftRight(cubic_start_x);
+  active_.Set(index);
 }
 
 void BulkSplineEvaluator::JumpToSpline(const Index index,
@@ -205,6 +275,12 @@ void BulkSplineEvaluator::ClearSplines(const Index index, const Index count) {
     cubics_[i] = CubicCurve(0.0f, 0.0f, 0.0f, cubic_xs_[i]);
     cubic_xs_[i] = 0.0f;
     cubic_x_ends_[i] = std::numeric_limits<float>::infinity();
+
+    // The cubic is constant, so evaluate it once here instead of every
+    // frame. Unused indices, left until the next Defragment(), then cost
+    // nothing.
+    EvaluateIndex(i);
+    active_.Clear(i);
   }
 }
 
@@ -231,26 +307,33 @@ void BulkSplineEvaluator::SetRepeating(const Index index, const Index count,
 }
 
 void BulkSplineEvaluator::UpdateCubicXsAndGetMask_C(const float delta_x,
+                                                    const Index begin,
+                                                    const Index end,
                                                     uint8_t* masks) {
-  const int num_xs = NumIndices();
-  const float* x_ends = &cubic_x_ends_.front();
-  float* xs = &cubic_xs_.front();
+  const float* x_ends = &cubic_x_ends_[begin];
+  float* xs = &cubic_xs_[begin];
+  const Source* sources = &sources_[begin];
+  const int num_xs = end - begin;
 
   for (int i = 0; i < num_xs; ++i) {
-    xs[i] += delta_x * sources_[i].rate;
+    xs[i] += delta_x * sources[i].rate;
     masks[i] = xs[i] > x_ends[i] ? 0xFF : 0x00;
   }
 }
 
-// For each non-zero mask[i], append 'i' to 'indices'.
+// For each non-zero mask[i], append 'i + offset' to 'indices'.
 // Returns: final length of indices.
 // TODO OPT: Add assembly version if generated code is poor.
 static size_t ConvertMaskToIndices(const uint8_t* mask, size_t length,
+                                   BulkSplineEvaluator::Index offset,
                                    BulkSplineEvaluator::Index* indices) {
   size_t num_indices = 0;
   for (size_t i = 0; i < length; ++i) {
-    indices[num_indices] = static_cast<uint16_t>(i);
-    if (mask[i] != 0) {
+    // Read mask[i] before writing, since `indices` may overwrite it.
+    const bool set = mask[i] != 0;
+    indices[num_indices] =
+        offset + static_cast<BulkSplineEvaluator::Index>(i);
+    if (set) {
       num_indices++;
     }
   }
@@ -261,29 +344,35 @@ static size_t ConvertMaskToIndices(const uint8_t* mask, size_t length,
 // into a list of indices. This algorithm is best for many SIMD implementations,
 // since they have trouble converting masks into indices.
 size_t BulkSplineEvaluator::UpdateCubicXs_TwoSteps(const float delta_x,
+                                                   const Index begin,
+                                                   const Index end,
                                                    Index* indices_to_init) {
-  // Use last half of 'indices_to_init' as a scratch buffer for 'mask'.
-  // Must be the last half since we read 'mask' to write 'indices_to_init'
-  // in ConvertMaskToIndices().
-  const Index num_indices = NumIndices();
-  uint8_t* mask = reinterpret_cast<uint8_t*>(&indices_to_init[num_indices / 2]);
+  // Use the last `num_indices` bytes of 'indices_to_init' as a scratch buffer
+  // for 'mask'. ConvertMaskToIndices() writes index i no later than it reads
+  // mask[i], and index i ends before mask[i + 1] starts, so no unread mask
+  // byte is overwritten.
+  const Index num_indices = end - begin;
+  uint8_t* mask =
+      reinterpret_cast<uint8_t*>(&indices_to_init[0] + num_indices) -
+      num_indices;
 
   // Add delta_x to each of the cubic_xs_.
   // Set mask[i] to 0xFF if the cubic has gone past the end of its array.
-  UpdateCubicXsAndGetMask(delta_x, mask);
+  UpdateCubicXsAndGetMask(delta_x, begin, end, mask);
 
   // Get indices that are true 0xFF in the mask array.
-  return ConvertMaskToIndices(mask, num_indices, indices_to_init);
+  return ConvertMaskToIndices(mask, num_indices, begin, indices_to_init);
 }
 
 // Record the indices, as we go along, for every index we need to re-init.
 // This algorithm is fastest when we process indices serially.
 size_t BulkSplineEvaluator::UpdateCubicXs_OneStep(const float delta_x,
+                                                  const Index begin,
+                                                  const Index end,
                                                   Index* indices_to_init) {
-  const Index num_indices = NumIndices();
   size_t num_to_init = 0;
 
-  for (Index i = 0; i < num_indices; ++i) {
+  for (Index i = begin; i < end; ++i) {
     // Increment each cubic x value by delta_x.
     cubic_xs_[i] += delta_x * sources_[i].rate;
 
@@ -323,6 +412,10 @@ void BulkSplineEvaluator::InitCubic(const Index index, const float start_x) {
 
   c.ScaleUp(s.y_scale);
   c.ShiftUp(s.y_offset);
+
+  // Past the end of the spline, the cubic is constant and its x-range is
+  // infinite, so it needs evaluating only once more.
+  active_.Assign(index, x_index != kAfterSplineIndex);
 }
 
 void BulkSplineEvaluator::EvaluateIndex(const Index index) {
@@ -331,27 +424,121 @@ void BulkSplineEvaluator::EvaluateIndex(const Index index) {
   ys_[index] = c.Evaluate(cubic_xs_[index]);
 }
 
-void BulkSplineEvaluator::EvaluateCubics_C() {
-  for (Index index = 0; index < NumIndices(); ++index) {
+void BulkSplineEvaluator::EvaluateCubics_C(const Index begin,
+                                           const Index end) {
+  for (Index index = begin; index < end; ++index) {
     EvaluateIndex(index);
   }
 }
 
 void BulkSplineEvaluator::AdvanceFrame(const float delta_x) {
-  // Add 'delta_x' to 'cubic_xs'.
-  // Gather a list of indices that are now beyond the end of the cubic.
-  Index* indices_to_init = scratch_.size() == 0 ? nullptr : &scratch_.front();
-  const size_t num_to_init = UpdateCubicXs(delta_x, indices_to_init);
-
-  // Reinitialize indices that have traversed beyond the end of their cubic.
-  for (size_t i = 0; i < num_to_init; ++i) {
-    const Index index = indices_to_init[i];
-    InitCubic(index, X(index));
+  AdvanceFrameRange(delta_x, 0, NumIndices());
+}
+
+void BulkSplineEvaluator::AdvanceFrameRange(const float delta_x,
+                                            const Index begin,
+                                            const Index end,
+                                            IndexBitSet* ended) {
+  assert(0 <= begin && begin <= end && end <= NumIndices());
+  if (begin == end) return;
+
+  // Held indices are left out of the x update, as well as the evaluation
+  // below, so advance runs of unheld indices. Usually nothing is held, and
+  // the whole range is one run.
+  for (Index run_begin = held_.NextClear(begin, end); run_begin < end;) {
+    const Index run_end = held_.NextSet(run_begin, end);
+
+    // Add 'delta_x' to 'cubic_xs'.
+    // Gather a list of indices that are now beyond the end of the cubic.
+    // Each run uses its own slice of the scratch buffer, so that ranges can
+    // be processed concurrently.
+    Index* indices_to_init = &scratch_[run_begin];
+    const size_t num_to_init =
+        UpdateCubicXs(delta_x, run_begin, run_end, indices_to_init);
+
+    // Reinitialize indices that have traversed beyond the end of their
+    // cubic. Splines that have just finished get their final evaluation here.
+    for (size_t i = 0; i < num_to_init; ++i) {
+      const Index index = indices_to_init[i];
+      InitCubic(index, X(index));
+      if (!active_.Test(index)) {
+        EvaluateCubics(index, index + 1);
+        if (ended != nullptr) ended->Set(index);
+      }
+    }
+    run_begin = held_.NextClear(run_end, end);
   }
 
   // Update 'ys_' array. Also might affect the constant coefficients of
-  // 'cubics_', if we're adjusting for modular arithmetic.
-  EvaluateCubics();
+  // 'cubics_', if we're adjusting for modular arithmetic. Evaluate runs of
+  // active, unheld indices, so that the bulk evaluators still see contiguous
+  // data.
+  for (Index run_begin = active_.NextSet(begin, end); run_begin < end;) {
+    if (held_.Test(run_begin)) {
+      run_begin = active_.NextSet(held_.NextClear(run_begin, end), end);
+      continue;
+    }
+    const Index run_end = std::min(active_.NextClear(run_begin, end),
+                                   held_.NextSet(run_begin, end));
+    EvaluateCubics(run_begin, run_end);
+    run_begin = active_.NextSet(run_end, end);
+  }
+}
+
+void BulkSplineEvaluator::FastForward(const Index index, const float delta_x,
+                                      IndexBitSet* ended) {
+  const Source& s = sources_[index];
+  if (s.spline == nullptr) return;
+
+  // Stay on the current cubic if we haven't reached its end. The current
+  // cubic may be a blend, which isn't part of the spline.
+  const float delta_cubic_x = delta_x * s.rate;
+  if (cubic_xs_[index] + delta_cubic_x <= cubic_x_ends_[index]) {
+    cubic_xs_[index] += delta_cubic_x;
+    EvaluateIndex(index);
+    return;
+  }
+
+  // Wrap repeating splines here, since x may be many loops past the end.
+  // IndexForXAllowingRepeat() expects x to be within a few loops.
+  float x = X(index) + delta_cubic_x;
+  const float end_x = s.spline->EndX();
+  if (s.repeat && x > end_x && end_x > 0.0f) {
+    x = std::fmod(x, end_x);
+  }
+
+  // Find the segment for `x` with a binary search, instead of stepping
+  // through every segment in between.
+  const bool was_active = active_.Test(index);
+  InitCubic(index, x);
+  EvaluateIndex(index);
+  if (was_active && !active_.Test(index) && ended != nullptr) {
+    ended->Set(index);
+  }
+}
+
+void BulkSplineEvaluator::SaveState(MotiveState* state) const {
+  const Index num_indices = NumIndices();
+  state->Write(num_indices);
+  state->Write(sources_.data(), num_indices);
+  state->Write(y_ranges_.data(), num_indices);
+  state->Write(cubic_xs_.data(), num_indices);
+  state->Write(cubic_x_ends_.data(), num_indices);
+  state->Write(cubics_.data(), num_indices);
+  state->Write(ys_.data(), num_indices);
+  state->Write(active_.words(), active_.num_words());
+}
+
+bool BulkSplineEvaluator::RestoreState(MotiveStateReader* reader) {
+  const Index num_indices = reader->Read<Index>();
+  if (!reader->Check(num_indices == NumIndices())) return false;
+  reader->Read(sources_.data(), num_indices);
+  reader->Read(y_ranges_.data(), num_indices);
+  reader->Read(cubic_xs_.data(), num_indices);
+  reader->Read(cubic_x_ends_.data(), num_indices);
+  reader->Read(cubics_.data(), num_indices);
+  reader->Read(ys_.data(), num_indices);
+  return reader->Read(active_.words(), active_.num_words());
 }
 
 bool BulkSplineEvaluator::Valid(const Index index) const {
@@ -369,98 +556,145 @@ bool BulkSplineEvaluator::Valid(const Index index) const {
 // These inline functions are used to redirect calls to the C or assembly
 // versions, or to run both versions and compare the output.
 inline void BulkSplineEvaluator::UpdateCubicXsAndGetMask(const float delta_x,
+                                                         const Index begin,
+                                                         const Index end,
                                                          uint8_t* masks) {
+  const int num_xs = end - begin;
 #if defined(MOTIVE_ASSEMBLY_TEST)
-  const int num_xs = NumIndices();
-  std::vector<float> xs_assembly(cubic_xs_);
+  std::vector<float> xs_assembly(cubic_xs_.begin() + begin,
+                                 cubic_xs_.begin() + end);
   std::vector<uint8_t> masks_assembly(num_xs);
 
-  UpdateCubicXsAndGetMask_C(delta_x, masks);
+  UpdateCubicXsAndGetMask_C(delta_x, begin, end, masks);
   MOTIVE_ASSEMBLY_FUNCTION_NAME(UpdateCubicXsAndGetMask_)(
-      delta_x, &cubic_x_ends_.front(), num_xs, &xs_assembly.front(),
+      delta_x, &cubic_x_ends_[begin], num_xs, &xs_assembly.front(),
       &masks_assembly.front());
 
   for (int i = 0; i < num_xs; ++i) {
-    assert(cubic_xs_[i] == xs_assembly[i]);
+    assert(cubic_xs_[begin + i] == xs_assembly[i]);
     assert(masks[i] == masks_assembly[i]);
   }
 
 #else  // not defined(MOTIVE_ASSEMBLY_TEST)
 
+#if defined(MOTIVE_X86_64)
+  // The x86 kernels read the playback rates straight out of `sources_`.
+  static_assert(sizeof(Source) % sizeof(float) == 0,
+                "rates must be a whole number of floats apart");
+  const int rate_stride = static_cast<int>(sizeof(Source) / sizeof(float));
+#endif
+
 #if defined(MOTIVE_NEON)
-  if (optimization_ == kNeonOptimizations) {
-    UpdateCubicXsAndGetMask_Neon(delta_x, &cubic_x_ends_.front(),
-                                  NumIndices(), &cubic_xs_.front(), masks);
+  if (optimization_ == kNeonOptimizations && !deterministic_) {
+    UpdateCubicXsAndGetMask_Neon(delta_x, &cubic_x_ends_[begin], num_xs,
+                                 &cubic_xs_[begin], masks);
+  } else
+#endif
+#if defined(MOTIVE_X86_64)
+  if (UseAvx2()) {
+    UpdateCubicXsAndGetMask_Avx2(delta_x, &sources_[begin].rate,
+                                 rate_stride, &cubic_x_ends_[begin], num_xs,
+                                 &cubic_xs_[begin], masks);
+  } else if (UseSse()) {
+    UpdateCubicXsAndGetMask_Sse(delta_x, &sources_[begin].rate, rate_stride,
+                                &cubic_x_ends_[begin], num_xs,
+                                &cubic_xs_[begin], masks);
   } else
 #endif
   {
-    UpdateCubicXsAndGetMask_C(delta_x, masks);
+    (void)num_xs;
+    UpdateCubicXsAndGetMask_C(delta_x, begin, end, masks);
   }
 
 #endif  // not defined(MOTIVE_ASSEMBLY_TEST)
 }
 
 inline size_t BulkSplineEvaluator::UpdateCubicXs(const float delta_x,
+                                                 const Index begin,
+                                                 const Index end,
                                                  Index* indices_to_init) {
 #if defined(MOTIVE_ASSEMBLY_TEST)
-  std::vector<float> xs_original(cubic_xs_);
-  std::vector<Index> indices_one(NumIndices());
+  std::vector<float> xs_original(cubic_xs_.begin() + begin,
+                                 cubic_xs_.begin() + end);
+  std::vector<Index> indices_one(end - begin);
 
-  const size_t num_one = UpdateCubicXs_OneStep(delta_x, &indices_one.front());
-  std::vector<float> xs_one(cubic_xs_);
+  const size_t num_one =
+      UpdateCubicXs_OneStep(delta_x, begin, end, &indices_one.front());
+  std::vector<float> xs_one(cubic_xs_.begin() + begin,
+                            cubic_xs_.begin() + end);
 
-  cubic_xs_ = xs_original;
-  const size_t num_two = UpdateCubicXs_TwoSteps(delta_x, indices_to_init);
+  std::copy(xs_original.begin(), xs_original.end(),
+            cubic_xs_.begin() + begin);
+  const size_t num_two =
+      UpdateCubicXs_TwoSteps(delta_x, begin, end, indices_to_init);
 
   assert(num_two == num_one);
   for (size_t i = 0; i < num_two; ++i) {
     assert(indices_to_init[i] == indices_one[i]);
   }
-  for (int i = 0; i < NumIndices(); ++i) {
-    assert(cubic_xs_[i] == xs_one[i]);
+  for (int i = begin; i < end; ++i) {
+    assert(cubic_xs_[i] == xs_one[i - begin]);
   }
   return num_two;
 
 #else  // not defined(MOTIVE_ASSEMBLY_TEST)
 
 #if defined(MOTIVE_NEON)
-  if (optimization_ == kNeonOptimizations) {
-    return UpdateCubicXs_TwoSteps(delta_x, indices_to_init);
+  if (optimization_ == kNeonOptimizations && !deterministic_) {
+    return UpdateCubicXs_TwoSteps(delta_x, begin, end, indices_to_init);
+  } else
+#endif
+#if defined(MOTIVE_X86_64)
+  if (UseAvx2() || UseSse()) {
+    return UpdateCubicXs_TwoSteps(delta_x, begin, end, indices_to_init);
   } else
 #endif
   {
-    return UpdateCubicXs_OneStep(delta_x, indices_to_init);
+    return UpdateCubicXs_OneStep(delta_x, begin, end, indices_to_init);
   }
 
 #endif  // not defined(MOTIVE_ASSEMBLY_TEST)
 }
 
-inline void BulkSplineEvaluator::EvaluateCubics() {
+inline void BulkSplineEvaluator::EvaluateCubics(const Index begin,
+                                                const Index end) {
+  const int num_curves = end - begin;
 #if defined(MOTIVE_ASSEMBLY_TEST)
-  std::vector<float> ys_assembly(NumIndices());
-  std::vector<CubicCurve> cubics_assembly(cubics_);
+  std::vector<float> ys_assembly(num_curves);
+  std::vector<CubicCurve> cubics_assembly(cubics_.begin() + begin,
+                                          cubics_.begin() + end);
 
   MOTIVE_ASSEMBLY_FUNCTION_NAME(EvaluateCubics_)(
-      &cubics_assembly.front(), &cubic_xs_.front(), &y_ranges_.front(),
-      NumIndices(), &ys_assembly.front());
-  EvaluateCubics_C();
+      &cubics_assembly.front(), &cubic_xs_[begin], &y_ranges_[begin],
+      num_curves, &ys_assembly.front());
+  EvaluateCubics_C(begin, end);
 
-  for (int i = 0; i < NumIndices(); ++i) {
-    assert(ys_assembly[i] == ys_[i]);
+  for (int i = 0; i < num_curves; ++i) {
+    assert(ys_assembly[i] == ys_[begin + i]);
   }
-  for (int i = 0; i < NumIndices(); ++i) {
-    assert(cubics_assembly[i] == cubics_[i]);
+  for (int i = 0; i < num_curves; ++i) {
+    assert(cubics_assembly[i] == cubics_[begin + i]);
   }
 #else  // not defined(MOTIVE_ASSEMBLY_TEST)
 
 #if defined(MOTIVE_NEON)
-  if (optimization_ == kNeonOptimizations) {
-    EvaluateCubics_Neon(&cubics_.front(), &cubic_xs_.front(),
-                        &y_ranges_.front(), NumIndices(), &ys_.front());
+  if (optimization_ == kNeonOptimizations && !deterministic_) {
+    EvaluateCubics_Neon(&cubics_[begin], &cubic_xs_[begin], &y_ranges_[begin],
+                        num_curves, &ys_[begin]);
+  } else
+#endif
+#if defined(MOTIVE_X86_64)
+  if (UseAvx2()) {
+    EvaluateCubics_Avx2(&cubics_[begin], &cubic_xs_[begin], num_curves,
+                        &ys_[begin]);
+  } else if (UseSse()) {
+    EvaluateCubics_Sse(&cubics_[begin], &cubic_xs_[begin], num_curves,
+                       &ys_[begin]);
   } else
 #endif
   {
-      EvaluateCubics_C();
+    (void)num_curves;
+    EvaluateCubics_C(begin, end);
   }
 
 #endif  // not defined(MOTIVE_ASSEMBLY_TEST)
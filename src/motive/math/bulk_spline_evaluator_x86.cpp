@@ -0,0 +1,177 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// SSE and AVX2 versions of BulkSplineEvaluator's inner loops.
+//
+// These use the same multiplies and adds, in the same order, as the C++
+// versions, and never fused multiply-adds, so their results match the C++
+// versions bit for bit. The AVX2 functions are compiled for AVX2 with a
+// function attribute, so that the rest of the library can still run on any
+// x86-64 CPU. Only call them if BestProcessorOptimization() returns
+// kAvx2Optimizations.
+
+#include "motive/util/optimizations.h"
+
+#if defined(MOTIVE_X86_64)
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+#include "motive/math/curve.h"
+
+#if defined(_MSC_VER)
+#define MOTIVE_TARGET_AVX2
+#else
+#define MOTIVE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace motive {
+
+// Write the low byte of each 32-bit lane of `lanes` to `masks`. Lanes are
+// all ones or all zeros, so the saturating packs keep them 0xFF or 0x00.
+static inline void StoreMask4(__m128i lanes, uint8_t* masks) {
+  const __m128i words = _mm_packs_epi32(lanes, lanes);
+  const __m128i bytes = _mm_packs_epi16(words, words);
+  const int32_t mask = _mm_cvtsi128_si32(bytes);
+  memcpy(masks, &mask, sizeof(mask));
+}
+
+void UpdateCubicXsAndGetMask_Sse(float delta_x, const float* rates,
+                                 int rate_stride, const float* x_ends,
+                                 int num_xs, float* xs, uint8_t* masks) {
+  const __m128 delta = _mm_set1_ps(delta_x);
+  int i = 0;
+  for (; i + 4 <= num_xs; i += 4) {
+    const float* r = rates + i * rate_stride;
+    const __m128 rate = _mm_setr_ps(r[0], r[rate_stride], r[2 * rate_stride],
+                                    r[3 * rate_stride]);
+    const __m128 x = _mm_add_ps(_mm_loadu_ps(xs + i), _mm_mul_ps(delta, rate));
+    _mm_storeu_ps(xs + i, x);
+    const __m128 past_end = _mm_cmpgt_ps(x, _mm_loadu_ps(x_ends + i));
+    StoreMask4(_mm_castps_si128(past_end), masks + i);
+  }
+  for (; i < num_xs; ++i) {
+    xs[i] += delta_x * rates[i * rate_stride];
+    masks[i] = xs[i] > x_ends[i] ? 0xFF : 0x00;
+  }
+}
+
+// Load the coefficients of the four curves at `curves` and transpose them,
+// so that `c[k]` holds the x^k coefficient of every curve.
+static inline void LoadCoefficients4(const CubicCurve* curves, __m128 c[4]) {
+  const float* p = reinterpret_cast<const float*>(curves);
+  c[0] = _mm_loadu_ps(p);
+  c[1] = _mm_loadu_ps(p + 4);
+  c[2] = _mm_loadu_ps(p + 8);
+  c[3] = _mm_loadu_ps(p + 12);
+  _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+}
+
+void EvaluateCubics_Sse(const CubicCurve* curves, const float* xs,
+                        int num_curves, float* ys) {
+  static_assert(sizeof(CubicCurve) == 4 * sizeof(float),
+                "CubicCurve must be four packed coefficients");
+  int i = 0;
+  for (; i + 4 <= num_curves; i += 4) {
+    __m128 c[4];
+    LoadCoefficients4(curves + i, c);
+
+    // ((c3 * x + c2) * x + c1) * x + c0, as in CubicCurve::Evaluate().
+    const __m128 x = _mm_loadu_ps(xs + i);
+    __m128 y = _mm_add_ps(_mm_mul_ps(c[3], x), c[2]);
+    y = _mm_add_ps(_mm_mul_ps(y, x), c[1]);
+    y = _mm_add_ps(_mm_mul_ps(y, x), c[0]);
+    _mm_storeu_ps(ys + i, y);
+  }
+  for (; i < num_curves; ++i) {
+    ys[i] = curves[i].Evaluate(xs[i]);
+  }
+}
+
+MOTIVE_TARGET_AVX2
+void UpdateCubicXsAndGetMask_Avx2(float delta_x, const float* rates,
+                                  int rate_stride, const float* x_ends,
+                                  int num_xs, float* xs, uint8_t* masks) {
+  const __m256 delta = _mm256_set1_ps(delta_x);
+  const __m256i rate_offsets =
+      _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                         _mm256_set1_epi32(rate_stride));
+  int i = 0;
+  for (; i + 8 <= num_xs; i += 8) {
+    const __m256 rate =
+        _mm256_i32gather_ps(rates + i * rate_stride, rate_offsets, 4);
+    const __m256 x =
+        _mm256_add_ps(_mm256_loadu_ps(xs + i), _mm256_mul_ps(delta, rate));
+    _mm256_storeu_ps(xs + i, x);
+    const __m256i past_end = _mm256_castps_si256(
+        _mm256_cmp_ps(x, _mm256_loadu_ps(x_ends + i), _CMP_GT_OQ));
+
+    // Pack the eight lanes into eight bytes.
+    const __m128i words =
+        _mm_packs_epi32(_mm256_castsi256_si128(past_end),
+                        _mm256_extracti128_si256(past_end, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(masks + i),
+                     _mm_packs_epi16(words, words));
+  }
+  for (; i < num_xs; ++i) {
+    xs[i] += delta_x * rates[i * rate_stride];
+    masks[i] = xs[i] > x_ends[i] ? 0xFF : 0x00;
+  }
+}
+
+// The four floats at `p` in the low half, and the four floats 16 floats
+// later in the high half.
+MOTIVE_TARGET_AVX2
+static inline __m256 LoadRowPair(const float* p) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)),
+                              _mm_loadu_ps(p + 16), 1);
+}
+
+MOTIVE_TARGET_AVX2
+void EvaluateCubics_Avx2(const CubicCurve* curves, const float* xs,
+                         int num_curves, float* ys) {
+  int i = 0;
+  for (; i + 8 <= num_curves; i += 8) {
+    // Row k holds curve k in its low half and curve k + 4 in its high half.
+    // The unpacks work on each half separately, so they transpose both
+    // groups of four at once.
+    const float* p = reinterpret_cast<const float*>(curves + i);
+    const __m256 r0 = LoadRowPair(p);
+    const __m256 r1 = LoadRowPair(p + 4);
+    const __m256 r2 = LoadRowPair(p + 8);
+    const __m256 r3 = LoadRowPair(p + 12);
+    const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+    const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+    const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    const __m256 c0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 c1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    const __m256 c2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    const __m256 c3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+
+    // ((c3 * x + c2) * x + c1) * x + c0, as in CubicCurve::Evaluate().
+    const __m256 x = _mm256_loadu_ps(xs + i);
+    __m256 y = _mm256_add_ps(_mm256_mul_ps(c3, x), c2);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), c1);
+    y = _mm256_add_ps(_mm256_mul_ps(y, x), c0);
+    _mm256_storeu_ps(ys + i, y);
+  }
+
+  // Finish with the SSE version, which handles any count.
+  EvaluateCubics_Sse(curves + i, xs + i, num_curves - i, ys + i);
+}
+
+}  // namespace motive
+
+#endif  // defined(MOTIVE_X86_64)
@@ -27,8 +27,37 @@ void Motivator::InitializeWithDimension(const MotivatorInit& init,
   // one processor per type. Get that processor.
   MotiveProcessor* processor = engine->Processor(init.type());
 
-  // Register and initialize ourselves with the MotiveProcessor.
+  // Register and initialize ourselves with the MotiveProcessor. If the
+  // processor is full (see MotiveProcessor::SetMaxIndices()), we stay invalid.
   processor->InitializeMotivator(init, engine, this, dimensions);
 }
 
+bool Motivator::InitializeBatch(const MotivatorInit& init,
+                                MotiveEngine* engine,
+                                MotiveDimension dimensions,
+                                Motivator* const* motivators,
+                                MotiveIndex count) {
+  if (count <= 0) return true;
+  InvalidateBatch(motivators, count);
+
+  MotiveProcessor* processor = engine->Processor(init.type());
+  return processor->InitializeMotivators(init, engine, motivators, count,
+                                         dimensions) != kMotiveIndexInvalid;
+}
+
+void Motivator::InvalidateBatch(Motivator* const* motivators,
+                                MotiveIndex count) {
+  // Hand each run of Motivators that share a processor to that processor.
+  MotiveIndex i = 0;
+  while (i < count) {
+    MotiveProcessor* processor = motivators[i]->processor_;
+    MotiveIndex end = i + 1;
+    while (end < count && motivators[end]->processor_ == processor) ++end;
+    if (processor != nullptr) {
+      processor->RemoveMotivators(motivators + i, end - i);
+    }
+    i = end;
+  }
+}
+
 }  // namespace motive
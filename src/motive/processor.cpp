@@ -12,12 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "motive/processor.h"
 #include "motive/motivator.h"
+#include "motive/snapshot.h"
 #include "motive/util/benchmark.h"
+#include "motive/util/move_range.h"
 
 namespace motive {
 
+// Bound to references by std::fill() and resize(), so needs storage.
+const uint64_t MotiveProcessor::kNoLocalityKey;
+
 MotiveProcessor::~MotiveProcessor() {
   // Reset all of the Motivators that we're currently driving.
   // We don't want any of them to reference us after we've been destroyed.
@@ -25,8 +34,11 @@ MotiveProcessor::~MotiveProcessor() {
        index += Dimensions(index)) {
     if (motivators_[index] != nullptr) {
       RemoveMotivatorWithoutNotifying(index);
+    } else if (index_handle_slots_[index] != kMotiveIndexInvalid) {
+      RemoveHandleWithoutNotifying(index_handle_slots_[index]);
     }
   }
+  ReleaseLocalitySpare();
 
   // Sanity-check: Ensure that we have no more active Motivators.
   assert(index_allocator_.Empty());
@@ -40,11 +52,15 @@ void MotiveProcessor::VerifyInternalState() const {
   // Check the validity of each Motivator.
   MotiveIndex len = static_cast<MotiveIndex>(motivators_.size());
   for (MotiveIndex i = 0; i < len; i += Dimensions(i)) {
-    // If a Motivator is nullptr, its index should not be allocated.
-    assert((motivators_[i] == nullptr && !index_allocator_.ValidIndex(i)) ||
+    // If a Motivator is nullptr, its index should not be allocated, unless
+    // it's referenced by a handle, or is the locality sort's spare block.
+    assert((motivators_[i] == nullptr &&
+            (!index_allocator_.ValidIndex(i) || IsMotivatorIndex(i) ||
+             i == locality_spare_)) ||
            motivators_[i]->Valid());
 
     if (motivators_[i] == nullptr) continue;
+    assert(index_handle_slots_[i] == kMotiveIndexInvalid);
 
     // All back pointers for a motivator should be the same.
     const MotiveDimension dimensions = Dimensions(i);
@@ -60,7 +76,7 @@ void MotiveProcessor::VerifyInternalState() const {
 #endif  // MOTIVE_VERIFY_INTERNAL_STATE
 }
 
-void MotiveProcessor::InitializeMotivator(const MotivatorInit& init,
+bool MotiveProcessor::InitializeMotivator(const MotivatorInit& init,
                                           MotiveEngine* engine,
                                           Motivator* motivator,
                                           MotiveDimension dimensions) {
@@ -69,9 +85,101 @@ void MotiveProcessor::InitializeMotivator(const MotivatorInit& init,
   // Assign an 'index' to reference the new Motivator. All interactions between
   // the Motivator and MotiveProcessor use this 'index' to identify the data.
   const MotiveIndex index = AllocateMotivatorIndices(motivator, dimensions);
+  if (index == kMotiveIndexInvalid) return false;
+
+  // Call the MotiveProcessor-specific initialization routine.
+  InitializeIndices(init, index, dimensions, engine);
+  SetChildLocalityKeys(index, dimensions);
+  return true;
+}
+
+MotiveIndex MotiveProcessor::InitializeMotivators(const MotivatorInit& init,
+                                                  MotiveEngine* engine,
+                                                  Motivator* const* motivators,
+                                                  MotiveIndex count,
+                                                  MotiveDimension dimensions) {
+  assert(count > 0);
+  const motive::Benchmark b(benchmark_id_for_init());
+
+  // One block of `dimensions` indices per Motivator, all adjacent, so that
+  // the arrays grow at most once.
+  const MotiveIndex first =
+      index_allocator_.AllocBlocks(dimensions, count, max_indices_);
+  if (first == MotiveIndexAllocator::kInvalidIndex) return kMotiveIndexInvalid;
+
+  const MotiveIndex end = first + count * dimensions;
+  std::fill(update_rates_.begin() + first, update_rates_.begin() + end,
+            UpdateRate());
+  std::fill(locality_keys_.begin() + first, locality_keys_.begin() + end,
+            kNoLocalityKey);
+  for (MotiveIndex i = first; i < end; ++i) {
+    live_indices_.Set(i);
+  }
+  for (MotiveIndex i = 0; i < count; ++i) {
+    Motivator* motivator = motivators[i];
+    assert(!motivator->Valid());
+    const MotiveIndex index = first + i * dimensions;
+    std::fill(motivators_.begin() + index,
+              motivators_.begin() + index + dimensions, motivator);
+    motivator->Init(this, index);
+
+    // Call the MotiveProcessor-specific initialization routine.
+    InitializeIndices(init, index, dimensions, engine);
+    SetChildLocalityKeys(index, dimensions);
+  }
+  VerifyInternalState();
+  return first;
+}
+
+MotiveHandle MotiveProcessor::InitializeHandle(const MotivatorInit& init,
+                                               MotiveEngine* engine,
+                                               MotiveDimension dimensions) {
+  const motive::Benchmark b(benchmark_id_for_init());
+
+  // Check for a free slot before allocating, so that failure leaves the
+  // processor unchanged.
+  if (free_handle_slots_.empty() &&
+      handle_slots_.size() >= MotiveHandle::kMaxSlots) {
+    return MotiveHandle();
+  }
+  const MotiveIndex index = index_allocator_.Alloc(dimensions, max_indices_);
+  if (index == MotiveIndexAllocator::kInvalidIndex) return MotiveHandle();
+
+  uint32_t slot;
+  if (free_handle_slots_.empty()) {
+    slot = static_cast<uint32_t>(handle_slots_.size());
+    handle_slots_.push_back(HandleSlot());
+  } else {
+    slot = free_handle_slots_.back();
+    free_handle_slots_.pop_back();
+  }
+  HandleSlot& handle_slot = handle_slots_[slot];
+  handle_slot.index = index;
+
+  // Unlike Motivators, handles are found through the table, so no pointer to
+  // the owner is kept.
+  for (MotiveDimension i = 0; i < dimensions; ++i) {
+    index_handle_slots_[index + i] = static_cast<MotiveIndex>(slot);
+    live_indices_.Set(index + i);
+    update_rates_[index + i] = UpdateRate();
+    locality_keys_[index + i] = kNoLocalityKey;
+  }
 
   // Call the MotiveProcessor-specific initialization routine.
   InitializeIndices(init, index, dimensions, engine);
+  SetChildLocalityKeys(index, dimensions);
+  VerifyInternalState();
+  return MotiveHandle(slot, handle_slots_[slot].generation);
+}
+
+void MotiveProcessor::RemoveHandle(MotiveHandle handle) {
+  const MotiveIndex index = HandleIndex(handle);
+
+  // Call the MotiveProcessor-specific remove routine.
+  RemoveIndices(index, Dimensions(index));
+  RemoveHandleWithoutNotifying(handle.slot());
+
+  VerifyInternalState();
 }
 
 void MotiveProcessor::CloneMotivator(Motivator* dst, MotiveIndex src) {
@@ -87,9 +195,11 @@ void MotiveProcessor::CloneMotivator(Motivator* dst, MotiveIndex src) {
   // the Motivator and MotiveProcessor use this 'index' to identify the data.
   const MotiveDimension dimensions = Dimensions(src);
   const MotiveIndex dst_index = AllocateMotivatorIndices(dst, dimensions);
+  if (dst_index == kMotiveIndexInvalid) return;
 
   // Call the MotiveProcessor-specific cloning routine.
   CloneIndices(dst_index, src, dimensions, Engine());
+  SetChildLocalityKeys(dst_index, dimensions);
 }
 
 // Don't notify derived classes. Useful in the destructor, since derived classes
@@ -97,9 +207,11 @@ void MotiveProcessor::CloneMotivator(Motivator* dst, MotiveIndex src) {
 void MotiveProcessor::RemoveMotivatorWithoutNotifying(MotiveIndex index) {
   // Ensure the Motivator no longer references us.
   motivators_[index]->Reset();
+  ClearOutputBinding(index);
 
   // Ensure we no longer reference the Motivator.
   const MotiveDimension dimensions = Dimensions(index);
+  ResetChangedIndices(index, dimensions);
   for (MotiveDimension i = 0; i < dimensions; ++i) {
     motivators_[index + i] = nullptr;
   }
@@ -109,6 +221,24 @@ void MotiveProcessor::RemoveMotivatorWithoutNotifying(MotiveIndex index) {
   index_allocator_.Free(index);
 }
 
+void MotiveProcessor::RemoveHandleWithoutNotifying(uint32_t slot) {
+  HandleSlot& handle_slot = handle_slots_[slot];
+  const MotiveIndex index = handle_slot.index;
+  ClearOutputBinding(index);
+  const MotiveDimension dimensions = Dimensions(index);
+  ResetChangedIndices(index, dimensions);
+  for (MotiveDimension i = 0; i < dimensions; ++i) {
+    index_handle_slots_[index + i] = kMotiveIndexInvalid;
+  }
+  index_allocator_.Free(index);
+
+  // Outstanding copies of the handle are now stale.
+  handle_slot.index = kMotiveIndexInvalid;
+  handle_slot.generation =
+      MotiveHandle::NextGeneration(handle_slot.generation);
+  free_handle_slots_.push_back(slot);
+}
+
 void MotiveProcessor::RemoveMotivator(MotiveIndex index) {
   assert(ValidMotivatorIndex(index));
 
@@ -122,6 +252,34 @@ void MotiveProcessor::RemoveMotivator(MotiveIndex index) {
   VerifyInternalState();
 }
 
+void MotiveProcessor::RemoveMotivators(Motivator* const* motivators,
+                                       MotiveIndex count) {
+  // Notify the derived class once per run of adjacent indices, instead of
+  // once per Motivator.
+  MotiveIndex run_start = kMotiveIndexInvalid;
+  MotiveIndex run_end = kMotiveIndexInvalid;
+  for (MotiveIndex i = 0; i < count; ++i) {
+    const MotiveIndex index = motivators[i]->index_;
+    assert(motivators[i]->processor_ == this && ValidMotivatorIndex(index));
+    if (index != run_end) {
+      if (run_start != kMotiveIndexInvalid) {
+        RemoveIndices(run_start, run_end - run_start);
+      }
+      run_start = index;
+    }
+    run_end = index + Dimensions(index);
+  }
+  if (run_start != kMotiveIndexInvalid) {
+    RemoveIndices(run_start, run_end - run_start);
+  }
+
+  for (MotiveIndex i = 0; i < count; ++i) {
+    RemoveMotivatorWithoutNotifying(motivators[i]->index_);
+  }
+
+  VerifyInternalState();
+}
+
 void MotiveProcessor::TransferMotivator(MotiveIndex index,
                                         Motivator* new_motivator) {
   assert(ValidMotivatorIndex(index));
@@ -149,15 +307,80 @@ void MotiveProcessor::SetEngine(MotiveEngine* engine) {
   }
 }
 
+void MotiveProcessor::Snapshot(ProcessorSnapshot* snapshot) const {
+  const MotiveIndex num_indices = index_allocator_.num_indices();
+  snapshot->motivators.assign(motivators_.begin(),
+                              motivators_.begin() + num_indices);
+  WriteSnapshot(snapshot);
+}
+
+void MotiveProcessor::SaveState(MotiveState* state) {
+  // Save the indices as they are, holes and all. Holes have no Motivator or
+  // handle, so RestoreState() checks that they're still holes.
+  const MotiveIndex num_indices = index_allocator_.num_indices();
+  state->Write(num_indices);
+  state->Write(motivators_.data(), num_indices);
+  state->Write(index_handle_slots_.data(), num_indices);
+  state->Write(update_rates_.data(), num_indices);
+  state->Write(has_update_intervals_);
+  SaveIndices(state, num_indices);
+}
+
+bool MotiveProcessor::RestoreState(MotiveStateReader* reader) {
+  const MotiveIndex num_indices = reader->Read<MotiveIndex>();
+  if (!reader->Check(num_indices == index_allocator_.num_indices())) {
+    return false;
+  }
+
+  // Rewinding is only possible if every index still belongs to the same
+  // Motivator.
+  for (MotiveIndex i = 0; i < num_indices; ++i) {
+    const Motivator* motivator = reader->Read<Motivator*>();
+    if (!reader->Check(motivator == motivators_[i])) return false;
+  }
+  for (MotiveIndex i = 0; i < num_indices; ++i) {
+    const MotiveIndex slot = reader->Read<MotiveIndex>();
+    if (!reader->Check(slot == index_handle_slots_[i])) return false;
+  }
+  reader->Read(update_rates_.data(), num_indices);
+  reader->Read(&has_update_intervals_, 1);
+  RestoreIndices(reader, num_indices);
+  return reader->ok();
+}
+
+void MotiveProcessor::SetUpdateInterval(MotiveIndex index, int interval,
+                                        int phase) {
+  assert(ValidMotivatorIndex(index));
+  assert(0 < interval && interval <= std::numeric_limits<uint16_t>::max());
+  assert(0 <= phase && phase < interval);
+  if (interval > 1) {
+    has_update_intervals_ = true;
+  }
+
+  // Every dimension of a Motivator must be updated on the same frames.
+  const MotiveDimension dimensions = Dimensions(index);
+  for (MotiveDimension i = 0; i < dimensions; ++i) {
+    UpdateRate& rate = update_rates_[index + i];
+    rate.interval = static_cast<uint16_t>(interval);
+    rate.countdown = static_cast<uint16_t>(phase);
+  }
+}
+
 bool MotiveProcessor::IsMotivatorIndex(MotiveIndex index) const {
-  return motivators_[index] != nullptr &&
-         (index == 0 || motivators_[index - 1] != motivators_[index]);
+  // Handle table entries point at the first index of their block.
+  if (motivators_[index] == nullptr) {
+    const MotiveIndex slot = index_handle_slots_[index];
+    return slot != kMotiveIndexInvalid && handle_slots_[slot].index == index;
+  }
+  return index == 0 || motivators_[index - 1] != motivators_[index];
 }
 
 bool MotiveProcessor::ValidIndex(MotiveIndex index) const {
-  return index < index_allocator_.num_indices() &&
-         motivators_[index] != nullptr &&
-         motivators_[index]->Processor() == this;
+  if (index >= index_allocator_.num_indices()) return false;
+  if (motivators_[index] == nullptr) {
+    return index_handle_slots_[index] != kMotiveIndexInvalid;
+  }
+  return motivators_[index]->Processor() == this;
 }
 
 bool MotiveProcessor::ValidMotivatorIndex(MotiveIndex index) const {
@@ -168,13 +391,17 @@ MotiveIndex MotiveProcessor::AllocateMotivatorIndices(
     Motivator* motivator, MotiveDimension dimensions) {
   // Assign an 'index' to reference the new Motivator. All interactions between
   // the Motivator and MotiveProcessor use this 'index' to identify the data.
-  const MotiveIndex index = index_allocator_.Alloc(dimensions);
+  const MotiveIndex index = index_allocator_.Alloc(dimensions, max_indices_);
+  if (index == MotiveIndexAllocator::kInvalidIndex) return kMotiveIndexInvalid;
 
   // Keep a pointer to the Motivator around. We may Defragment() the indices and
   // move the data around. We also need to remove the Motivator when we're
   // destroyed.
   for (MotiveDimension i = 0; i < dimensions; ++i) {
     motivators_[index + i] = motivator;
+    live_indices_.Set(index + i);
+    update_rates_[index + i] = UpdateRate();
+    locality_keys_[index + i] = kNoLocalityKey;
   }
 
   // Initialize the motivator to point at our MotiveProcessor.
@@ -183,15 +410,173 @@ MotiveIndex MotiveProcessor::AllocateMotivatorIndices(
   return index;
 }
 
+void MotiveProcessor::Reserve(MotiveIndex num_indices) {
+  assert(num_indices >= 0);
+  index_allocator_.Reserve(num_indices);
+  motivators_.reserve(num_indices);
+  index_handle_slots_.reserve(num_indices);
+  output_bindings_.reserve(num_indices);
+  pending_events_.Reserve(num_indices);
+  changed_indices_.Reserve(num_indices);
+  live_indices_.Reserve(num_indices);
+  if (track_changes_) {
+    reported_outputs_.reserve(num_indices * NumOutputFloats());
+  }
+  update_rates_.reserve(num_indices);
+  locality_keys_.reserve(num_indices);
+
+  // Call derived class.
+  ReserveIndices(num_indices);
+}
+
+void MotiveProcessor::SetMaxIndices(MotiveIndex max_indices) {
+  assert(max_indices >= 0);
+  max_indices_ = max_indices;
+}
+
+void MotiveProcessor::SetOutputBinding(MotiveIndex index, void* destination,
+                                       size_t stride) {
+  assert(ValidMotivatorIndex(index));
+  ClearOutputBinding(index);
+  if (destination == nullptr) return;
+
+  OutputBinding& binding = output_bindings_[index];
+  binding.destination = static_cast<uint8_t*>(destination);
+  binding.stride = stride;
+  num_output_bindings_++;
+}
+
+void MotiveProcessor::ClearOutputBinding(MotiveIndex index) {
+  OutputBinding& binding = output_bindings_[index];
+  if (binding.destination == nullptr) return;
+  binding = OutputBinding();
+  num_output_bindings_--;
+}
+
+void MotiveProcessor::WriteOutputBindings() const {
+  if (num_output_bindings_ == 0) return;
+
+  const MotiveIndex num_indices = index_allocator_.num_indices();
+  for (MotiveIndex i = 0; i < num_indices; i += Dimensions(i)) {
+    const OutputBinding& binding = output_bindings_[i];
+    if (binding.destination != nullptr) {
+      WriteOutputBinding(i, binding.destination, binding.stride);
+    }
+  }
+}
+
+void MotiveProcessor::CollectEvents(MotiveEventQueue* queue) {
+  if (!events_enabled_) return;
+
+  const MotiveIndex num_indices = NumIndices();
+  for (MotiveIndex i = pending_events_.NextSet(0, num_indices);
+       i < num_indices; i = pending_events_.NextSet(i + 1, num_indices)) {
+    Motivator* motivator = motivators_[i];
+    const MotiveIndex slot = index_handle_slots_[i];
+    if (motivator == nullptr && slot == kMotiveIndexInvalid) {
+      pending_events_.Clear(i);
+      continue;
+    }
+
+    // Report each Motivator once, however many of its dimensions were
+    // marked.
+    const MotiveIndex index =
+        motivator != nullptr ? motivator->index_ : handle_slots_[slot].index;
+    const MotiveDimension dimensions = Dimensions(index);
+    for (MotiveDimension d = 0; d < dimensions; ++d) {
+      pending_events_.Clear(index + d);
+    }
+
+    MotiveEvent event;
+    event.type = EventForIndex(index, dimensions);
+    if (event.type == kMotiveEventNone) continue;
+    event.motivator_type = Type();
+    event.motivator = motivator;
+    if (motivator == nullptr) {
+      event.handle = MotiveHandle(slot, handle_slots_[slot].generation);
+    }
+    queue->Push(event);
+  }
+}
+
+void MotiveProcessor::SetChangeTracking(bool track_changes, float epsilon) {
+  track_changes_ = track_changes;
+  change_epsilon_ = epsilon;
+
+  // Start over. With the default FindChangedIndices(), every Motivator is
+  // reported in the next frame.
+  const MotiveIndex num_indices = NumIndices();
+  changed_indices_.Resize(0, false);
+  changed_indices_.Resize(num_indices, false);
+  std::vector<float>().swap(reported_outputs_);
+  if (track_changes) {
+    reported_outputs_.resize(num_indices * NumOutputFloats(),
+                             std::numeric_limits<float>::quiet_NaN());
+  }
+}
+
+void MotiveProcessor::UpdateChangedIndices() {
+  if (track_changes_) {
+    FindChangedIndices(change_epsilon_, &changed_indices_);
+  }
+}
+
+void MotiveProcessor::FindChangedIndices(float epsilon, IndexBitSet* changed) {
+  // Only indices in use can change. Their bits in `changed` were cleared when
+  // they were freed, so holes are skipped a word at a time.
+  const int num_floats = NumOutputFloats();
+  const MotiveIndex num_indices = NumIndices();
+  for (MotiveIndex i = live_indices_.NextSet(0, num_indices); i < num_indices;
+       i = live_indices_.NextSet(i + 1, num_indices)) {
+    const float* output = OutputFloats(i);
+    float* reported = reported_outputs_.data() + i * num_floats;
+    bool moved = num_floats == 0;
+    for (int j = 0; j < num_floats; ++j) {
+      // Written so that NaN, for indices not yet reported, counts as moved.
+      if (!(std::fabs(output[j] - reported[j]) <= epsilon)) {
+        moved = true;
+        break;
+      }
+    }
+    if (moved) {
+      std::copy(output, output + num_floats, reported);
+    }
+    changed->Assign(i, moved);
+  }
+}
+
+void MotiveProcessor::ResetChangedIndices(MotiveIndex index,
+                                          MotiveDimension dimensions) {
+  for (MotiveIndex i = index; i < index + dimensions; ++i) {
+    changed_indices_.Clear(i);
+    live_indices_.Clear(i);
+    pending_events_.Clear(i);
+  }
+  if (track_changes_) {
+    const int num_floats = NumOutputFloats();
+    std::fill(reported_outputs_.begin() + index * num_floats,
+              reported_outputs_.begin() + (index + dimensions) * num_floats,
+              std::numeric_limits<float>::quiet_NaN());
+  }
+}
+
 void MotiveProcessor::SetNumIndicesBase(MotiveIndex num_indices) {
   // When the size decreases, we don't bother reallocating the size of the
   // 'motivators_' vector. We want to avoid reallocating as much as possible,
-  // so we let it grow to its high-water mark.
-  //
-  // TODO: Ideally, we should reserve approximately the right amount of storage
-  // for motivators_. That would require adding a user-defined initialization
-  // parameter.
+  // so we let it grow to its high-water mark. Call Reserve() to skip the
+  // reallocations on the way up.
   motivators_.resize(num_indices);
+  index_handle_slots_.resize(num_indices, kMotiveIndexInvalid);
+  output_bindings_.resize(num_indices);
+  pending_events_.Resize(num_indices, false);
+  changed_indices_.Resize(num_indices, false);
+  live_indices_.Resize(num_indices, false);
+  if (track_changes_) {
+    reported_outputs_.resize(num_indices * NumOutputFloats(),
+                             std::numeric_limits<float>::quiet_NaN());
+  }
+  update_rates_.resize(num_indices);
+  locality_keys_.resize(num_indices, kNoLocalityKey);
 
   // Call derived class.
   SetNumIndices(num_indices);
@@ -199,26 +584,217 @@ void MotiveProcessor::SetNumIndicesBase(MotiveIndex num_indices) {
 
 void MotiveProcessor::MoveIndexRangeBase(const IndexRange& source,
                                          MotiveIndex target) {
-  // Reinitialize the motivators to point to the new index.
+  // Reinitialize the motivators to point to the new index. The spare block
+  // has no owner, so just remember where it went.
   const MotiveIndex index_diff = target - source.start();
+  const bool moves_spare =
+      source.start() <= locality_spare_ && locality_spare_ < source.end();
+  for (MotiveIndex i = source.start(); i < source.end(); i += Dimensions(i)) {
+    if (i != locality_spare_) SetOwnerIndex(i, i + index_diff);
+  }
+
+  MoveIndexData(source.start(), target, source.Length());
+  if (moves_spare) locality_spare_ += index_diff;
+
+  // Children are keyed by their parent's index, which just changed.
   for (MotiveIndex i = source.start(); i < source.end(); i += Dimensions(i)) {
-    motivators_[i]->Init(this, i + index_diff);
+    if (i + index_diff == locality_spare_) continue;
+    SetChildLocalityKeys(i + index_diff, Dimensions(i));
   }
+  locality_dirty_ = true;
+}
+
+void MotiveProcessor::SetOwnerIndex(MotiveIndex index, MotiveIndex new_index) {
+  // Handles don't point at anything, so only the handle table needs updating.
+  if (motivators_[index] != nullptr) {
+    motivators_[index]->Init(this, new_index);
+  } else {
+    handle_slots_[index_handle_slots_[index]].index = new_index;
+  }
+}
 
+void MotiveProcessor::MoveIndexData(MotiveIndex source, MotiveIndex target,
+                                    MotiveIndex count) {
   // Tell derivated class about the move.
-  MoveIndices(source.start(), target, source.Length());
+  MoveIndices(source, target, count);
+
+#if !defined(NDEBUG)
+  // Assert we're moving something valid onto something invalid. The target
+  // range may overlap the source range.
+  for (MotiveIndex i = source; i < source + count; ++i) {
+    assert(motivators_[i] != nullptr ||
+           index_handle_slots_[i] != kMotiveIndexInvalid ||
+           InLocalitySpare(i));
+  }
+  for (MotiveIndex i = target; i < target + count; ++i) {
+    assert((source <= i && i < source + count) ||
+           (motivators_[i] == nullptr &&
+            index_handle_slots_[i] == kMotiveIndexInvalid));
+  }
+#endif  // !defined(NDEBUG)
+
+  // Move our internal data too, one block per array.
+  MoveRangeBytes(&motivators_, source, target, count);
+  MoveRangeBytes(&index_handle_slots_, source, target, count);
+  MoveRangeBytes(&output_bindings_, source, target, count);
+  MoveRangeBytes(&update_rates_, source, target, count);
+  MoveRangeBytes(&locality_keys_, source, target, count);
+  changed_indices_.Move(source, target, count);
+  live_indices_.Move(source, target, count);
+  pending_events_.Move(source, target, count);
+
+  // The reported outputs move with the data.
+  if (track_changes_) {
+    const int num_floats = NumOutputFloats();
+    MoveRangeBytes(&reported_outputs_, source * num_floats,
+                   target * num_floats, count * num_floats);
+  }
 
-  // Reinitialize the motivator pointers.
-  for (MotiveIndex i = source.start(); i < source.end(); ++i) {
-    // Assert we're moving something valid onto something invalid.
-    assert(motivators_[i] != nullptr && motivators_[i + index_diff] == nullptr);
+  // The part of the source range that wasn't overwritten is free now.
+  MotiveIndex vacated_end;
+  const MotiveIndex vacated_start =
+      VacatedRange(source, target, count, &vacated_end);
+  std::fill(motivators_.begin() + vacated_start,
+            motivators_.begin() + vacated_end, nullptr);
+  std::fill(index_handle_slots_.begin() + vacated_start,
+            index_handle_slots_.begin() + vacated_end, kMotiveIndexInvalid);
+  std::fill(output_bindings_.begin() + vacated_start,
+            output_bindings_.begin() + vacated_end, OutputBinding());
+  ResetChangedIndices(vacated_start, vacated_end - vacated_start);
+}
 
-    // Move our internal data too.
-    motivators_[i + index_diff] = motivators_[i];
-    motivators_[i] = nullptr;
+void MotiveProcessor::SwapIndexBlocks(MotiveIndex a, MotiveIndex b,
+                                      MotiveDimension dimensions) {
+  // Park `a` in the spare block, so that every move lands on free indices.
+  assert(dimensions <= locality_spare_dimensions_);
+  const MotiveIndex parked = locality_spare_;
+  SetOwnerIndex(a, parked);
+  MoveIndexData(a, parked, dimensions);
+  SetOwnerIndex(b, a);
+  MoveIndexData(b, a, dimensions);
+  SetOwnerIndex(parked, b);
+  MoveIndexData(parked, b, dimensions);
+
+  SetChildLocalityKeys(a, dimensions);
+  SetChildLocalityKeys(b, dimensions);
+}
+
+void MotiveProcessor::SetLocalitySortBudget(MotiveIndex max_swaps) {
+  assert(max_swaps >= 0);
+  locality_sort_budget_ = max_swaps;
+  if (max_swaps > 0) {
+    locality_dirty_ = true;
+  } else {
+    ReleaseLocalitySpare();
   }
 }
 
+bool MotiveProcessor::ReserveLocalitySpare(MotiveDimension dimensions) {
+  if (dimensions <= locality_spare_dimensions_) return true;
+
+  // Free the old spare first, so that it doesn't count towards the cap.
+  ReleaseLocalitySpare();
+  const MotiveIndex spare = index_allocator_.Alloc(dimensions, max_indices_);
+  if (spare == MotiveIndexAllocator::kInvalidIndex) return false;
+
+  // The block may be fresh off the end of the arrays, so put it in the same
+  // state as a freed block. That's the state every swap leaves it in, too.
+  RemoveIndices(spare, dimensions);
+  locality_spare_ = spare;
+  locality_spare_dimensions_ = dimensions;
+  return true;
+}
+
+void MotiveProcessor::ReleaseLocalitySpare() {
+  if (locality_spare_ == kMotiveIndexInvalid) return;
+  index_allocator_.Free(locality_spare_);
+  locality_spare_ = kMotiveIndexInvalid;
+  locality_spare_dimensions_ = 0;
+}
+
+bool MotiveProcessor::SortByLocality(MotiveIndex max_swaps) {
+  // Gather the keyed blocks, skipping the holes. Blocks can only trade places
+  // with blocks of the same size, so each size is sorted on its own. Most
+  // frames, the keys are already in order, so check that first.
+  locality_blocks_.clear();
+  bool sorted = true;
+  const MotiveIndex num_indices = NumIndices();
+  for (MotiveIndex i = 0; i < num_indices; i += Dimensions(i)) {
+    const uint64_t key = locality_keys_[i];
+    if (key == kNoLocalityKey) continue;
+    if (motivators_[i] == nullptr &&
+        index_handle_slots_[i] == kMotiveIndexInvalid) continue;
+
+    const LocalityBlock block = {Dimensions(i), key, i};
+    for (auto it = locality_blocks_.rbegin(); it != locality_blocks_.rend();
+         ++it) {
+      if (it->dimensions != block.dimensions) continue;
+      if (block.key < it->key) sorted = false;
+      break;
+    }
+    locality_blocks_.push_back(block);
+  }
+  if (sorted) {
+    locality_dirty_ = false;
+    return true;
+  }
+
+  std::sort(locality_blocks_.begin(), locality_blocks_.end());
+  locality_block_at_.resize(num_indices);
+
+  // The swaps park a block in the spare, which must fit the biggest block.
+  MotiveDimension max_dimensions = 0;
+  for (size_t i = 0; i < locality_blocks_.size(); ++i) {
+    max_dimensions = std::max(max_dimensions, locality_blocks_[i].dimensions);
+  }
+  if (!ReserveLocalitySpare(max_dimensions)) return false;
+
+  MotiveIndex num_swaps = 0;
+  bool finished = true;
+  for (size_t first = 0; first < locality_blocks_.size();) {
+    // Blocks [first, last) have the same size, and are sorted by key. The
+    // k'th block belongs at the k'th lowest index held by any of them.
+    size_t last = first + 1;
+    while (last < locality_blocks_.size() &&
+           locality_blocks_[last].dimensions ==
+               locality_blocks_[first].dimensions) {
+      ++last;
+    }
+    locality_positions_.clear();
+    for (size_t k = first; k < last; ++k) {
+      locality_positions_.push_back(locality_blocks_[k].index);
+      locality_block_at_[locality_blocks_[k].index] =
+          static_cast<MotiveIndex>(k);
+    }
+    std::sort(locality_positions_.begin(), locality_positions_.end());
+
+    for (size_t k = first; k < last; ++k) {
+      LocalityBlock& block = locality_blocks_[k];
+      const MotiveIndex position = locality_positions_[k - first];
+      if (block.index == position) continue;
+      if (num_swaps == max_swaps) {
+        finished = false;
+        break;
+      }
+
+      // Trade places with the block that's in the way.
+      LocalityBlock& other = locality_blocks_[locality_block_at_[position]];
+      SwapIndexBlocks(block.index, position, block.dimensions);
+      other.index = block.index;
+      locality_block_at_[other.index] = locality_block_at_[position];
+      block.index = position;
+      locality_block_at_[position] = static_cast<MotiveIndex>(k);
+      num_swaps++;
+    }
+    first = last;
+  }
+
+  // The swaps re-key the children, which marks the order dirty again.
+  locality_dirty_ = !finished;
+  VerifyInternalState();
+  return finished;
+}
+
 void MotiveProcessor::RegisterBenchmarks() {
   const std::string class_name(*Type());
   benchmark_id_for_advance_frame_ =
@@ -46,7 +46,7 @@ static inline MotiveTime SimpleTargetTime(const ConstData& /*d*/) {
   return static_cast<MotiveTime>(0);
 }
 
-class ConstMotiveProcessor : public SimpleProcessorTemplate<ConstData> {
+class ConstMotiveProcessor final : public SimpleProcessorTemplate<ConstData> {
  public:
   virtual ~ConstMotiveProcessor() {}
 
@@ -56,6 +56,9 @@ class ConstMotiveProcessor : public SimpleProcessorTemplate<ConstData> {
 
   virtual MotivatorType Type() const { return ConstInit::kType; }
   virtual int Priority() const { return 1; }
+  virtual bool ReadsFrom(const MotiveProcessor& /*other*/) const {
+    return false;
+  }
 
   virtual MotiveCurveShape MotiveShape(MotiveIndex /*index*/) const {
     //TODO(jsanmiya): Find a way to store this shape.
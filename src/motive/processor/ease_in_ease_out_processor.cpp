@@ -57,57 +57,35 @@ static inline MotiveTime SimpleTargetTime(const EaseInEaseOutData& d) {
   return static_cast<MotiveTime>(d.target_time - d.elapsed_time);
 }
 
-class EaseInEaseOutMotiveProcessor
+class EaseInEaseOutMotiveProcessor final
     : public SimpleProcessorTemplate<EaseInEaseOutData> {
  public:
   virtual ~EaseInEaseOutMotiveProcessor() {}
 
   virtual void AdvanceFrame(MotiveTime delta_time) {
     Defragment();
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+  }
 
-    // Loop through every motivator one at a time.
-    for (size_t i = 0; i < data_.size(); ++i) {
-      EaseInEaseOutData& d = data_[i];
-
-      // Advance the time and then update the current value.
-      d.elapsed_time += static_cast<float>(delta_time);
-
-      float q_time = d.elapsed_time - d.q_start_time;
-
-      // If we go past the end value, with a non-zero derivative and there's
-      // no instruction to go to another target, make it so that our curve is
-      // adjusted to hit target value with a zero derivative.
-      if (q_time >= d.q.total_x()) {
-        float target_value = d.q.Evaluate(d.q.total_x());
-        float target_velocity = d.q.Derivative(d.q.total_x());
-        d.q_start_time += d.q.total_x();
-        q_time = d.elapsed_time - d.q_start_time;
-        const bool ends_with_nonzero_derivative =
-            std::fabs(target_velocity) > kDerivativeEpsilon;
-        if (ends_with_nonzero_derivative) {
-          // Create curve to hit target value with zero derivative.
-          float start_second_derivative_abs = 0.0f;
-          float end_second_derivative_abs = 0.0f;
-          CalculateSecondDerivativesFromTypicalCurve(
-              d.shape.typical_delta_value, d.shape.typical_total_time,
-              d.shape.bias, &start_second_derivative_abs,
-              &end_second_derivative_abs);
-          d.q = CalculateQuadraticEaseInEaseOut(
-              target_value, target_velocity, start_second_derivative_abs,
-              target_value, 0.0f, end_second_derivative_abs,
-              d.shape.typical_delta_value, d.shape.typical_total_time);
-        } else {
-          // Curve is a flat line at target_value.
-          d.q = QuadraticEaseInEaseOut(QuadraticCurve(0.0f, 0.0f, target_value),
-                                       std::numeric_limits<float>::infinity());
-        }
-      }
-      values_[i] = d.q.Evaluate(q_time);
+  virtual bool SupportsAdvanceFrameRange() const { return true; }
+
+  virtual void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                                 MotiveIndex end) {
+    // Loop through every moving motivator one at a time.
+    for (MotiveIndex i = active_.NextSet(begin, end); i < end;
+         i = active_.NextSet(i + 1, end)) {
+      MotiveTime index_delta_time = delta_time;
+      if (!UpdateDue(i, &index_delta_time)) continue;
+      AdvanceIndex(i, index_delta_time);
+      if (!active_.Test(i)) MarkEvent(i);
     }
   }
 
   virtual MotivatorType Type() const { return EaseInEaseOutInit::kType; }
   virtual int Priority() const { return 1; }
+  virtual bool ReadsFrom(const MotiveProcessor& /*other*/) const {
+    return false;
+  }
 
   virtual void SetTargetWithShape(MotiveIndex index, MotiveDimension dimensions,
                                   const float* target_values,
@@ -132,6 +110,7 @@ class EaseInEaseOutMotiveProcessor
       d.q_start_time = 0.0f;
       d.elapsed_time = 0.0f;
       d.shape = shape;
+      active_.Set(processor_index);
     }
   }
 
@@ -139,6 +118,61 @@ class EaseInEaseOutMotiveProcessor
     const EaseInEaseOutData& d = Data(index);
     return d.shape;
   }
+
+  // The curves are evaluated directly at the new time, so fast forwarding is
+  // the same as advancing by a large `delta_time`, reaching the target
+  // included.
+  virtual void FastForward(MotiveIndex index, MotiveTime delta_time) {
+    for (MotiveIndex i = index; i < index + Dimensions(index); ++i) {
+      if (!active_.Test(i)) continue;
+      AdvanceIndex(i, delta_time);
+      if (!active_.Test(i)) MarkEvent(i);
+    }
+  }
+
+ private:
+  void AdvanceIndex(MotiveIndex i, MotiveTime delta_time) {
+    EaseInEaseOutData& d = data_[i];
+
+    // Advance the time and then update the current value.
+    d.elapsed_time += static_cast<float>(delta_time);
+
+    float q_time = d.elapsed_time - d.q_start_time;
+
+    // If we go past the end value, with a non-zero derivative and there's
+    // no instruction to go to another target, make it so that our curve is
+    // adjusted to hit target value with a zero derivative. A large
+    // `delta_time` can also go past the end of that curve, onto the flat
+    // line at the target.
+    while (q_time >= d.q.total_x()) {
+      float target_value = d.q.Evaluate(d.q.total_x());
+      float target_velocity = d.q.Derivative(d.q.total_x());
+      d.q_start_time += d.q.total_x();
+      q_time = d.elapsed_time - d.q_start_time;
+      const bool ends_with_nonzero_derivative =
+          std::fabs(target_velocity) > kDerivativeEpsilon;
+      if (ends_with_nonzero_derivative) {
+        // Create curve to hit target value with zero derivative.
+        float start_second_derivative_abs = 0.0f;
+        float end_second_derivative_abs = 0.0f;
+        CalculateSecondDerivativesFromTypicalCurve(
+            d.shape.typical_delta_value, d.shape.typical_total_time,
+            d.shape.bias, &start_second_derivative_abs,
+            &end_second_derivative_abs);
+        d.q = CalculateQuadraticEaseInEaseOut(
+            target_value, target_velocity, start_second_derivative_abs,
+            target_value, 0.0f, end_second_derivative_abs,
+            d.shape.typical_delta_value, d.shape.typical_total_time);
+      } else {
+        // Curve is a flat line at target_value. The value won't change
+        // again until the next call to SetTargetWithShape().
+        d.q = QuadraticEaseInEaseOut(QuadraticCurve(0.0f, 0.0f, target_value),
+                                     std::numeric_limits<float>::infinity());
+        active_.Clear(i);
+      }
+    }
+    values_[i] = d.q.Evaluate(q_time);
+  }
 };
 
 MOTIVE_INSTANCE(EaseInEaseOutInit, EaseInEaseOutMotiveProcessor);
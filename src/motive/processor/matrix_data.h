@@ -116,6 +116,48 @@ class MatrixData {
     }
   }
 
+  void SetUpdateInterval(int interval, int phase) {
+    for (int i = 0, num_ops = ops_.size(); i < num_ops; ++i) {
+      ops_[i].SetUpdateInterval(interval, phase);
+    }
+  }
+
+  // Key op `i`'s Motivator with `key(i)`, so that the ops of one matrix end
+  // up next to each other when their processor reorders its indices.
+  template <typename KeyFn>
+  void SetLocalityKeys(const KeyFn& key) {
+    for (int i = 0, num_ops = ops_.size(); i < num_ops; ++i) {
+      ops_[i].SetLocalityKey(key(i));
+    }
+  }
+
+  void FastForward(MotiveTime delta_time) {
+    for (int i = 0, num_ops = ops_.size(); i < num_ops; ++i) {
+      ops_[i].FastForward(delta_time);
+    }
+    UpdateResultMatrix();
+  }
+
+  void SaveState(MotiveState* state) const {
+    state->Write(static_cast<int>(ops_.size()));
+    for (int i = 0, num_ops = ops_.size(); i < num_ops; ++i) {
+      ops_[i].SaveState(state);
+    }
+    state->Write(result_matrix_);
+    state->Write(scale_);
+  }
+
+  // The ops must be the same as when the state was saved.
+  bool RestoreState(MotiveStateReader* reader) {
+    const int num_ops = reader->Read<int>();
+    if (!reader->Check(num_ops == static_cast<int>(ops_.size()))) return false;
+    for (int i = 0; i < num_ops; ++i) {
+      if (!ops_[i].RestoreState(reader)) return false;
+    }
+    reader->Read(&result_matrix_, 1);
+    return reader->Read(&scale_, 1);
+  }
+
   MotiveTime TimeRemaining() const {
     MotiveTime time = 0;
     for (int i = 0, num_ops = ops_.size(); i < num_ops; ++i) {
@@ -19,11 +19,12 @@
 #include "motive/math/angle.h"
 #include "motive/math/bulk_spline_evaluator.h"
 #include "motive/processor/matrix_data.h"
+#include "motive/util/move_range.h"
 
 namespace motive {
 
 // See comments on MatrixInit for details on this class.
-class MatrixMotiveProcessor : public MatrixProcessor4f {
+class MatrixMotiveProcessor final : public MatrixProcessor4f {
  public:
   MatrixMotiveProcessor() : time_(0) {}
 
@@ -33,14 +34,27 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
 
   virtual void AdvanceFrame(MotiveTime delta_time) {
     Defragment();
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+    EndAdvanceFrame(delta_time);
+  }
+
+  virtual bool SupportsAdvanceFrameRange() const { return true; }
 
+  virtual void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                                 MotiveIndex end) {
     // Process the series of matrix operations for each index.
-    const MotiveIndex num_indices = NumIndices();
-    for (MotiveIndex index = 0; index < num_indices; ++index) {
-      MatrixData& d = Data(index);
-      d.UpdateResultMatrix();
+    for (MotiveIndex index = begin; index < end; ++index) {
+      // Matrices with an update interval are held between updates.
+      MotiveTime index_delta_time = delta_time;
+      if (!UpdateDue(index, &index_delta_time)) continue;
+
+      // Unused indices have no ops, so are cheap to update. Use `data_`
+      // directly, since Data() asserts on unused indices.
+      data_[index].UpdateResultMatrix();
     }
+  }
 
+  virtual void EndAdvanceFrame(MotiveTime delta_time) {
     // Update our global time. It shouldn't matter if this wraps
     // around, since we only calculate times relative to it.
     time_ += delta_time;
@@ -100,6 +114,12 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
                           const motive::SplinePlayback& playback) {
     assert(Engine());
     Data(index).BlendToOps(ops, playback, Engine());
+
+    // New ops must update on the same frames as the old ones.
+    if (UpdateInterval(index) > 1) {
+      Data(index).SetUpdateInterval(UpdateInterval(index), UpdatePhase(index));
+    }
+    SetChildLocalityKeys(index, 1);
   }
 
   virtual void SetPlaybackRate(MotiveIndex index, float playback_rate) {
@@ -110,6 +130,15 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
     Data(index).SetRepeating(repeat);
   }
 
+  virtual void SetUpdateInterval(MotiveIndex index, int interval, int phase) {
+    MotiveProcessor::SetUpdateInterval(index, interval, phase);
+    Data(index).SetUpdateInterval(interval, phase);
+  }
+
+  virtual void FastForward(MotiveIndex index, MotiveTime delta_time) {
+    Data(index).FastForward(delta_time);
+  }
+
   virtual MotiveTime TimeRemaining(MotiveIndex index) const {
     return Data(index).TimeRemaining();
   }
@@ -142,6 +171,13 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
     }
   }
 
+  void SetChildLocalityKeys(MotiveIndex index,
+                            MotiveDimension dimensions) override {
+    for (MotiveIndex i = index; i < index + dimensions; ++i) {
+      Data(i).SetLocalityKeys([i](int op) { return ChildLocalityKey(i, op); });
+    }
+  }
+
   virtual void RemoveIndices(MotiveIndex index, MotiveDimension dimensions) {
     // Callers depend on indices staying consistent between calls to this
     // function, so just reset the MatrixData states to empty instead of erasing
@@ -153,11 +189,14 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
 
   virtual void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                            MotiveDimension dimensions) {
-    MotiveIndex old_i = old_index;
-    MotiveIndex new_i = new_index;
-    for (MotiveDimension i = 0; i < dimensions; ++i, ++new_i, ++old_i) {
-      using std::swap;
-      swap(data_[new_i], data_[old_i]);
+    // The data owns its ops, so move it instead of copying bytes. The ops
+    // stay where they are in memory. Reset what's left behind.
+    MoveRangeObjects(&data_, old_index, new_index, dimensions);
+    MotiveIndex vacated_end;
+    const MotiveIndex vacated_start =
+        VacatedRange(old_index, new_index, dimensions, &vacated_end);
+    for (MotiveIndex i = vacated_start; i < vacated_end; ++i) {
+      data_[i].Reset();
     }
   }
 
@@ -172,6 +211,26 @@ class MatrixMotiveProcessor : public MatrixProcessor4f {
     data_.resize(num_indices);
   }
 
+  virtual void ReserveIndices(MotiveIndex num_indices) {
+    data_.reserve(num_indices);
+  }
+
+  virtual void SaveIndices(MotiveState* state,
+                           MotiveIndex num_indices) const {
+    state->Write(time_);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      data_[i].SaveState(state);
+    }
+  }
+
+  virtual void RestoreIndices(MotiveStateReader* reader,
+                              MotiveIndex num_indices) {
+    reader->Read(&time_, 1);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      if (!data_[i].RestoreState(reader)) return;
+    }
+  }
+
   const MatrixData& Data(MotiveIndex index) const {
     assert(ValidIndex(index));
     return data_[index];
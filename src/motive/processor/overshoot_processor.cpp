@@ -15,35 +15,69 @@
 #include "motive/engine.h"
 #include "motive/overshoot_init.h"
 #include "motive/processor/overshoot_data.h"
+#include "motive/simple_processor_template.h"
+#include "motive/util/index_bit_set.h"
+#include "motive/util/move_range.h"
 
 namespace motive {
 
-class OvershootMotiveProcessor : public MotiveProcessorNf {
+// FastForward() simulates at most this many steps of max_delta_time(). Any
+// longer, and the motion has been damped onto the target.
+static const MotiveTime kMaxFastForwardSteps = 128;
+
+class OvershootMotiveProcessor final : public MotiveProcessorNf {
  public:
   virtual ~OvershootMotiveProcessor() {}
 
   virtual void AdvanceFrame(MotiveTime delta_time) {
     Defragment();
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+  }
+
+  virtual bool SupportsAdvanceFrameRange() const { return true; }
 
-    // Loop through every motivator one at a time.
+  virtual MotiveIndex NumActiveIndices() const { return active_.Count(); }
+
+  virtual void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                                 MotiveIndex end) {
+    // Loop through every moving motivator one at a time. Settled motivators
+    // stay on their target until SetTargets() wakes them.
     // TODO: change this to a closed-form equation.
     // TODO OPT: reorder data and then optimize with SIMD to process in groups
     // of 4 floating-point or 8 fixed-point values.
-    for (size_t i = 0; i < data_.size(); ++i) {
-      OvershootData& d = data_[i];
-      for (MotiveTime time_remaining = delta_time; time_remaining > 0;) {
-        MotiveTime dt = std::min(time_remaining, d.init.max_delta_time());
-
-        d.velocity = CalculateVelocity(dt, d, values_[i]);
-        values_[i] = CalculateValue(dt, d, values_[i]);
+    for (MotiveIndex i = active_.NextSet(begin, end); i < end;
+         i = active_.NextSet(i + 1, end)) {
+      MotiveTime index_delta_time = delta_time;
+      if (!UpdateDue(i, &index_delta_time)) continue;
+      Simulate(i, index_delta_time);
+      if (!active_.Test(i)) MarkEvent(i);
+    }
+  }
 
-        time_remaining -= dt;
+  // Simulate short jumps. Longer ones would take more than
+  // kMaxFastForwardSteps steps, by which time the motion is damped onto the
+  // target, so snap straight there. Either way, settling is reported, as in
+  // AdvanceFrameRange().
+  virtual void FastForward(MotiveIndex index, MotiveTime delta_time) {
+    for (MotiveIndex i = index; i < index + Dimensions(index); ++i) {
+      if (!active_.Test(i)) continue;
+      OvershootData& d = Data(i);
+      if (delta_time <= kMaxFastForwardSteps * d.init.max_delta_time()) {
+        Simulate(i, delta_time);
+      } else {
+        values_[i] = d.target_value;
+        d.velocity = 0.0f;
+        active_.Clear(i);
       }
+      if (!active_.Test(i)) MarkEvent(i);
     }
   }
 
   virtual MotivatorType Type() const { return OvershootInit::kType; }
   virtual int Priority() const { return 1; }
+  virtual bool ReadsFrom(const MotiveProcessor& /*other*/) const {
+    return false;
+  }
 
   // Accessors to allow the user to get and set simluation values.
   virtual const float* Values(MotiveIndex index) const {
@@ -88,34 +122,79 @@ class OvershootMotiveProcessor : public MotiveProcessorNf {
 
   virtual void SetTargets(MotiveIndex index, MotiveDimension dimensions,
                           const MotiveTarget1f* ts) {
-    const MotiveTarget1f* t = ts;
-    for (MotiveIndex i = index; i < index + dimensions; ++i, ++t) {
-      OvershootData& d = Data(i);
-      // A 'time' of 0 means that we're setting the current values.
-      const MotiveNode1f& current = t->Node(0);
-      if (current.time == 0) {
-        values_[i] = current.value;
-        d.velocity = current.velocity;
-      }
+    for (MotiveDimension i = 0; i < dimensions; ++i) {
+      SetTarget(index + i, ts[i]);
+    }
+  }
+
+ protected:
+  void SetTarget(MotiveIndex i, const MotiveTarget1f& t) {
+    OvershootData& d = Data(i);
+    // A 'time' of 0 means that we're setting the current values.
+    const MotiveNode1f& current = t.Node(0);
+    if (current.time == 0) {
+      values_[i] = current.value;
+      d.velocity = current.velocity;
+    }
+
+    // A 'time' > 0 means that we're setting the target values.
+    // We can also use the second node to set target values, if it exists.
+    const MotiveNode1f* target =
+        current.time == 0 ? (t.num_nodes() > 1 ? &t.Node(1) : nullptr)
+                          : &t.Node(0);
+    if (target != nullptr) {
+      d.target_value = target->value;
+    }
+    active_.Set(i);
+  }
 
-      // A 'time' > 0 means that we're setting the target values.
-      // We can also use the second node to set target values, if it exists.
-      const MotiveNode1f* target =
-          current.time == 0 ? (t->num_nodes() > 1 ? &t->Node(1) : nullptr)
-                            : &t->Node(0);
-      if (target != nullptr) {
-        d.target_value = target->value;
+  // Settled once every dimension has snapped onto its target.
+  virtual MotiveEventType EventForIndex(MotiveIndex index,
+                                        MotiveDimension dimensions) const {
+    const MotiveIndex end = index + dimensions;
+    return active_.NextSet(index, end) == end ? kMotiveEventSettled
+                                              : kMotiveEventNone;
+  }
+
+  virtual void SetTargetsAtIndices(const BatchEntry* entries,
+                                   MotiveIndex count,
+                                   MotiveDimension dimensions,
+                                   const MotiveTarget1f* targets) {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      const MotiveTarget1f* t = targets + entries[i].source * dimensions;
+      for (MotiveDimension j = 0; j < dimensions; ++j) {
+        SetTarget(entries[i].index + j, t[j]);
       }
     }
   }
 
- protected:
+  // Step the simulation for index `i` forward by `delta_time`, in steps of at
+  // most max_delta_time().
+  void Simulate(MotiveIndex i, MotiveTime delta_time) {
+    OvershootData& d = data_[i];
+    for (MotiveTime time_remaining = delta_time; time_remaining > 0;) {
+      MotiveTime dt = std::min(time_remaining, d.init.max_delta_time());
+
+      d.velocity = CalculateVelocity(dt, d, values_[i]);
+      values_[i] = CalculateValue(dt, d, values_[i]);
+
+      time_remaining -= dt;
+    }
+
+    // With no velocity and no difference, there's no acceleration either,
+    // so the motivator will never move again.
+    if (d.velocity == 0.0f && values_[i] == d.target_value) {
+      active_.Clear(i);
+    }
+  }
+
   virtual void InitializeIndices(const MotivatorInit& init, MotiveIndex index,
                                  MotiveDimension dimensions,
                                  MotiveEngine* /*engine*/) {
     for (MotiveIndex i = index; i < index + dimensions; ++i) {
       Data(i).Initialize(static_cast<const OvershootInit&>(init));
       values_[i] = 0.0f;
+      active_.Clear(i);
     }
   }
 
@@ -125,17 +204,46 @@ class OvershootMotiveProcessor : public MotiveProcessorNf {
 
   virtual void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                            MotiveDimension dimensions) {
-    MotiveIndex old_i = old_index;
-    MotiveIndex new_i = new_index;
-    for (MotiveDimension i = 0; i < dimensions; ++i, ++new_i, ++old_i) {
-      data_[new_i] = data_[old_i];
-      values_[new_i] = values_[old_i];
+    MoveRangeBytes(&data_, old_index, new_index, dimensions);
+    MoveRangeBytes(&values_, old_index, new_index, dimensions);
+    active_.Move(old_index, new_index, dimensions);
+
+    // The vacated indices may be handed out again without being removed, so
+    // leave them as RemoveIndices() would.
+    MotiveIndex vacated_end;
+    for (MotiveIndex i = VacatedRange(old_index, new_index, dimensions,
+                                      &vacated_end);
+         i < vacated_end; ++i) {
+      data_[i].Initialize(OvershootInit());
+      values_[i] = 0.0f;
+      active_.Clear(i);
     }
   }
 
   virtual void SetNumIndices(MotiveIndex num_indices) {
     data_.resize(num_indices);
     values_.resize(num_indices);
+    active_.Resize(num_indices, false);
+    SetValuesArray(values_.data());
+  }
+
+  virtual void ReserveIndices(MotiveIndex num_indices) {
+    data_.reserve(num_indices);
+    values_.reserve(num_indices);
+    active_.Reserve(num_indices);
+
+    // Reserving can move the values, so repoint FastValues() at them.
+    SetValuesArray(values_.data());
+  }
+
+  virtual void SaveIndices(MotiveState* state,
+                           MotiveIndex num_indices) const {
+    SaveSimpleIndices(data_, values_, active_, num_indices, state);
+  }
+
+  virtual void RestoreIndices(MotiveStateReader* reader,
+                              MotiveIndex num_indices) {
+    RestoreSimpleIndices(reader, num_indices, &data_, &values_, &active_);
   }
 
   const OvershootData& Data(MotiveIndex index) const {
@@ -191,6 +299,9 @@ class OvershootMotiveProcessor : public MotiveProcessorNf {
 
   std::vector<OvershootData> data_;
   std::vector<float> values_;
+
+  // Bit i is set if index i is still moving toward its target.
+  IndexBitSet active_;
 };
 
 MOTIVE_INSTANCE(OvershootInit, OvershootMotiveProcessor);
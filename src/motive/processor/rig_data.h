@@ -15,6 +15,7 @@
 #ifndef MOTIVE_RIG_DATA_H_
 #define MOTIVE_RIG_DATA_H_
 
+#include <cmath>
 #include <iomanip>
 #include <sstream>
 
@@ -206,6 +207,60 @@ class RigData {
     }
   }
 
+  void SetUpdateInterval(int interval, int phase) {
+    for (size_t i = 0; i < motivators_.size(); ++i) {
+      motivators_[i].SetUpdateInterval(interval, phase);
+    }
+  }
+
+  // Key bone motivator `i` with `key(i)`, so that the bones of one rig end up
+  // next to each other when their processor reorders its indices.
+  template <typename KeyFn>
+  void SetLocalityKeys(const KeyFn& key) {
+    for (size_t i = 0; i < motivators_.size(); ++i) {
+      motivators_[i].SetLocalityKey(key(static_cast<uint32_t>(i)));
+    }
+  }
+
+  void FastForward(MotiveTime delta_time) {
+    for (size_t i = 0; i < motivators_.size(); ++i) {
+      motivators_[i].FastForward(delta_time);
+    }
+
+    // The animation now ends sooner, relative to the processor's clock.
+    if (end_time_ != kMotiveTimeEndless) {
+      end_time_ -= delta_time;
+    }
+    UpdateGlobalTransforms();
+  }
+
+  // The bone motivators are saved by their own processor.
+  void SaveState(MotiveState* state) const {
+    state->Write(static_cast<int>(motivators_.size()));
+    state->Write(static_cast<int>(weights_.size()));
+    state->Write(weights_.data(), weights_.size());
+    state->Write(current_anim_);
+    state->Write(root_motion_transform_);
+    state->Write(end_time_);
+    state->Write(global_transforms_.data(), global_transforms_.size());
+  }
+
+  // The rig must be playing the same number of animations as when the state
+  // was saved.
+  bool RestoreState(MotiveStateReader* reader) {
+    const int num_motivators = reader->Read<int>();
+    const int num_weights = reader->Read<int>();
+    if (!reader->Check(num_motivators == static_cast<int>(motivators_.size()) &&
+                       num_weights == static_cast<int>(weights_.size()))) {
+      return false;
+    }
+    reader->Read(weights_.data(), num_weights);
+    reader->Read(&current_anim_, 1);
+    reader->Read(&root_motion_transform_, 1);
+    reader->Read(&end_time_, 1);
+    return reader->Read(global_transforms_.data(), global_transforms_.size());
+  }
+
   MotiveTime TimeRemaining() const {
     if (end_time_ == kMotiveTimeEndless) {
       return kMotiveTimeEndless;
@@ -249,6 +304,24 @@ class RigData {
     return root_motion_transform_;
   }
 
+  // Return true if any global transform has moved by more than `epsilon`
+  // since this last returned true, and remember the transforms for next
+  // time. Always true the first time.
+  bool UpdateReportedTransforms(float epsilon) {
+    const size_t num_floats = global_transforms_.size() *
+                              sizeof(mathfu::AffineTransform) / sizeof(float);
+    const float* transforms =
+        reinterpret_cast<const float*>(global_transforms_.data());
+    bool moved = reported_transforms_.size() != num_floats;
+    for (size_t i = 0; i < num_floats && !moved; ++i) {
+      moved = std::fabs(transforms[i] - reported_transforms_[i]) > epsilon;
+    }
+    if (moved) {
+      reported_transforms_.assign(transforms, transforms + num_floats);
+    }
+    return moved;
+  }
+
   BoneIndex NumBones() const { return defining_anim_->NumBones(); }
 
   MotiveTime end_time() const { return end_time_; }
@@ -514,6 +587,10 @@ class RigData {
               mathfu::simd_allocator<mathfu::AffineTransform>>
       global_transforms_;
 
+  // `global_transforms_` as of the last UpdateReportedTransforms() that
+  // returned true. Empty until then.
+  std::vector<float> reported_transforms_;
+
   // The list of weights per running animation, normalized to sum to 1.
   std::vector<float> weights_;
 
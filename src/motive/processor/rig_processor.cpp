@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 
@@ -23,11 +24,14 @@
 #include "motive/processor/rig_data.h"
 #include "motive/rig_anim.h"
 #include "motive/rig_processor.h"
+#include "motive/snapshot.h"
+#include "motive/util/hash.h"
+#include "motive/util/move_range.h"
 
 namespace motive {
 
 // See comments on RigInit for details on this class.
-class MotiveRigProcessor : public RigProcessor {
+class MotiveRigProcessor final : public RigProcessor {
  public:
   MotiveRigProcessor() : time_(0) {}
 
@@ -37,14 +41,37 @@ class MotiveRigProcessor : public RigProcessor {
 
   void AdvanceFrame(MotiveTime delta_time) override {
     Defragment();
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+    EndAdvanceFrame(delta_time);
+  }
+
+  bool SupportsAdvanceFrameRange() const override { return true; }
 
+  void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                         MotiveIndex end) override {
     // Process the series of matrix operations for each index.
-    const MotiveIndex num_indices = NumIndices();
-    for (MotiveIndex index = 0; index < num_indices; ++index) {
-      RigData& d = Data(index);
-      d.UpdateGlobalTransforms();
+    for (MotiveIndex index = begin; index < end; ++index) {
+      // Unused indices have no data. They only exist between calls to
+      // Defragment(), or when indices are pinned.
+      RigData* d = data_[index];
+      if (d == nullptr) continue;
+
+      // `time_` only changes in EndAdvanceFrame(), so every chunk sees the
+      // same start of frame.
+      const MotiveTime end_time = d->end_time();
+      if (end_time != kMotiveTimeEndless && time_ < end_time &&
+          end_time <= time_ + delta_time) {
+        MarkEvent(index);
+      }
+
+      // Rigs with an update interval hold their transforms between updates.
+      MotiveTime index_delta_time = delta_time;
+      if (!UpdateDue(index, &index_delta_time)) continue;
+      d->UpdateGlobalTransforms();
     }
+  }
 
+  void EndAdvanceFrame(MotiveTime delta_time) override {
     // Update our global time. It shouldn't matter if this wraps
     // around, since we only calculate times relative to it.
     time_ += delta_time;
@@ -53,12 +80,16 @@ class MotiveRigProcessor : public RigProcessor {
   void BlendToAnim(MotiveIndex index, const RigAnim& anim,
                    const motive::SplinePlayback& playback) override {
     Data(index).BlendToAnim(anim, playback, Engine(), time_);
+    ApplyUpdateIntervalToChildren(index);
+    SetChildLocalityKeys(index, 1);
   }
 
   void BlendToAnims(MotiveIndex index, const RigAnim** anims,
                     const SplinePlayback* playbacks, const float* weights,
                     int count) override {
     Data(index).BlendToAnims(anims, playbacks, weights, count, Engine(), time_);
+    ApplyUpdateIntervalToChildren(index);
+    SetChildLocalityKeys(index, 1);
   }
 
   void SetPlaybackRate(MotiveIndex index, float playback_rate) override {
@@ -78,9 +109,33 @@ class MotiveRigProcessor : public RigProcessor {
     Data(index).SetRepeating(repeat);
   }
 
+  // The bones are driven by child Motivators, so they have to skip the same
+  // frames as the rig itself.
+  void SetUpdateInterval(MotiveIndex index, int interval, int phase) override {
+    MotiveProcessor::SetUpdateInterval(index, interval, phase);
+    Data(index).SetUpdateInterval(interval, phase);
+  }
+
+  // Report an animation that ends within the jump, as AdvanceFrameRange()
+  // does.
+  void FastForward(MotiveIndex index, MotiveTime delta_time) override {
+    RigData& d = Data(index);
+    const MotiveTime end_time = d.end_time();
+    if (end_time != kMotiveTimeEndless && time_ < end_time &&
+        end_time <= time_ + delta_time) {
+      MarkEvent(index);
+    }
+    d.FastForward(delta_time);
+  }
+
   MotivatorType Type() const override { return RigInit::kType; }
   int Priority() const override { return 3; }
 
+  // Bones are driven by MatrixMotivators of either the matrix or sqt type.
+  bool ReadsFrom(const MotiveProcessor& other) const override {
+    return other.Type() == MatrixInit::kType || other.Type() == SqtInit::kType;
+  }
+
   const mathfu::AffineTransform* GlobalTransforms(
       MotiveIndex index) const override {
     return Data(index).GlobalTransforms();
@@ -126,6 +181,64 @@ class MotiveRigProcessor : public RigProcessor {
     return static_cast<MotiveIndex>(data_.size());
   }
 
+  // Blending may create new bone Motivators. Keep them on the rig's update
+  // frames.
+  void ApplyUpdateIntervalToChildren(MotiveIndex index) {
+    if (UpdateInterval(index) > 1) {
+      Data(index).SetUpdateInterval(UpdateInterval(index), UpdatePhase(index));
+    }
+  }
+
+  uint64_t HashOutputs(uint64_t hash) const override {
+    for (MotiveIndex i = 0; i < NumIndices(); ++i) {
+      const RigData* d = data_[i];
+      if (d == nullptr) continue;
+      hash = HashValues(d->GlobalTransforms(), d->NumBones(), hash);
+    }
+    return hash;
+  }
+
+  // The number of bones varies, so each rig keeps its own copy of the
+  // transforms it last reported.
+  void FindChangedIndices(float epsilon, IndexBitSet* changed) override {
+    for (MotiveIndex i = 0; i < NumIndices(); ++i) {
+      RigData* d = data_[i];
+      changed->Assign(i, d != nullptr && d->UpdateReportedTransforms(epsilon));
+    }
+  }
+
+  // Rigs are only marked when their animation ends.
+  MotiveEventType EventForIndex(MotiveIndex /*index*/,
+                                MotiveDimension /*dimensions*/) const override {
+    return kMotiveEventRigAnimEnded;
+  }
+
+  // One global transform per bone.
+  void WriteOutputBinding(MotiveIndex index, uint8_t* destination,
+                          size_t stride) const override {
+    const RigData& d = Data(index);
+    const mathfu::AffineTransform* transforms = d.GlobalTransforms();
+    for (BoneIndex i = 0; i < d.NumBones(); ++i) {
+      memcpy(destination + i * stride, &transforms[i],
+             sizeof(mathfu::AffineTransform));
+    }
+  }
+
+  void WriteSnapshot(ProcessorSnapshot* snapshot) const override {
+    const MotiveIndex num_indices = NumIndices();
+    snapshot->transforms.clear();
+    snapshot->transform_starts.resize(num_indices + 1);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      snapshot->transform_starts[i] = snapshot->transforms.size();
+      const RigData* d = data_[i];
+      if (d == nullptr) continue;
+      const mathfu::AffineTransform* transforms = d->GlobalTransforms();
+      snapshot->transforms.insert(snapshot->transforms.end(), transforms,
+                                  transforms + d->NumBones());
+    }
+    snapshot->transform_starts[num_indices] = snapshot->transforms.size();
+  }
+
   void InitializeIndices(const MotivatorInit& init, MotiveIndex index,
                          MotiveDimension dimensions,
                          MotiveEngine* engine) override {
@@ -137,6 +250,14 @@ class MotiveRigProcessor : public RigProcessor {
     }
   }
 
+  void SetChildLocalityKeys(MotiveIndex index,
+                            MotiveDimension dimensions) override {
+    for (MotiveIndex i = index; i < index + dimensions; ++i) {
+      Data(i).SetLocalityKeys(
+          [i](uint32_t bone) { return ChildLocalityKey(i, bone); });
+    }
+  }
+
   void RemoveIndices(MotiveIndex index, MotiveDimension dimensions) override {
     for (MotiveIndex i = index; i < index + dimensions; ++i) {
       if (data_[i] == nullptr) continue;
@@ -147,12 +268,12 @@ class MotiveRigProcessor : public RigProcessor {
 
   void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                    MotiveDimension dimensions) override {
-    MotiveIndex old_i = old_index;
-    MotiveIndex new_i = new_index;
-    for (MotiveDimension i = 0; i < dimensions; ++i, ++new_i, ++old_i) {
-      data_[new_i] = data_[old_i];
-      data_[old_i] = nullptr;
-    }
+    MoveRangeBytes(&data_, old_index, new_index, dimensions);
+    MotiveIndex vacated_end;
+    const MotiveIndex vacated_start =
+        VacatedRange(old_index, new_index, dimensions, &vacated_end);
+    std::fill(data_.begin() + vacated_start, data_.begin() + vacated_end,
+              nullptr);
   }
 
   void SetNumIndices(MotiveIndex num_indices) override {
@@ -166,6 +287,29 @@ class MotiveRigProcessor : public RigProcessor {
     data_.resize(num_indices, nullptr);
   }
 
+  void ReserveIndices(MotiveIndex num_indices) override {
+    data_.reserve(num_indices);
+  }
+
+  void SaveIndices(MotiveState* state, MotiveIndex num_indices) const override {
+    state->Write(time_);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      const RigData* d = data_[i];
+      state->Write(d != nullptr);
+      if (d != nullptr) d->SaveState(state);
+    }
+  }
+
+  void RestoreIndices(MotiveStateReader* reader,
+                      MotiveIndex num_indices) override {
+    reader->Read(&time_, 1);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      const bool has_data = reader->Read<bool>();
+      if (!reader->Check(has_data == (data_[i] != nullptr))) return;
+      if (has_data && !data_[i]->RestoreState(reader)) return;
+    }
+  }
+
   const RigData& Data(MotiveIndex index) const {
     assert(ValidIndex(index));
     return *data_[index];
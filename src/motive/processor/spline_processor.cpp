@@ -12,11 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "motive/engine.h"
 #include "motive/math/bulk_spline_evaluator.h"
 #include "motive/math/compact_spline.h"
 #include "motive/processor/spline_data.h"
 #include "motive/spline_init.h"
+#include "motive/util/move_range.h"
 
 namespace motive {
 
@@ -24,7 +27,7 @@ namespace motive {
 // that go above or below the supplied nodes.
 static const float kYRangeBufferPercent = 1.2f;
 
-class SplineMotiveProcessor : public MotiveProcessorNf {
+class SplineMotiveProcessor final : public MotiveProcessorNf {
  public:
   virtual ~SplineMotiveProcessor() {
     for (auto it = spline_pool_.begin(); it != spline_pool_.end(); ++it) {
@@ -34,7 +37,42 @@ class SplineMotiveProcessor : public MotiveProcessorNf {
 
   void AdvanceFrame(MotiveTime delta_time) override {
     Defragment();
-    interpolator_.AdvanceFrame(static_cast<float>(delta_time));
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+  }
+
+  bool SupportsAdvanceFrameRange() const override { return true; }
+
+  void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                         MotiveIndex end) override {
+    // Held splines don't move at all. When they're next due, catch up on
+    // the time they skipped, and let the interpolator advance them by the
+    // rest.
+    if (HasUpdateIntervals()) {
+      for (MotiveIndex i = begin; i < end; ++i) {
+        MotiveTime index_delta_time = delta_time;
+        const bool due = UpdateDue(i, &index_delta_time);
+        interpolator_.SetHeld(i, !due);
+        if (due && index_delta_time > delta_time) {
+          interpolator_.AdvanceX(
+              i, static_cast<float>(index_delta_time - delta_time));
+        }
+      }
+    }
+    interpolator_.AdvanceFrameRange(static_cast<float>(delta_time), begin,
+                                    end, PendingEvents());
+  }
+
+  void SetDeterministic(bool deterministic) override {
+    interpolator_.SetDeterministic(deterministic);
+  }
+
+  // Splines that play past their end are reported, as in
+  // AdvanceFrameRange().
+  void FastForward(MotiveIndex index, MotiveTime delta_time) override {
+    for (MotiveDimension i = 0; i < Dimensions(index); ++i) {
+      interpolator_.FastForward(index + i, static_cast<float>(delta_time),
+                                PendingEvents());
+    }
   }
 
   MotivatorType Type() const override { return SplineInit::kType; }
@@ -142,6 +180,16 @@ class SplineMotiveProcessor : public MotiveProcessorNf {
   }
 
  protected:
+  // Dimensions' splines may end on different frames. Report the Motivator
+  // when the last one ends.
+  MotiveEventType EventForIndex(MotiveIndex index,
+                                MotiveDimension dimensions) const override {
+    for (MotiveDimension i = 0; i < dimensions; ++i) {
+      if (!interpolator_.Ended(index + i)) return kMotiveEventNone;
+    }
+    return kMotiveEventSplineEnded;
+  }
+
   // TODO: Change to CreateSplineToTarget()
   void SetTarget(MotiveIndex index, const MotiveTarget1f& t) {
     SplineData& d = Data(index);
@@ -224,6 +272,43 @@ class SplineMotiveProcessor : public MotiveProcessorNf {
         });
   }
 
+  void SetTargetsAtIndices(const BatchEntry* entries, MotiveIndex count,
+                           MotiveDimension dimensions,
+                           const MotiveTarget1f* targets) override {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      const MotiveTarget1f* t = targets + entries[i].source * dimensions;
+      for (MotiveDimension d = 0; d < dimensions; ++d) {
+        SetTarget(entries[i].index + d, t[d]);
+      }
+    }
+  }
+
+  void SetSplinesAtIndices(const BatchEntry* entries, MotiveIndex count,
+                           MotiveDimension dimensions,
+                           const CompactSpline* const* splines,
+                           const SplinePlayback& playback) override {
+    for (MotiveIndex i = 0; i < count; ++i) {
+      const CompactSpline* const* s = splines + entries[i].source * dimensions;
+      for (MotiveDimension d = 0; d < dimensions; ++d) {
+        const MotiveIndex index = entries[i].index + d;
+        FreeSplineForIndex(index);
+        interpolator_.SetSplines(index, 1, s[d], playback);
+      }
+    }
+  }
+
+  void GatherVelocitiesAtIndices(const MotiveIndex* indices, MotiveIndex count,
+                                 MotiveDimension dimensions, float* out,
+                                 size_t item_stride,
+                                 size_t dimension_stride) const override {
+    for (MotiveDimension d = 0; d < dimensions; ++d) {
+      float* out_d = out + d * dimension_stride;
+      for (MotiveIndex i = 0; i < count; ++i) {
+        out_d[i * item_stride] = interpolator_.Derivative(indices[i] + d);
+      }
+    }
+  }
+
   virtual void RemoveIndices(MotiveIndex index, MotiveDimension dimensions) {
     // Clear reference to this spline.
     interpolator_.ClearSplines(index, dimensions);
@@ -238,17 +323,136 @@ class SplineMotiveProcessor : public MotiveProcessorNf {
 
   virtual void MoveIndices(MotiveIndex old_index, MotiveIndex new_index,
                            MotiveDimension dimensions) {
-    MotiveIndex old_i = old_index;
-    MotiveIndex new_i = new_index;
-    for (MotiveDimension i = 0; i < dimensions; ++i, ++new_i, ++old_i) {
-      data_[new_i] = data_[old_i];
-    }
+    MoveRangeBytes(&data_, old_index, new_index, dimensions);
     interpolator_.MoveIndices(old_index, new_index, dimensions);
+
+    // The local splines now belong to the new indices. The vacated indices
+    // may be handed out again without being removed, so they mustn't keep
+    // a pointer to them.
+    MotiveIndex vacated_end;
+    for (MotiveIndex i = VacatedRange(old_index, new_index, dimensions,
+                                      &vacated_end);
+         i < vacated_end; ++i) {
+      data_[i].local_spline = nullptr;
+    }
   }
 
   virtual void SetNumIndices(MotiveIndex num_indices) {
     data_.resize(num_indices);
     interpolator_.SetNumIndices(num_indices);
+    SetValuesArray(num_indices > 0 ? interpolator_.Ys(0) : nullptr);
+  }
+
+  virtual void ReserveIndices(MotiveIndex num_indices) {
+    data_.reserve(num_indices);
+    interpolator_.Reserve(num_indices);
+
+    // Reserving can move the values, so repoint FastValues() at them.
+    const MotiveIndex num_values = interpolator_.NumIndices();
+    SetValuesArray(num_values > 0 ? interpolator_.Ys(0) : nullptr);
+  }
+
+  // Splines created by SetTargets() are rewritten in place, so their nodes
+  // are saved too. Other splines are owned by the caller, and saved by
+  // pointer in the interpolator.
+  void SaveIndices(MotiveState* state, MotiveIndex num_indices) const override {
+    interpolator_.SaveState(state);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      const CompactSpline* spline = data_[i].local_spline;
+      state->Write(spline);
+      if (spline == nullptr) continue;
+      state->Write(spline->y_range());
+      state->Write(spline->x_granularity());
+      state->Write(spline->num_nodes());
+      state->Write(spline->nodes(), spline->num_nodes());
+    }
+  }
+
+  void RestoreIndices(MotiveStateReader* reader,
+                      MotiveIndex num_indices) override {
+    if (!interpolator_.RestoreState(reader)) return;
+
+    // Rewrite the saved splines in place. They're all still alive, either
+    // in the pool or owned by some index, and every index is about to get
+    // its saved spline back. The verifying pass checks that they are before
+    // anything dereferences them.
+    const bool verifying = reader->verifying();
+    if (verifying) GatherKnownSplines();
+    saved_splines_.resize(num_indices);
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      CompactSpline* spline = reader->Read<CompactSpline*>();
+      saved_splines_[i] = spline;
+      if (spline == nullptr) continue;
+      if (verifying &&
+          !reader->Check(std::binary_search(reclaimed_splines_.begin(),
+                                            reclaimed_splines_.end(),
+                                            spline))) {
+        return;
+      }
+      const Range y_range = reader->Read<Range>();
+      const float x_granularity = reader->Read<float>();
+      const CompactSplineIndex num_nodes = reader->Read<CompactSplineIndex>();
+      if (!reader->Check(num_nodes <= spline->max_nodes())) return;
+      if (!verifying) spline->Init(y_range, x_granularity);
+      for (CompactSplineIndex j = 0; j < num_nodes; ++j) {
+        const detail::CompactSplineNode n =
+            reader->Read<detail::CompactSplineNode>();
+        if (!verifying) spline->AddNodeVerbatim(n.x(), n.y(), n.angle());
+      }
+    }
+    if (!verifying) ReclaimSplines();
+  }
+
+  // Sort every spline this processor owns into `reclaimed_splines_`, so
+  // that RestoreIndices() can check the saved pointers against them.
+  void GatherKnownSplines() {
+    std::vector<CompactSpline*>& known = reclaimed_splines_;
+    known.assign(spline_pool_.begin(), spline_pool_.end());
+    for (size_t i = 0; i < data_.size(); ++i) {
+      if (data_[i].local_spline != nullptr) {
+        known.push_back(data_[i].local_spline);
+      }
+    }
+    std::sort(known.begin(), known.end());
+  }
+
+  // Make `saved_splines_[i]` the local spline of index i again. Splines are
+  // never destroyed while the processor is alive, so a saved spline is
+  // either still owned by some index, or in the pool. A spline may have
+  // moved to a later index, so first return every spline that's changed
+  // hands to the pool, and only then take the saved ones back out.
+  void ReclaimSplines() {
+    const MotiveIndex num_indices =
+        static_cast<MotiveIndex>(saved_splines_.size());
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      SplineData& d = data_[i];
+      if (d.local_spline == saved_splines_[i]) continue;
+      FreeSpline(d.local_spline);
+      d.local_spline = nullptr;
+    }
+
+    std::vector<CompactSpline*>& reclaimed = reclaimed_splines_;
+    reclaimed.clear();
+    for (MotiveIndex i = 0; i < num_indices; ++i) {
+      SplineData& d = data_[i];
+      if (d.local_spline != nullptr || saved_splines_[i] == nullptr) continue;
+      d.local_spline = saved_splines_[i];
+      reclaimed.push_back(saved_splines_[i]);
+    }
+    if (reclaimed.empty()) return;
+
+    // Compact the pool in one pass.
+    std::sort(reclaimed.begin(), reclaimed.end());
+    const size_t pool_size = spline_pool_.size();
+    spline_pool_.erase(
+        std::remove_if(spline_pool_.begin(), spline_pool_.end(),
+                       [&reclaimed](CompactSpline* spline) {
+                         return std::binary_search(reclaimed.begin(),
+                                                   reclaimed.end(), spline);
+                       }),
+        spline_pool_.end());
+    assert(pool_size - spline_pool_.size() == reclaimed.size());
+    (void)pool_size;
   }
 
   const SplineData& Data(MotiveIndex index) const {
@@ -319,6 +523,11 @@ class SplineMotiveProcessor : public MotiveProcessorNf {
   // try to recycle an old one from this pool first.
   std::vector<CompactSpline*> spline_pool_;
 
+  // Scratch space for RestoreIndices(), kept so that restoring doesn't
+  // allocate once the processor has been restored at this size.
+  std::vector<CompactSpline*> saved_splines_;
+  std::vector<CompactSpline*> reclaimed_splines_;
+
   // Perform the spline evaluation, over time. Indices in 'interpolator_'
   // are the same as the MotiveIndex values in this class.
   BulkSplineEvaluator interpolator_;
@@ -18,6 +18,7 @@
 #include "motive/spring_init.h"
 #include "motive/math/curve_util.h"
 #include "motive/simple_processor_template.h"
+#include "motive/util.h"
 
 namespace motive {
 
@@ -25,6 +26,10 @@ namespace motive {
 //                 configurable in MotiveCurveShape.
 static const float kNumSpringIterations = 4.0f;
 
+// Settle once the swing and velocity are this fraction of the typical delta
+// value and typical velocity in the MotiveCurveShape.
+static const float kSpringSettledFraction = 0.001f;
+
 struct SpringData {
   SpringData() : elapsed_time(0.0f), target_time(0.0f) {}
 
@@ -45,6 +50,9 @@ struct SpringData {
 
   // Time after kNumSpringIterations.
   float target_time;
+
+  // Thresholds for snapping onto the target. See kSpringSettledFraction.
+  Settled1f at_target;
 };
 
 }  // namespace motive
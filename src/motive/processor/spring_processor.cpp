@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cmath>
+
 #include "motive/spring_init.h"
 #include "motive/math/curve_util.h"
 #include "motive/processor/spring_data.h"
@@ -41,28 +43,64 @@ static inline MotiveTime SimpleTargetTime(const SpringData& d) {
   return static_cast<MotiveTime>(d.target_time - d.elapsed_time);
 }
 
-class SpringMotiveProcessor : public SimpleProcessorTemplate<SpringData> {
+class SpringMotiveProcessor final : public SimpleProcessorTemplate<SpringData> {
  public:
   virtual ~SpringMotiveProcessor() {}
 
   virtual void AdvanceFrame(MotiveTime delta_time) {
     Defragment();
+    AdvanceFrameRange(delta_time, 0, NumIndices());
+  }
 
-    // Loop through every motivator, one at a time.
+  virtual bool SupportsAdvanceFrameRange() const { return true; }
+
+  virtual void AdvanceFrameRange(MotiveTime delta_time, MotiveIndex begin,
+                                 MotiveIndex end) {
+    // Loop through every moving motivator, one at a time.
     // At some point we can write an assembly language function to process
     // these in parallel.
-    for (size_t i = 0; i < data_.size(); ++i) {
+    for (MotiveIndex i = active_.NextSet(begin, end); i < end;
+         i = active_.NextSet(i + 1, end)) {
+      MotiveTime index_delta_time = delta_time;
+      if (!UpdateDue(i, &index_delta_time)) continue;
       SpringData& d = data_[i];
 
       // Advance the time and then update the current value.
-      d.elapsed_time += static_cast<float>(delta_time);
+      d.elapsed_time += static_cast<float>(index_delta_time);
       d.q.IncrementContext(d.elapsed_time, &d.c);
       values_[i] = d.q.EvaluateWithContext(d.elapsed_time, d.c);
+
+      // The oscillation shrinks by the bias every half cycle, but never
+      // reaches zero. Once it's too small to see, snap onto the target. The
+      // value stays there until the next call to SetTargetWithShape().
+      if (Settled(d)) {
+        Settle(i);
+        MarkEvent(i);
+      }
+    }
+  }
+
+  // Recalculate the context at the new time, instead of incrementing it
+  // through every oscillation in between.
+  virtual void FastForward(MotiveIndex index, MotiveTime delta_time) {
+    for (MotiveIndex i = index; i < index + Dimensions(index); ++i) {
+      if (!active_.Test(i)) continue;
+      SpringData& d = Data(i);
+      d.elapsed_time += static_cast<float>(delta_time);
+      d.c = d.q.CalculateContext(d.elapsed_time);
+      values_[i] = d.q.EvaluateWithContext(d.elapsed_time, d.c);
+      if (Settled(d)) {
+        Settle(i);
+        MarkEvent(i);
+      }
     }
   }
 
   virtual MotivatorType Type() const { return SpringInit::kType; }
   virtual int Priority() const { return 1; }
+  virtual bool ReadsFrom(const MotiveProcessor& /*other*/) const {
+    return false;
+  }
 
   virtual void SetTargetWithShape(MotiveIndex index, MotiveDimension dimensions,
                                   const float* target_values,
@@ -78,9 +116,34 @@ class SpringMotiveProcessor : public SimpleProcessorTemplate<SpringData> {
                             shape.typical_total_time, shape.bias);
       d.c = d.q.CalculateContext(0.0f);
       d.elapsed_time = 0.0f;
+      d.at_target.max_difference =
+          kSpringSettledFraction * fabs(shape.typical_delta_value);
+      d.at_target.max_velocity = kSpringSettledFraction *
+                                 fabs(shape.typical_delta_value) /
+                                 shape.typical_total_time;
+      active_.Set(processor_index);
     }
   }
 
+  // The remaining swing, on either side of the target, and the velocity are
+  // both within the thresholds set by SetTargetWithShape().
+  static bool Settled(const SpringData& d) {
+    return d.at_target.Settled(d.c.peak,
+                               d.q.DerivativeWithContext(d.elapsed_time, d.c));
+  }
+
+  // Park `index` on its target, at rest, as if freshly initialized there.
+  void Settle(MotiveIndex index) {
+    SpringData& d = data_[index];
+    const float target = d.q.target();
+    d.q = QuadraticSpring(target);
+    d.c = QuadraticSpring::Context();
+    d.elapsed_time = 0.0f;
+    d.target_time = 0.0f;
+    values_[index] = target;
+    active_.Clear(index);
+  }
+
   virtual MotiveCurveShape MotiveShape(MotiveIndex /*index*/) const {
     // TODO(jsanmiya): We'll be removing MotiveShape in the next change.
     return MotiveCurveShape();
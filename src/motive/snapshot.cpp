@@ -0,0 +1,93 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "motive/snapshot.h"
+
+#include <algorithm>
+
+namespace motive {
+
+void MotiveSnapshot::IndexMotivators() {
+  // A Motivator owns one index per dimension. Record only the first.
+  entries_.clear();
+  for (ProcessorMap::const_iterator it = processors_.begin();
+       it != processors_.end(); ++it) {
+    const std::vector<const Motivator*>& motivators = it->second.motivators;
+    for (size_t i = 0; i < motivators.size(); ++i) {
+      const Motivator* motivator = motivators[i];
+      if (motivator == nullptr || (i > 0 && motivators[i - 1] == motivator)) {
+        continue;
+      }
+      const Entry entry = {motivator, &it->second,
+                           static_cast<MotiveIndex>(i)};
+      entries_.push_back(entry);
+    }
+  }
+  std::sort(entries_.begin(), entries_.end(),
+            [](const Entry& a, const Entry& b) {
+              return a.motivator < b.motivator;
+            });
+}
+
+// Only reads the snapshot, never `motivator`, whose fields may be changing
+// on the simulation thread.
+const ProcessorSnapshot* MotiveSnapshot::Find(const Motivator& motivator,
+                                              MotiveIndex* index) const {
+  const std::vector<Entry>::const_iterator it = std::lower_bound(
+      entries_.begin(), entries_.end(), &motivator,
+      [](const Entry& entry, const Motivator* m) {
+        return entry.motivator < m;
+      });
+  if (it == entries_.end() || it->motivator != &motivator) return nullptr;
+  *index = it->index;
+  return it->processor;
+}
+
+const float* MotiveSnapshot::Values(const Motivator& motivator) const {
+  MotiveIndex index;
+  const ProcessorSnapshot* snapshot = Find(motivator, &index);
+  if (snapshot == nullptr ||
+      static_cast<size_t>(index) >= snapshot->values.size()) {
+    return nullptr;
+  }
+  return &snapshot->values[index];
+}
+
+const mathfu::mat4* MotiveSnapshot::Matrix(const Motivator& motivator) const {
+  MotiveIndex index;
+  const ProcessorSnapshot* snapshot = Find(motivator, &index);
+  if (snapshot == nullptr ||
+      static_cast<size_t>(index) >= snapshot->matrices.size()) {
+    return nullptr;
+  }
+  return &snapshot->matrices[index];
+}
+
+const mathfu::AffineTransform* MotiveSnapshot::GlobalTransforms(
+    const Motivator& motivator, int* num_transforms) const {
+  *num_transforms = 0;
+  MotiveIndex index;
+  const ProcessorSnapshot* snapshot = Find(motivator, &index);
+  if (snapshot == nullptr ||
+      static_cast<size_t>(index) + 1 >= snapshot->transform_starts.size()) {
+    return nullptr;
+  }
+
+  const size_t start = snapshot->transform_starts[index];
+  const size_t end = snapshot->transform_starts[index + 1];
+  *num_transforms = static_cast<int>(end - start);
+  return start == end ? nullptr : &snapshot->transforms[start];
+}
+
+}  // namespace motive
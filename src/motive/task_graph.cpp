@@ -0,0 +1,92 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include <algorithm>
+
+#include "motive/processor.h"
+#include "motive/task_graph.h"
+
+namespace motive {
+
+const int* MotiveTaskGraph::Dependencies(int i, int* num_dependencies) const {
+  assert(0 <= i && i < NumTasks());
+  const int start = dependency_starts_[i];
+  const int end = i + 1 < NumTasks() ? dependency_starts_[i + 1]
+                                     : static_cast<int>(dependencies_.size());
+  *num_dependencies = end - start;
+  return start == end ? nullptr : &dependencies_[start];
+}
+
+void MotiveTaskGraph::Run(int i) {
+  Task& task = tasks_[i];
+  const BenchmarkTime start = GetBenchmarkTime();
+  switch (task.type) {
+    case kBeginAdvanceFrame:
+      task.processor->BeginAdvanceFrame(task.delta_time);
+      break;
+
+    case kAdvanceFrameRange: {
+      // Ranges are calculated before BeginAdvanceFrame() runs. It may
+      // defragment the processor, and so shrink the number of indices.
+      const MotiveIndex end = std::min(task.end, task.processor->NumIndices());
+      if (task.begin < end) {
+        task.processor->AdvanceFrameRange(task.delta_time, task.begin, end);
+      }
+      break;
+    }
+
+    // Outputs are final once the processor has finished advancing.
+    case kEndAdvanceFrame:
+      task.processor->EndAdvanceFrame(task.delta_time);
+      task.processor->UpdateChangedIndices();
+      task.processor->WriteOutputBindings();
+      break;
+
+    case kAdvanceFrame:
+      task.processor->AdvanceFrame(task.delta_time);
+      task.processor->UpdateChangedIndices();
+      task.processor->WriteOutputBindings();
+      break;
+  }
+  task.duration = GetBenchmarkTime() - start;
+}
+
+void MotiveTaskGraph::Clear() {
+  tasks_.clear();
+  dependency_starts_.clear();
+  dependencies_.clear();
+  num_phases_ = 0;
+}
+
+int MotiveTaskGraph::AddTask(MotiveProcessor* processor, TaskType type,
+                             MotiveIndex begin, MotiveIndex end,
+                             MotiveTime delta_time, int phase) {
+  // Tasks must be added in phase order.
+  assert(tasks_.empty() || tasks_.back().phase <= phase);
+  const Task task = {processor, type, begin, end, delta_time, phase, 0};
+  tasks_.push_back(task);
+  dependency_starts_.push_back(static_cast<int>(dependencies_.size()));
+  num_phases_ = std::max(num_phases_, phase + 1);
+  return NumTasks() - 1;
+}
+
+void MotiveTaskGraph::AddDependency(int dependency) {
+  // Dependencies must be earlier tasks, in earlier phases.
+  assert(0 <= dependency && dependency < NumTasks() - 1);
+  assert(tasks_[dependency].phase < tasks_.back().phase);
+  dependencies_.push_back(dependency);
+}
+
+}  // namespace motive
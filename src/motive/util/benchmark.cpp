@@ -217,6 +217,11 @@ Benchmark::~Benchmark() {
   gTimes[id_].Append(end_time - start_time_);
 }
 
+void AddBenchmarkSample(int id, BenchmarkTime sample) {
+  assert(0 <= id && id < static_cast<int>(gTimes.size()));
+  gTimes[id].Append(sample);
+}
+
 }  // namespace motive
 
 #else
@@ -16,12 +16,72 @@
 
 #if defined(__ANDROID__)
 #include <cpu-features.h>
+#elif defined(MOTIVE_X86_64) && defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(MOTIVE_X86_64)
+#include <cpuid.h>
 #endif  // defined(__ANDROID__)
 
 namespace motive {
 
+#if !defined(__ANDROID__) && defined(MOTIVE_X86_64)
+
+// Feature bits, from the Intel Software Developer's Manual.
+static const unsigned int kCpuid1EcxSse3 = 1u << 0;
+static const unsigned int kCpuid1EcxSsse3 = 1u << 9;
+static const unsigned int kCpuid1EcxOsxsave = 1u << 27;
+static const unsigned int kCpuid1EcxAvx = 1u << 28;
+static const unsigned int kCpuid7EbxAvx2 = 1u << 5;
+
+// XCR0 bits that say the OS saves the SSE and AVX registers.
+static const unsigned int kXcr0SseAndAvxState = 0x6;
+
+// Fill `regs` with eax, ebx, ecx, and edx for the cpuid `leaf`.
+static void Cpuid(unsigned int leaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+  __cpuidex(reinterpret_cast<int*>(regs), static_cast<int>(leaf), 0);
+#else
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// The low 32 bits of extended control register 0. Only valid if cpuid
+// reports OSXSAVE.
+static unsigned int Xcr0() {
+#if defined(_MSC_VER)
+  return static_cast<unsigned int>(_xgetbv(0));
+#else
+  unsigned int eax = 0;
+  unsigned int edx = 0;
+  __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return eax;
+#endif
+}
+
+static ProcessorOptimization BestX86Optimization() {
+  unsigned int regs[4];
+  Cpuid(0, regs);
+  const unsigned int max_leaf = regs[0];
+  if (max_leaf < 1) return kNoOptimizations;
+
+  Cpuid(1, regs);
+  const unsigned int ecx1 = regs[2];
+
+  // AVX2 needs the OS to save the upper halves of the ymm registers.
+  if (max_leaf >= 7 && (ecx1 & kCpuid1EcxOsxsave) &&
+      (ecx1 & kCpuid1EcxAvx) &&
+      (Xcr0() & kXcr0SseAndAvxState) == kXcr0SseAndAvxState) {
+    Cpuid(7, regs);
+    if (regs[1] & kCpuid7EbxAvx2) return kAvx2Optimizations;
+  }
+  if (ecx1 & kCpuid1EcxSsse3) return kSsse3Optimizations;
+  if (ecx1 & kCpuid1EcxSse3) return kSse3Optimizations;
+  return kNoOptimizations;
+}
+
+#endif  // !defined(__ANDROID__) && defined(MOTIVE_X86_64)
+
 ProcessorOptimization BestProcessorOptimization() {
-// TODO: Add checks for other operating systems.
 #if defined(__ANDROID__)
   const uint64_t features = android_getCpuFeatures();
   switch (android_getCpuFamily()) {
@@ -36,6 +96,8 @@ ProcessorOptimization BestProcessorOptimization() {
     default:
       break;
   }
+#elif defined(MOTIVE_X86_64)
+  return BestX86Optimization();
 #endif  // defined(__ANDROID__)
 
   return kNoOptimizations;
@@ -0,0 +1,111 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "motive/util/worker_pool.h"
+
+#include <assert.h>
+
+namespace motive {
+
+WorkerPool::WorkerPool(int num_threads)
+    : task_(nullptr),
+      num_tasks_(0),
+      generation_(0),
+      num_active_workers_(0),
+      shutdown_(false),
+      next_task_(0) {
+  assert(num_threads >= 0);
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+  }
+  work_ready_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+}
+
+void WorkerPool::Run(int num_tasks, const Task& task) {
+  // Waking the workers is only worthwhile when there's more than one task.
+  if (threads_.empty() || num_tasks <= 1) {
+    for (int i = 0; i < num_tasks; ++i) {
+      task(i);
+    }
+    return;
+  }
+
+  // Publish the batch. Every worker participates in every batch, even if
+  // there's nothing left for it to claim by the time it wakes up.
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    num_tasks_ = num_tasks;
+    next_task_.store(0);
+    num_active_workers_ = num_threads();
+    ++generation_;
+  }
+  work_ready_.notify_all();
+
+  // Help out on the calling thread.
+  ExecuteTasks(task, num_tasks);
+
+  // Barrier. Wait for the workers to finish their last claimed tasks.
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this]() { return num_active_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void WorkerPool::WorkerLoop() {
+  uint32_t executed_generation = 0;
+  for (;;) {
+    const Task* task = nullptr;
+    int num_tasks = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_ready_.wait(lock, [this, executed_generation]() {
+        return shutdown_ || generation_ != executed_generation;
+      });
+      if (shutdown_) return;
+      executed_generation = generation_;
+      task = task_;
+      num_tasks = num_tasks_;
+    }
+
+    ExecuteTasks(*task, num_tasks);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      num_active_workers_--;
+      if (num_active_workers_ == 0) {
+        work_done_.notify_one();
+      }
+    }
+  }
+}
+
+void WorkerPool::ExecuteTasks(const Task& task, int num_tasks) {
+  for (int i = next_task_.fetch_add(1); i < num_tasks;
+       i = next_task_.fetch_add(1)) {
+    task(i);
+  }
+}
+
+}  // namespace motive
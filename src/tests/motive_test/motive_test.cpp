@@ -19,6 +19,7 @@
 #include "motive/const_init.h"
 #include "motive/ease_in_ease_out_init.h"
 #include "motive/engine.h"
+#include "motive/engine_group.h"
 #include "motive/math/angle.h"
 #include "motive/math/curve_util.h"
 #include "motive/matrix_init.h"
@@ -26,7 +27,9 @@
 #include "motive/matrix_op.h"
 #include "motive/overshoot_init.h"
 #include "motive/spline_init.h"
+#include "motive/spring_init.h"
 #include "motive/sqt_init.h"
+#include "motive/static_engine.h"
 
 #define DEBUG_PRINT_MATRICES 0
 
@@ -58,14 +61,18 @@ using motive::MatrixInit;
 using motive::MatrixMotivator4f;
 using motive::MatrixOperationInit;
 using motive::MatrixOperationType;
+using motive::Motivator;
 using motive::Motivator1f;
 using motive::Motivator2f;
 using motive::Motivator3f;
 using motive::Motivator4f;
 using motive::MotivatorInit;
+using motive::MotivatorNf;
 using motive::MotiveCurveShape;
 using motive::MotiveDimension;
 using motive::MotiveEngine;
+using motive::MotiveEngineGroup;
+using motive::MotiveSnapshot;
 using motive::MotiveTarget1f;
 using motive::MotiveTarget2f;
 using motive::MotiveTarget3f;
@@ -230,6 +237,7 @@ class MotiveTests : public ::testing::Test {
     motive::EaseInEaseOutInit::Register();
     motive::MatrixInit::Register();
     motive::SqtInit::Register();
+    motive::SpringInit::Register();
 
     // Create an OvershootInit with reasonable values.
     overshoot_angle_init_.set_modular(true);
@@ -1253,6 +1261,1117 @@ void Splines(MotiveTests& t) {
 }
 TEST_ALL_VECTOR_MOTIVATORS_F(Splines)
 
+// Advancing processors on worker threads should give exactly the same results
+// as advancing them serially.
+TEST_F(MotiveTests, WorkerThreadsMatchSerial) {
+  static const int kNumMotivators = 64;
+  static const MotiveTime kEndTime = 1000;
+
+  MotiveEngine parallel_engine;
+  parallel_engine.SetNumWorkerThreads(3);
+  EXPECT_EQ(3, parallel_engine.NumWorkerThreads());
+
+  std::vector<MatrixOperationInit> ops;
+  ops.emplace_back(0, kRotateAboutY, spline_angle_init_, simple_spline_);
+  ops.emplace_back(1, kTranslateX, spline_scalar_init, 2.0f);
+  const MatrixInit matrix_init(ops);
+
+  Motivator1f serial_overshoots[kNumMotivators];
+  Motivator1f parallel_overshoots[kNumMotivators];
+  Motivator1f serial_splines[kNumMotivators];
+  Motivator1f parallel_splines[kNumMotivators];
+  MatrixMotivator4f serial_matrices[kNumMotivators];
+  MatrixMotivator4f parallel_matrices[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const SplinePlayback playback(static_cast<float>(i), true);
+    InitOvershootMotivator(&serial_overshoots[i]);
+    parallel_overshoots[i].InitializeWithTarget(
+        overshoot_percent_init_, &parallel_engine,
+        motive::CurrentToTarget1f(overshoot_percent_init_.range().start(),
+                                  overshoot_percent_init_.max_velocity(),
+                                  overshoot_percent_init_.range().end(), 0.0f,
+                                  1));
+    serial_splines[i].Initialize(spline_scalar_init, &engine_);
+    parallel_splines[i].Initialize(spline_scalar_init, &parallel_engine);
+    serial_splines[i].SetSpline(simple_spline_, playback);
+    parallel_splines[i].SetSpline(simple_spline_, playback);
+    serial_matrices[i].Initialize(matrix_init, &engine_);
+    parallel_matrices[i].Initialize(matrix_init, &parallel_engine);
+  }
+
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    parallel_engine.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_EQ(serial_overshoots[i].Value(), parallel_overshoots[i].Value());
+      EXPECT_EQ(serial_splines[i].Value(), parallel_splines[i].Value());
+      ExpectMatricesEqual(serial_matrices[i].Value(),
+                          parallel_matrices[i].Value(), 0.0f);
+    }
+  }
+}
+
+// Split processors into many small chunks, and punch holes in the indices
+// so that the chunks are computed after defragmentation.
+TEST_F(MotiveTests, AdvanceFrameChunksMatchSerial) {
+  static const int kNumMotivators = 300;
+  static const MotiveTime kEndTime = 500;
+
+  MotiveEngine parallel_engine;
+  parallel_engine.SetNumWorkerThreads(3);
+  parallel_engine.SetAdvanceFrameChunkSize(7);
+  EXPECT_EQ(7, parallel_engine.AdvanceFrameChunkSize());
+
+  Motivator1f serial_splines[kNumMotivators];
+  Motivator1f parallel_splines[kNumMotivators];
+  Motivator1f serial_overshoots[kNumMotivators];
+  Motivator1f parallel_overshoots[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const SplinePlayback playback(static_cast<float>(i * 3), true);
+    serial_splines[i].Initialize(spline_scalar_init, &engine_);
+    parallel_splines[i].Initialize(spline_scalar_init, &parallel_engine);
+    serial_splines[i].SetSpline(simple_spline_, playback);
+    parallel_splines[i].SetSpline(simple_spline_, playback);
+    InitOvershootMotivator(&serial_overshoots[i]);
+    parallel_overshoots[i].InitializeWithTarget(
+        overshoot_percent_init_, &parallel_engine,
+        motive::CurrentToTarget1f(overshoot_percent_init_.range().start(),
+                                  overshoot_percent_init_.max_velocity(),
+                                  overshoot_percent_init_.range().end(), 0.0f,
+                                  1));
+  }
+  for (int i = 0; i < kNumMotivators; i += 9) {
+    serial_splines[i].Invalidate();
+    parallel_splines[i].Invalidate();
+  }
+
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    parallel_engine.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_EQ(serial_overshoots[i].Value(), parallel_overshoots[i].Value());
+      if (!serial_splines[i].Valid()) continue;
+      EXPECT_EQ(serial_splines[i].Value(), parallel_splines[i].Value());
+    }
+  }
+}
+
+// The engine must forget its schedule when its processors are destroyed.
+TEST_F(MotiveTests, AdvanceFrameAfterReset) {
+  {
+    Motivator1f overshoot;
+    InitOvershootMotivator(&overshoot);
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  engine_.Reset();
+
+  Motivator1f spline(spline_scalar_init, &engine_);
+  spline.SetSpline(simple_spline_, SplinePlayback());
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_TRUE(spline.Valid());
+  EXPECT_EQ(kTimePerFrame, spline.SplineTime());
+}
+
+// Snapshots hold the values of the frame that was published, even after
+// the engine has moved on to the next frame.
+TEST_F(MotiveTests, SnapshotHoldsPublishedFrame) {
+  engine_.SetSnapshotMode(true);
+  Motivator1f removed(spline_scalar_init, &engine_);
+  Motivator1f spline(spline_scalar_init, &engine_);
+  spline.SetSpline(simple_spline_, SplinePlayback());
+  EXPECT_EQ(nullptr, engine_.AcquireSnapshot().Values(spline));
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  const MotiveSnapshot& first = engine_.AcquireSnapshot();
+  const float first_value = spline.Value();
+  EXPECT_EQ(1u, first.frame());
+  ASSERT_NE(nullptr, first.Values(spline));
+  EXPECT_EQ(first_value, *first.Values(spline));
+
+  // Pinned indices aren't defragmented by AdvanceFrame(), so `spline` can
+  // still be looked up in `first`.
+  removed.Invalidate();
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_NE(first_value, spline.Value());
+  EXPECT_EQ(1u, first.frame());
+  ASSERT_NE(nullptr, first.Values(spline));
+  EXPECT_EQ(first_value, *first.Values(spline));
+  EXPECT_EQ(nullptr, first.Values(removed));
+
+  const MotiveSnapshot& second = engine_.AcquireSnapshot();
+  EXPECT_EQ(2u, second.frame());
+  ASSERT_NE(nullptr, second.Values(spline));
+  EXPECT_EQ(spline.Value(), *second.Values(spline));
+
+  // Defragmenting moves `spline`, and publishes a snapshot that knows that.
+  // The snapshot still held finds `spline` where it was.
+  engine_.Defragment();
+  ASSERT_NE(nullptr, second.Values(spline));
+  EXPECT_EQ(spline.Value(), *second.Values(spline));
+  const MotiveSnapshot& third = engine_.AcquireSnapshot();
+  ASSERT_NE(nullptr, third.Values(spline));
+  EXPECT_EQ(spline.Value(), *third.Values(spline));
+}
+
+// Settled motivators are skipped in AdvanceFrame(), but must hold their value
+// and start moving again when given a new target.
+TEST_F(MotiveTests, SettledMotivatorWakesOnNewTarget) {
+  static const float kTarget = 60.0f;
+  static const float kNewTarget = 40.0f;
+  Motivator1f overshoot;
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, kTarget, 1, &overshoot);
+  for (MotiveTime time = 0; time < kMaxTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  EXPECT_EQ(kTarget, overshoot.Value());
+  EXPECT_EQ(0.0f, overshoot.Velocity());
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(kTarget, overshoot.Value());
+
+  overshoot.SetTarget(motive::Target1f(kNewTarget, 0.0f, 1));
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_GT(kTarget, overshoot.Value());
+  for (MotiveTime time = 0; time < kMaxTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  EXPECT_EQ(kNewTarget, overshoot.Value());
+}
+
+// Runs a task graph on the calling thread, in index order, checking that
+// every dependency has already been run.
+class SerialTaskExecutor : public motive::MotiveTaskExecutor {
+ public:
+  SerialTaskExecutor() : num_executions_(0) {}
+
+  virtual void Execute(motive::MotiveTaskGraph* graph) {
+    std::vector<bool> done(graph->NumTasks(), false);
+    for (int i = 0; i < graph->NumTasks(); ++i) {
+      int num_dependencies = 0;
+      const int* dependencies = graph->Dependencies(i, &num_dependencies);
+      for (int j = 0; j < num_dependencies; ++j) {
+        EXPECT_TRUE(done[dependencies[j]]);
+        EXPECT_LT(graph->task(dependencies[j]).phase, graph->task(i).phase);
+      }
+      graph->Run(i);
+      done[i] = true;
+    }
+    num_executions_++;
+  }
+
+  int num_executions() const { return num_executions_; }
+
+ private:
+  int num_executions_;
+};
+
+// A host job system advancing the engine must get the same result as the
+// engine advancing itself.
+TEST_F(MotiveTests, TaskExecutorMatchesSerial) {
+  static const int kNumMotivators = 20;
+  static const MotiveTime kEndTime = 300;
+
+  MotiveEngine hosted_engine;
+  hosted_engine.SetAdvanceFrameChunkSize(3);
+  SerialTaskExecutor executor;
+
+  Motivator1f serial_splines[kNumMotivators];
+  Motivator1f hosted_splines[kNumMotivators];
+  MatrixMotivator4f serial_matrices[kNumMotivators];
+  MatrixMotivator4f hosted_matrices[kNumMotivators];
+  std::vector<MatrixOperationInit> ops;
+  ops.emplace_back(0, kRotateAboutY, spline_angle_init_, simple_spline_);
+  ops.emplace_back(1, kTranslateX, spline_scalar_init, 2.0f);
+  const MatrixInit matrix_init(ops);
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const SplinePlayback playback(static_cast<float>(i * 5), true);
+    serial_splines[i].Initialize(spline_scalar_init, &engine_);
+    hosted_splines[i].Initialize(spline_scalar_init, &hosted_engine);
+    serial_splines[i].SetSpline(simple_spline_, playback);
+    hosted_splines[i].SetSpline(simple_spline_, playback);
+    serial_matrices[i].Initialize(matrix_init, &engine_);
+    hosted_matrices[i].Initialize(matrix_init, &hosted_engine);
+  }
+
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    hosted_engine.AdvanceFrame(kTimePerFrame, &executor);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_EQ(serial_splines[i].Value(), hosted_splines[i].Value());
+      ExpectMatricesEqual(serial_matrices[i].Value(),
+                          hosted_matrices[i].Value(), 0.0f);
+    }
+  }
+  EXPECT_EQ(kEndTime / kTimePerFrame, executor.num_executions());
+}
+
+// A Motivator with an update interval should hold its value between updates,
+// and match a full-rate Motivator on the frames that it updates. It catches
+// up on the skipped time in one step, which can round differently.
+TEST_F(MotiveTests, UpdateIntervalHoldsBetweenUpdates) {
+  static const int kInterval = 3;
+  static const MotiveTime kEndTime = 300;
+  const SplinePlayback playback(0.0f, true);
+  Motivator1f full_rate(spline_scalar_init, &engine_);
+  Motivator1f reduced_rate(spline_scalar_init, &engine_);
+  full_rate.SetSpline(simple_spline_, playback);
+  reduced_rate.SetSpline(simple_spline_, playback);
+  reduced_rate.SetUpdateInterval(kInterval, 0);
+  EXPECT_EQ(kInterval, reduced_rate.UpdateInterval());
+
+  int frame = 0;
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame, ++frame) {
+    const float held_value = reduced_rate.Value();
+    engine_.AdvanceFrame(kTimePerFrame);
+    if (frame % kInterval == 0) {
+      EXPECT_NEAR(full_rate.Value(), reduced_rate.Value(), 0.001f);
+    } else {
+      EXPECT_EQ(held_value, reduced_rate.Value());
+    }
+  }
+}
+
+// FastForward() should land where advancing frame by frame does, even when
+// the spline loops several times in between.
+TEST_F(MotiveTests, FastForwardMatchesAdvanceFrame) {
+  static const MotiveTime kEndTime = 3250;
+  MotiveEngine fast_forward_engine;
+  const SplinePlayback playback(0.0f, true);
+  Motivator1f stepped(spline_scalar_init, &engine_);
+  Motivator1f jumped(spline_scalar_init, &fast_forward_engine);
+  stepped.SetSpline(simple_spline_, playback);
+  jumped.SetSpline(simple_spline_, playback);
+
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  jumped.FastForward(kEndTime);
+  EXPECT_NEAR(stepped.Value(), jumped.Value(), 0.001f);
+  EXPECT_NEAR(stepped.Velocity(), jumped.Velocity(), 0.001f);
+
+  // Curves that are simulated should end up on their target.
+  Motivator1f overshoot;
+  overshoot.InitializeWithTarget(
+      overshoot_percent_init_, &fast_forward_engine,
+      motive::CurrentToTarget1f(50.0f, 0.0f, 60.0f, 0.0f, 1));
+  overshoot.FastForward(kMaxTime);
+  EXPECT_EQ(60.0f, overshoot.Value());
+  EXPECT_EQ(0.0f, overshoot.Velocity());
+}
+
+// RestoreState() should rewind every Motivator, even after targets have been
+// changed, so that replaying the same frames gives the same values.
+TEST_F(MotiveTests, RestoreStateReplaysFrames) {
+  static const int kNumFrames = 20;
+  Motivator1f spline;
+  Motivator1f overshoot;
+  Motivator1f ease;
+  InitMotivator(spline_scalar_init, 0.0f, 0.0f, 1.0f, 500, &spline);
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, 60.0f, 1, &overshoot);
+  InitEaseInEaseOutMotivator(ease_init__, 1.0f, 0.0f,
+                             MotiveCurveShape(1.0f, 500.0f, 0.5f), &ease);
+  for (int i = 0; i < kNumFrames; ++i) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+
+  motive::MotiveState state;
+  engine_.SaveState(&state);
+  const float saved_values[] = {spline.Value(), overshoot.Value(),
+                                ease.Value()};
+  std::vector<float> expected;
+  for (int i = 0; i < kNumFrames; ++i) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    expected.push_back(spline.Value());
+    expected.push_back(overshoot.Value());
+    expected.push_back(ease.Value());
+  }
+
+  // Diverge from the saved path, then rewind.
+  spline.SetTarget(motive::Target1f(-1.0f, 0.0f, 100));
+  overshoot.SetTarget(motive::Target1f(0.0f, 0.0f, 1));
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_TRUE(engine_.RestoreState(state));
+  EXPECT_EQ(saved_values[0], spline.Value());
+  EXPECT_EQ(saved_values[1], overshoot.Value());
+  EXPECT_EQ(saved_values[2], ease.Value());
+
+  for (int i = 0; i < kNumFrames; ++i) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    EXPECT_EQ(expected[3 * i], spline.Value());
+    EXPECT_EQ(expected[3 * i + 1], overshoot.Value());
+    EXPECT_EQ(expected[3 * i + 2], ease.Value());
+  }
+
+  // Saving again reuses the blob's memory.
+  const uint8_t* data = state.data();
+  engine_.SaveState(&state);
+  EXPECT_EQ(data, state.data());
+}
+
+// A state that doesn't match the engine should be rejected, without changing
+// any Motivator. Holes left by freed Motivators are saved as they are.
+TEST_F(MotiveTests, RestoreStateRejectsMismatchedState) {
+  Motivator1f spline;
+  Motivator1f overshoot;
+  Motivator1f freed;
+  InitMotivator(spline_scalar_init, 0.0f, 0.0f, 1.0f, 500, &spline);
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, 60.0f, 1, &freed);
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, 60.0f, 1, &overshoot);
+  engine_.AdvanceFrame(kTimePerFrame);
+
+  // Save with `freed` alive, then free it, leaving a hole.
+  motive::MotiveState state;
+  engine_.SaveState(&state);
+  freed.Invalidate();
+  motive::MotiveState with_hole;
+  engine_.SaveState(&with_hole);
+  EXPECT_TRUE(engine_.RestoreState(with_hole));
+  engine_.AdvanceFrame(kTimePerFrame);
+  const float spline_value = spline.Value();
+  const float overshoot_value = overshoot.Value();
+
+  // `freed` no longer owns its index.
+  EXPECT_FALSE(engine_.RestoreState(state));
+  EXPECT_EQ(spline_value, spline.Value());
+  EXPECT_EQ(overshoot_value, overshoot.Value());
+
+  // Cut off partway through the last processor.
+  engine_.SaveState(&state);
+  engine_.AdvanceFrame(kTimePerFrame);
+  const float advanced_spline_value = spline.Value();
+  const float advanced_overshoot_value = overshoot.Value();
+  motive::MotiveState truncated;
+  truncated.Write(state.data(), state.size() - 1);
+  EXPECT_FALSE(engine_.RestoreState(truncated));
+  EXPECT_EQ(advanced_spline_value, spline.Value());
+  EXPECT_EQ(advanced_overshoot_value, overshoot.Value());
+  EXPECT_TRUE(engine_.RestoreState(state));
+  EXPECT_EQ(spline_value, spline.Value());
+  EXPECT_EQ(overshoot_value, overshoot.Value());
+}
+
+// In deterministic mode, the state hash should not depend on how the frame
+// was split across threads, but should change whenever a value does.
+TEST_F(MotiveTests, DeterministicStateHashMatchesAcrossThreads) {
+  static const int kNumMotivators = 200;
+  static const MotiveTime kEndTime = 500;
+
+  MotiveEngine parallel_engine;
+  parallel_engine.SetNumWorkerThreads(3);
+  parallel_engine.SetAdvanceFrameChunkSize(5);
+  engine_.SetDeterministicMode(true);
+  parallel_engine.SetDeterministicMode(true);
+  EXPECT_TRUE(parallel_engine.DeterministicMode());
+
+  Motivator1f serial_splines[kNumMotivators];
+  Motivator1f parallel_splines[kNumMotivators];
+  Motivator1f serial_overshoots[kNumMotivators];
+  Motivator1f parallel_overshoots[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const SplinePlayback playback(static_cast<float>(i * 2), true);
+    serial_splines[i].Initialize(spline_scalar_init, &engine_);
+    parallel_splines[i].Initialize(spline_scalar_init, &parallel_engine);
+    serial_splines[i].SetSpline(simple_spline_, playback);
+    parallel_splines[i].SetSpline(simple_spline_, playback);
+    InitOvershootMotivator(&serial_overshoots[i]);
+    parallel_overshoots[i].InitializeWithTarget(
+        overshoot_percent_init_, &parallel_engine,
+        motive::CurrentToTarget1f(overshoot_percent_init_.range().start(),
+                                  overshoot_percent_init_.max_velocity(),
+                                  overshoot_percent_init_.range().end(), 0.0f,
+                                  1));
+  }
+  EXPECT_EQ(engine_.StateHash(), parallel_engine.StateHash());
+
+  uint64_t previous_hash = engine_.StateHash();
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    parallel_engine.AdvanceFrame(kTimePerFrame);
+    const uint64_t hash = engine_.StateHash();
+    EXPECT_EQ(hash, parallel_engine.StateHash());
+    EXPECT_NE(previous_hash, hash);
+    previous_hash = hash;
+  }
+
+  // A single diverging Motivator should show up in the hash.
+  parallel_overshoots[kNumMotivators / 2].SetTarget(
+      motive::Target1f(0.0f, 0.0f, 1));
+  engine_.AdvanceFrame(kTimePerFrame);
+  parallel_engine.AdvanceFrame(kTimePerFrame);
+  EXPECT_NE(engine_.StateHash(), parallel_engine.StateHash());
+}
+
+// Engines advanced together by a MotiveEngineGroup should get the same
+// results as engines advanced one at a time, whatever bins they're put in.
+TEST_F(MotiveTests, EngineGroupMatchesSerial) {
+  static const int kNumEngines = 24;
+  static const MotiveTime kEndTime = 300;
+
+  MotiveEngine serial_engines[kNumEngines];
+  MotiveEngine grouped_engines[kNumEngines];
+  std::vector<Motivator1f> serial_splines(kNumEngines * (kNumEngines + 1) / 2);
+  std::vector<Motivator1f> grouped_splines(serial_splines.size());
+  std::vector<Motivator1f> serial_overshoots(kNumEngines);
+  std::vector<Motivator1f> grouped_overshoots(kNumEngines);
+  MotiveEngineGroup group(3);
+  EXPECT_EQ(3, group.NumWorkerThreads());
+
+  // Give engine e a load of e + 1 splines, so that the engines are packed
+  // into bins of differing sizes.
+  size_t spline = 0;
+  for (int e = 0; e < kNumEngines; ++e) {
+    group.AddEngine(&grouped_engines[e]);
+    for (int i = 0; i <= e; ++i, ++spline) {
+      const SplinePlayback playback(static_cast<float>(spline), true);
+      serial_splines[spline].Initialize(spline_scalar_init,
+                                        &serial_engines[e]);
+      grouped_splines[spline].Initialize(spline_scalar_init,
+                                         &grouped_engines[e]);
+      serial_splines[spline].SetSpline(simple_spline_, playback);
+      grouped_splines[spline].SetSpline(simple_spline_, playback);
+    }
+    const MotiveTarget1f target =
+        motive::CurrentToTarget1f(50.0f, 0.0f, 60.0f, 0.0f, 1);
+    serial_overshoots[e].InitializeWithTarget(overshoot_percent_init_,
+                                              &serial_engines[e], target);
+    grouped_overshoots[e].InitializeWithTarget(overshoot_percent_init_,
+                                               &grouped_engines[e], target);
+  }
+  EXPECT_EQ(kNumEngines, group.NumEngines());
+
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    for (int e = 0; e < kNumEngines; ++e) {
+      serial_engines[e].AdvanceFrame(kTimePerFrame);
+    }
+    group.AdvanceFrame(kTimePerFrame);
+    EXPECT_LE(group.NumBins(), 4 * group.BinsPerThread());
+    for (size_t i = 0; i < serial_splines.size(); ++i) {
+      EXPECT_EQ(serial_splines[i].Value(), grouped_splines[i].Value());
+    }
+    for (int e = 0; e < kNumEngines; ++e) {
+      EXPECT_EQ(serial_overshoots[e].Value(), grouped_overshoots[e].Value());
+    }
+  }
+
+  // Engines that leave the group are no longer advanced.
+  group.RemoveEngine(&grouped_engines[0]);
+  const float removed_value = grouped_splines[0].Value();
+  group.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(kNumEngines - 1, group.NumEngines());
+  EXPECT_EQ(removed_value, grouped_splines[0].Value());
+}
+
+// A StaticMotiveEngine creates its processors up front, and should animate
+// exactly as a MotiveEngine does. Values read through the inline path should
+// match the processor's virtual Values().
+TEST_F(MotiveTests, StaticEngineMatchesDynamicEngine) {
+  typedef motive::StaticMotiveEngine<OvershootInit, SplineInit> StaticEngine;
+  static const int kNumMotivators = 100;
+  static const MotiveTime kEndTime = 300;
+
+  StaticEngine static_engine;
+  EXPECT_EQ(0, StaticEngine::TypeId<OvershootInit>());
+  EXPECT_EQ(1, StaticEngine::TypeId<SplineInit>());
+  EXPECT_NE(nullptr, static_engine.Processor<SplineInit>());
+  EXPECT_EQ(static_engine.Processor<SplineInit>(),
+            static_engine.Processor(SplineInit::kType));
+
+  Motivator1f dynamic_overshoots[kNumMotivators];
+  Motivator1f static_overshoots[kNumMotivators];
+  Motivator1f dynamic_splines[kNumMotivators];
+  Motivator1f static_splines[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const MotiveTarget1f target = motive::CurrentToTarget1f(
+        static_cast<float>(i), 0.0f, 60.0f, 0.0f, 10 + i);
+    dynamic_overshoots[i].InitializeWithTarget(overshoot_percent_init_,
+                                               &engine_, target);
+    static_overshoots[i].InitializeWithTarget(overshoot_percent_init_,
+                                              &static_engine, target);
+    const SplinePlayback playback(static_cast<float>(i), true);
+    dynamic_splines[i].Initialize(spline_scalar_init, &engine_);
+    static_splines[i].Initialize(spline_scalar_init, &static_engine);
+    dynamic_splines[i].SetSpline(simple_spline_, playback);
+    static_splines[i].SetSpline(simple_spline_, playback);
+  }
+
+  const motive::MotiveProcessorNf* spline_processor =
+      static_cast<const motive::MotiveProcessorNf*>(
+          static_engine.Processor<SplineInit>());
+  for (MotiveTime time = 0; time < kEndTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    static_engine.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_EQ(dynamic_overshoots[i].Value(), static_overshoots[i].Value());
+      EXPECT_EQ(dynamic_splines[i].Value(), static_splines[i].Value());
+      EXPECT_EQ(spline_processor->Values(i), spline_processor->FastValues(i));
+    }
+  }
+
+  // Reset() keeps the listed processors.
+  static_engine.Reset();
+  EXPECT_FALSE(static_splines[0].Valid());
+  EXPECT_NE(nullptr, static_engine.Processor<OvershootInit>());
+
+  // Even through a MotiveEngine, the cached processors are recreated.
+  motive::MotiveEngine& base_engine = static_engine;
+  base_engine.Reset();
+  EXPECT_EQ(static_engine.Processor<SplineInit>(),
+            static_engine.Processor(SplineInit::kType));
+}
+
+// After Reserve(), initializing Motivators shouldn't reallocate the
+// processor's arrays, so pointers into them stay put.
+TEST_F(MotiveTests, ReserveAvoidsReallocation) {
+  static const int kNumMotivators = 1000;
+  engine_.Reserve(OvershootInit::kType, kNumMotivators);
+  engine_.Reserve(SplineInit::kType, kNumMotivators);
+
+  Motivator1f overshoots[kNumMotivators];
+  Motivator1f splines[kNumMotivators];
+  InitOvershootMotivator(&overshoots[0]);
+  splines[0].Initialize(spline_scalar_init, &engine_);
+  const float* overshoot_values = overshoots[0].Values();
+  const float* spline_values = splines[0].Values();
+
+  for (int i = 1; i < kNumMotivators; ++i) {
+    InitOvershootMotivator(&overshoots[i]);
+    splines[i].Initialize(spline_scalar_init, &engine_);
+    splines[i].SetSpline(simple_spline_, SplinePlayback());
+  }
+  EXPECT_EQ(overshoot_values, overshoots[0].Values());
+  EXPECT_EQ(spline_values, splines[0].Values());
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(overshoot_values, overshoots[0].Values());
+  EXPECT_EQ(spline_values, splines[0].Values());
+
+  // Reserving more while Motivators are live may move the arrays. The
+  // Motivators should read from the new ones.
+  const float overshoot_value = overshoots[0].Value();
+  const float spline_value = splines[0].Value();
+  engine_.Reserve(OvershootInit::kType, 10 * kNumMotivators);
+  engine_.Reserve(SplineInit::kType, 10 * kNumMotivators);
+  const motive::MotiveProcessorNf* overshoot_processor =
+      static_cast<const motive::MotiveProcessorNf*>(
+          engine_.Processor(OvershootInit::kType));
+  const motive::MotiveProcessorNf* spline_processor =
+      static_cast<const motive::MotiveProcessorNf*>(
+          engine_.Processor(SplineInit::kType));
+  EXPECT_EQ(overshoot_processor->Values(0), overshoots[0].Values());
+  EXPECT_EQ(spline_processor->Values(0), splines[0].Values());
+  EXPECT_EQ(overshoot_value, overshoots[0].Value());
+  EXPECT_EQ(spline_value, splines[0].Value());
+}
+
+// Once a processor reaches its cap, initialization should fail cleanly and
+// leave the Motivator invalid. Freed indices should still be reused.
+TEST_F(MotiveTests, MaxIndicesCapsMotivators) {
+  engine_.SetMaxIndices(OvershootInit::kType, 3);
+
+  Motivator1f overshoots[3];
+  for (int i = 0; i < 3; ++i) {
+    InitOvershootMotivator(&overshoots[i]);
+    EXPECT_TRUE(overshoots[i].Valid());
+  }
+  Motivator1f over_cap;
+  InitOvershootMotivator(&over_cap);
+  EXPECT_FALSE(over_cap.Valid());
+  EXPECT_TRUE(over_cap.Sane());
+
+  // A freed index is recycled, but only for a Motivator that fits in it.
+  overshoots[1].Invalidate();
+  Motivator2f too_wide;
+  too_wide.Initialize(overshoot_percent_init_, &engine_);
+  EXPECT_FALSE(too_wide.Valid());
+  InitOvershootMotivator(&over_cap);
+  EXPECT_TRUE(over_cap.Valid());
+
+  // The Motivators that did initialize are unaffected.
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_TRUE(overshoots[0].Sane());
+  EXPECT_TRUE(overshoots[2].Sane());
+  EXPECT_TRUE(over_cap.Sane());
+  EXPECT_EQ(overshoots[0].Value(), over_cap.Value());
+}
+
+// Initializing a batch of Motivators at once should behave exactly like
+// initializing them one at a time, and the batch should be freed cleanly.
+TEST_F(MotiveTests, BatchInitializeMatchesIndividual) {
+  static const int kNumMotivators = 20;
+  const OvershootInit& init = overshoot_percent_init_;
+  MotiveTarget1f targets[kNumMotivators];
+  Motivator1f individual[kNumMotivators];
+  Motivator1f batch[kNumMotivators];
+  Motivator* batch_ptrs[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    targets[i] = motive::CurrentToTarget1f(
+        init.range().start(), init.max_velocity(),
+        init.range().Lerp(static_cast<float>(i) / kNumMotivators), 0.0f, 1);
+    individual[i].InitializeWithTargets(init, &engine_, 1, &targets[i]);
+    batch_ptrs[i] = &batch[i];
+  }
+  EXPECT_TRUE(MotivatorNf::InitializeBatchWithTargets(
+      init, &engine_, 1, batch_ptrs, kNumMotivators, targets));
+
+  for (int frame = 0; frame < 10; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_TRUE(batch[i].Sane());
+      EXPECT_EQ(individual[i].Value(), batch[i].Value());
+    }
+  }
+
+  // Every other Motivator, so that the batch is freed in several runs.
+  Motivator* odd_ptrs[kNumMotivators / 2];
+  for (int i = 0; i < kNumMotivators / 2; ++i) {
+    odd_ptrs[i] = &batch[2 * i + 1];
+  }
+  Motivator::InvalidateBatch(odd_ptrs, kNumMotivators / 2);
+  for (int i = 0; i < kNumMotivators; ++i) {
+    EXPECT_EQ(i % 2 == 0, batch[i].Valid());
+    EXPECT_TRUE(batch[i].Sane());
+  }
+  Motivator::InvalidateBatch(batch_ptrs, kNumMotivators);
+  for (int i = 0; i < kNumMotivators; ++i) {
+    EXPECT_FALSE(batch[i].Valid());
+  }
+
+  // A batch that doesn't fit under the cap is not initialized at all.
+  engine_.SetMaxIndices(OvershootInit::kType, kNumMotivators + 1);
+  EXPECT_FALSE(Motivator::InitializeBatch(init, &engine_, 1, batch_ptrs,
+                                          kNumMotivators));
+  for (int i = 0; i < kNumMotivators; ++i) {
+    EXPECT_FALSE(batch[i].Valid());
+  }
+}
+
+// Data referenced by a handle should animate like a Motivator's, keep its
+// handle valid across Defragment(), and leave stale copies invalid once
+// removed.
+TEST_F(MotiveTests, HandlesSurviveDefragment) {
+  static const int kNumHandles = 8;
+  const OvershootInit& init = overshoot_percent_init_;
+  const MotiveTarget1f target = motive::CurrentToTarget1f(
+      init.range().start(), init.max_velocity(), init.range().end(), 0.0f, 1);
+  Motivator1f motivator;
+  motivator.InitializeWithTargets(init, &engine_, 1, &target);
+
+  motive::MotiveProcessorNf* processor =
+      static_cast<motive::MotiveProcessorNf*>(engine_.Processor(init.type()));
+  motive::MotiveHandle handles[kNumHandles];
+  for (int i = 0; i < kNumHandles; ++i) {
+    handles[i] = processor->InitializeHandle(init, &engine_, 1);
+    ASSERT_TRUE(processor->ValidHandle(handles[i]));
+    processor->SetTargets(processor->HandleIndex(handles[i]), 1, &target);
+  }
+
+  // Free the early ones, so that Defragment() moves the later ones down.
+  const motive::MotiveHandle stale = handles[kNumHandles / 2 - 1];
+  for (int i = 0; i < kNumHandles / 2; ++i) {
+    processor->RemoveHandle(handles[i]);
+    EXPECT_FALSE(processor->ValidHandle(handles[i]));
+  }
+  const motive::MotiveIndex old_index =
+      processor->HandleIndex(handles[kNumHandles - 1]);
+
+  // Handles are plain data, so they can be relocated with memcpy.
+  motive::MotiveHandle moved[kNumHandles / 2];
+  memcpy(moved, &handles[kNumHandles / 2], sizeof(moved));
+
+  for (int frame = 0; frame < 10; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumHandles / 2; ++i) {
+      EXPECT_TRUE(processor->ValidHandle(moved[i]));
+      EXPECT_EQ(motivator.Value(),
+                processor->Value(processor->HandleIndex(moved[i])));
+    }
+  }
+  EXPECT_NE(old_index, processor->HandleIndex(moved[kNumHandles / 2 - 1]));
+
+  // A recycled slot doesn't revive stale handles.
+  const motive::MotiveHandle recycled =
+      processor->InitializeHandle(init, &engine_, 1);
+  EXPECT_EQ(stale.slot(), recycled.slot());
+  EXPECT_FALSE(processor->ValidHandle(stale));
+  EXPECT_TRUE(processor->ValidHandle(recycled));
+  EXPECT_FALSE(processor->ValidHandle(motive::MotiveHandle()));
+}
+
+// Gathering values and velocities in bulk should match reading them one
+// Motivator at a time, for both packed and strided output.
+TEST_F(MotiveTests, GatherMatchesPerMotivatorReads) {
+  static const int kNumMotivators = 70;
+  Motivator2f motivators[kNumMotivators];
+  const Motivator2f* ptrs[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const float start = static_cast<float>(i % 10);
+    InitMotivator(overshoot_percent_init_, start, 0.0f, start + 1.0f, 10,
+                  &motivators[i]);
+    ptrs[kNumMotivators - 1 - i] = &motivators[i];
+  }
+  engine_.AdvanceFrame(kTimePerFrame);
+
+  // Structure of arrays: all the x's, then all the y's.
+  float soa[2 * kNumMotivators];
+  MotivatorNf::GatherValues(ptrs, kNumMotivators, soa, 1, kNumMotivators);
+
+  // Array of structures, with a padding float after each.
+  float aos[3 * kNumMotivators];
+  MotivatorNf::GatherVelocities(ptrs, kNumMotivators, aos, 3, 1);
+
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const vec2 value = ptrs[i]->Value();
+    const vec2 velocity = ptrs[i]->Velocity();
+    EXPECT_EQ(value[0], soa[i]);
+    EXPECT_EQ(value[1], soa[kNumMotivators + i]);
+    EXPECT_EQ(velocity[0], aos[3 * i]);
+    EXPECT_EQ(velocity[1], aos[3 * i + 1]);
+  }
+}
+
+// Setting targets in a batch, in any order, should match setting them one
+// Motivator at a time.
+TEST_F(MotiveTests, SetTargetsBatchMatchesIndividual) {
+  static const int kNumMotivators = 100;
+  Motivator1f individual[kNumMotivators];
+  Motivator1f batch[kNumMotivators];
+  Motivator1f* batch_ptrs[kNumMotivators];
+  MotiveTarget1f targets[kNumMotivators];
+  for (int i = 0; i < kNumMotivators; ++i) {
+    InitOvershootMotivator(&individual[i]);
+    InitOvershootMotivator(&batch[i]);
+  }
+
+  // Visit the batch out of order, to exercise the sort.
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const int j = (i * 37) % kNumMotivators;
+    targets[i] = motive::Target1f(static_cast<float>(j % 7), 0.0f, 10);
+    individual[j].SetTargets(&targets[i]);
+    batch_ptrs[i] = &batch[j];
+  }
+  MotivatorNf::SetTargetsBatch(batch_ptrs, kNumMotivators, targets);
+
+  for (int frame = 0; frame < 10; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    for (int i = 0; i < kNumMotivators; ++i) {
+      EXPECT_EQ(individual[i].Value(), batch[i].Value());
+    }
+  }
+}
+
+// Bound outputs should be written at the end of each frame, and stop being
+// written once the binding is removed.
+TEST_F(MotiveTests, OutputBindingsWriteAfterAdvance) {
+  static const int kNumMotivators = 8;
+  static const int kStride = 3;
+  Motivator2f motivators[kNumMotivators];
+  float outputs[kStride * kNumMotivators] = {0.0f};
+  for (int i = 0; i < kNumMotivators; ++i) {
+    const float start = static_cast<float>(i);
+    InitMotivator(overshoot_percent_init_, start, 0.0f, start + 1.0f, 10,
+                  &motivators[i]);
+    motivators[i].BindOutput(&outputs[kStride * i], sizeof(float));
+  }
+
+  // Remove one binding explicitly, and one by invalidating.
+  motivators[1].BindOutput(nullptr, 0);
+  motivators[2].Invalidate();
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  for (int i = 0; i < kNumMotivators; ++i) {
+    if (i == 1 || i == 2) {
+      EXPECT_EQ(0.0f, outputs[kStride * i]);
+      EXPECT_EQ(0.0f, outputs[kStride * i + 1]);
+      continue;
+    }
+    const vec2 value = motivators[i].Value();
+    EXPECT_EQ(value[0], outputs[kStride * i]);
+    EXPECT_EQ(value[1], outputs[kStride * i + 1]);
+    EXPECT_EQ(0.0f, outputs[kStride * i + 2]);
+  }
+}
+
+// Each Motivator should report finishing exactly once, in the frame that it
+// finishes.
+TEST_F(MotiveTests, EventsReportedOnceWhenFinished) {
+  static const MotiveTime kTargetTime = 10 * kTimePerFrame;
+  static const float kTarget = 60.0f;
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f spline;
+  Motivator1f overshoot;
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 1.0f, kTargetTime, &spline);
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, kTarget, 1, &overshoot);
+
+  int num_spline_events = 0;
+  int num_overshoot_events = 0;
+  motive::MotiveEvent event;
+  for (MotiveTime time = 0; time < kMaxTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    while (engine_.Events()->Pop(&event)) {
+      if (event.motivator == &spline) {
+        EXPECT_EQ(motive::kMotiveEventSplineEnded, event.type);
+        EXPECT_GE(0, spline.TargetTime());
+        num_spline_events++;
+      } else {
+        EXPECT_EQ(&overshoot, event.motivator);
+        EXPECT_EQ(motive::kMotiveEventSettled, event.type);
+        EXPECT_EQ(kTarget, overshoot.Value());
+        num_overshoot_events++;
+      }
+    }
+  }
+  EXPECT_EQ(1, num_spline_events);
+  EXPECT_EQ(1, num_overshoot_events);
+  EXPECT_EQ(0u, engine_.Events()->num_dropped());
+}
+
+// Fast-forwarding onto the target should report settling, like advancing
+// frame by frame does.
+TEST_F(MotiveTests, FastForwardReportsSettled) {
+  static const float kTarget = 60.0f;
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f overshoot;
+  InitMotivator(overshoot_percent_init_, 50.0f, 0.0f, kTarget, 1, &overshoot);
+  overshoot.FastForward(kMaxTime);
+  EXPECT_EQ(kTarget, overshoot.Value());
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  motive::MotiveEvent event;
+  ASSERT_TRUE(engine_.Events()->Pop(&event));
+  EXPECT_EQ(&overshoot, event.motivator);
+  EXPECT_EQ(motive::kMotiveEventSettled, event.type);
+  EXPECT_FALSE(engine_.Events()->Pop(&event));
+}
+
+// Fast-forwarding a spline past its end should report it, like advancing
+// frame by frame does.
+TEST_F(MotiveTests, FastForwardReportsSplineEnded) {
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f spline;
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 1.0f, 10 * kTimePerFrame,
+                &spline);
+  spline.FastForward(kMaxTime);
+  EXPECT_NEAR(1.0f, spline.Value(), 0.001f);
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  motive::MotiveEvent event;
+  ASSERT_TRUE(engine_.Events()->Pop(&event));
+  EXPECT_EQ(&spline, event.motivator);
+  EXPECT_EQ(motive::kMotiveEventSplineEnded, event.type);
+  EXPECT_FALSE(engine_.Events()->Pop(&event));
+}
+
+// Fast-forwarding an ease-in-ease-out curve onto its target should report
+// it, like advancing frame by frame does.
+TEST_F(MotiveTests, FastForwardReportsEaseInEaseOutTargetReached) {
+  static const float kTarget = 1.0f;
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f ease;
+  InitEaseInEaseOutMotivator(ease_init__, kTarget, 0.0f,
+                             MotiveCurveShape(kTarget, 500.0f, 0.5f), &ease);
+  ease.FastForward(kMaxTime);
+  EXPECT_NEAR(kTarget, ease.Value(), 0.001f);
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  motive::MotiveEvent event;
+  ASSERT_TRUE(engine_.Events()->Pop(&event));
+  EXPECT_EQ(&ease, event.motivator);
+  EXPECT_EQ(motive::kMotiveEventTargetReached, event.type);
+  EXPECT_FALSE(engine_.Events()->Pop(&event));
+}
+
+// Fast-forwarding a spring until it settles should report it, like
+// advancing frame by frame does.
+TEST_F(MotiveTests, FastForwardReportsSpringTargetReached) {
+  static const float kTarget = 10.0f;
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f spring;
+  InitEaseInEaseOutMotivator(motive::SpringInit(), kTarget, 0.0f,
+                             MotiveCurveShape(kTarget, 500.0f, 0.5f), &spring);
+  spring.FastForward(kMaxTime);
+  EXPECT_EQ(kTarget, spring.Value());
+
+  engine_.AdvanceFrame(kTimePerFrame);
+  motive::MotiveEvent event;
+  ASSERT_TRUE(engine_.Events()->Pop(&event));
+  EXPECT_EQ(&spring, event.motivator);
+  EXPECT_EQ(motive::kMotiveEventTargetReached, event.type);
+  EXPECT_FALSE(engine_.Events()->Pop(&event));
+}
+
+// Only outputs that moved should be reported as changed.
+TEST_F(MotiveTests, ChangedIndicesSkipSettledOutputs) {
+  static const float kTarget = 60.0f;
+  const OvershootInit& init = overshoot_percent_init_;
+  engine_.SetChangeTracking(init.type(), true, 0.0f);
+  motive::MotiveProcessorNf* processor =
+      static_cast<motive::MotiveProcessorNf*>(engine_.Processor(init.type()));
+
+  const MotiveTarget1f moving_target =
+      motive::CurrentToTarget1f(50.0f, 0.0f, kTarget, 0.0f, 1);
+  const MotiveTarget1f settled_target =
+      motive::CurrentToTarget1f(kTarget, 0.0f, kTarget, 0.0f, 1);
+  const motive::MotiveHandle moving =
+      processor->InitializeHandle(init, &engine_, 1);
+  const motive::MotiveHandle settled =
+      processor->InitializeHandle(init, &engine_, 1);
+  processor->SetTargets(processor->HandleIndex(moving), 1, &moving_target);
+  processor->SetTargets(processor->HandleIndex(settled), 1, &settled_target);
+
+  // Both are new, so both are reported in the first frame.
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_TRUE(processor->Changed(processor->HandleIndex(moving)));
+  EXPECT_TRUE(processor->Changed(processor->HandleIndex(settled)));
+
+  // After that, only the one that's moving.
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_TRUE(processor->Changed(processor->HandleIndex(moving)));
+  EXPECT_FALSE(processor->Changed(processor->HandleIndex(settled)));
+
+  // Once both have settled, nothing is reported.
+  for (MotiveTime time = 0; time < kMaxTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  const motive::IndexBitSet& changed = processor->ChangedIndices();
+  EXPECT_EQ(changed.size(), changed.NextSet(0, changed.size()));
+}
+
+// A locality sort budget should reorder keyed indices by key over a few
+// frames, without disturbing their data.
+TEST_F(MotiveTests, LocalitySortOrdersIndicesByKey) {
+  static const int kNumHandles = 10;
+  static const motive::MotiveIndex kSwapsPerFrame = 2;
+  const OvershootInit& init = overshoot_percent_init_;
+  engine_.SetLocalitySortBudget(init.type(), kSwapsPerFrame);
+  motive::MotiveProcessorNf* processor =
+      static_cast<motive::MotiveProcessorNf*>(engine_.Processor(init.type()));
+
+  // Key the handles in the reverse of their allocation order.
+  motive::MotiveHandle handles[kNumHandles];
+  for (int i = 0; i < kNumHandles; ++i) {
+    const MotiveTarget1f target = motive::CurrentToTarget1f(
+        static_cast<float>(i), 0.0f, static_cast<float>(i), 0.0f, 1);
+    handles[i] = processor->InitializeHandle(init, &engine_, 1);
+    const motive::MotiveIndex index = processor->HandleIndex(handles[i]);
+    processor->SetTargets(index, 1, &target);
+    processor->SetLocalityKey(index, kNumHandles - i);
+  }
+
+  // Each frame makes at most kSwapsPerFrame swaps, which reach the ends
+  // first. The middle pair is still out of order after one frame.
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_LT(processor->HandleIndex(handles[kNumHandles / 2 - 1]),
+            processor->HandleIndex(handles[kNumHandles / 2]));
+  for (int frame = 0; frame < kNumHandles; ++frame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+
+  for (int i = 0; i < kNumHandles; ++i) {
+    const motive::MotiveIndex index = processor->HandleIndex(handles[i]);
+    EXPECT_EQ(static_cast<uint64_t>(kNumHandles - i),
+              processor->LocalityKey(index));
+    EXPECT_EQ(static_cast<float>(i), processor->Value(index));
+    if (i > 0) {
+      EXPECT_LT(index, processor->HandleIndex(handles[i - 1]));
+    }
+  }
+}
+
+// The locality sort swaps through a spare block, which counts towards the
+// processor's cap. With no room for it, nothing is reordered.
+TEST_F(MotiveTests, LocalitySortStaysUnderMaxIndices) {
+  static const int kNumHandles = 4;
+  const OvershootInit& init = overshoot_percent_init_;
+  engine_.SetMaxIndices(init.type(), kNumHandles);
+  engine_.SetLocalitySortBudget(init.type(), kNumHandles);
+  motive::MotiveProcessorNf* processor =
+      static_cast<motive::MotiveProcessorNf*>(engine_.Processor(init.type()));
+
+  motive::MotiveHandle handles[kNumHandles];
+  for (int i = 0; i < kNumHandles; ++i) {
+    handles[i] = processor->InitializeHandle(init, &engine_, 1);
+    processor->SetLocalityKey(processor->HandleIndex(handles[i]),
+                              kNumHandles - i);
+  }
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(kNumHandles, processor->NumIndices());
+  for (int i = 0; i < kNumHandles; ++i) {
+    EXPECT_EQ(i, processor->HandleIndex(handles[i]));
+  }
+
+  // One more index is enough for the spare.
+  engine_.SetMaxIndices(init.type(), kNumHandles + 1);
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(kNumHandles + 1, processor->NumIndices());
+  for (int i = 0; i < kNumHandles; ++i) {
+    EXPECT_EQ(kNumHandles - 1 - i, processor->HandleIndex(handles[i]));
+  }
+
+  // Turning the sort off frees the spare.
+  engine_.SetLocalitySortBudget(init.type(), 0);
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(kNumHandles, processor->NumIndices());
+}
+
+// A budgeted Defragment() can leave the indices it moved out of in the
+// middle of the array, where they're allocated again without being removed.
+// Motivators allocated there shouldn't share the moved Motivators' splines.
+TEST_F(MotiveTests, BudgetedDefragmentHolesAreClean) {
+  static const MotiveTime kTargetTime = 10 * kTimePerFrame;
+  engine_.SetDefragmentBudget(1);
+
+  // Leave a one-index hole at the start, that the two-index Motivators can't
+  // fill. Defragment() has to shift `moved` over, leaving a hole behind it.
+  Motivator1f freed;
+  Motivator2f moved;
+  Motivator2f last;
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 1.0f, kTargetTime, &freed);
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 2.0f, kTargetTime, &moved);
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 3.0f, kTargetTime, &last);
+  freed.Invalidate();
+  engine_.AdvanceFrame(kTimePerFrame);
+
+  // Allocate into the hole, with a target of its own.
+  Motivator1f reused;
+  InitMotivator(smooth_scalar_init(), 0.0f, 0.0f, 4.0f, kTargetTime, &reused);
+
+  for (MotiveTime time = 0; time <= kTargetTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+  }
+  EXPECT_NEAR(2.0f, moved.Value()[0], 0.001f);
+  EXPECT_NEAR(2.0f, moved.Value()[1], 0.001f);
+  EXPECT_NEAR(3.0f, last.Value()[0], 0.001f);
+  EXPECT_NEAR(3.0f, last.Value()[1], 0.001f);
+  EXPECT_NEAR(4.0f, reused.Value(), 0.001f);
+}
+
+// A spring's oscillation never dies out completely, so it should snap onto
+// its target once the swing is small, go inactive, and report it once.
+TEST_F(MotiveTests, SpringSettlesOnTarget) {
+  static const float kTarget = 10.0f;
+  engine_.SetEventQueueCapacity(16);
+  Motivator1f spring;
+  InitEaseInEaseOutMotivator(motive::SpringInit(), kTarget, 0.0f,
+                             MotiveCurveShape(kTarget, 500.0f, 0.5f), &spring);
+  const motive::MotiveProcessor* processor =
+      engine_.Processor(motive::SpringInit::kType);
+  engine_.AdvanceFrame(kTimePerFrame);
+  EXPECT_EQ(1, processor->NumActiveIndices());
+
+  int num_events = 0;
+  motive::MotiveEvent event;
+  for (MotiveTime time = 0; time < kMaxTime; time += kTimePerFrame) {
+    engine_.AdvanceFrame(kTimePerFrame);
+    while (engine_.Events()->Pop(&event)) {
+      EXPECT_EQ(&spring, event.motivator);
+      EXPECT_EQ(motive::kMotiveEventTargetReached, event.type);
+      num_events++;
+    }
+  }
+  EXPECT_EQ(1, num_events);
+  EXPECT_EQ(0, processor->NumActiveIndices());
+  EXPECT_EQ(kTarget, spring.Value());
+  EXPECT_EQ(0.0f, spring.Velocity());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -557,6 +557,46 @@ TEST_F(SplineTests, YScaleAndOffset) {
   }
 }
 
+// Every SIMD kernel that the CPU supports should match the C++ kernels
+// exactly, across segment changes, repeats, and different playback rates.
+TEST_F(SplineTests, BulkEvaluatorOptimizationsMatchC) {
+  // Not a multiple of the SIMD width, so the remainder loops run too.
+  static const int kNumIndices = 37;
+  static const int kNumFrames = 200;
+  static const motive::ProcessorOptimization kOptimizations[] = {
+      motive::kSse3Optimizations, motive::kAvx2Optimizations};
+
+  BulkSplineEvaluator reference;
+  reference.SetOptimization(motive::kNoOptimizations);
+  for (size_t k = 0; k < MOTIVE_ARRAY_SIZE(kOptimizations); ++k) {
+    const motive::ProcessorOptimization optimization = kOptimizations[k];
+    if (optimization > motive::BestProcessorOptimization()) continue;
+    BulkSplineEvaluator optimized;
+    optimized.SetOptimization(optimization);
+
+    BulkSplineEvaluator* evaluators[] = {&reference, &optimized};
+    for (size_t e = 0; e < MOTIVE_ARRAY_SIZE(evaluators); ++e) {
+      BulkSplineEvaluator& evaluator = *evaluators[e];
+      evaluator.SetNumIndices(kNumIndices);
+      for (int i = 0; i < kNumIndices; ++i) {
+        const motive::SplinePlayback playback(
+            static_cast<float>(i), i % 3 == 0,
+            0.25f * static_cast<float>(i % 9));
+        evaluator.SetSplines(i, 1, &short_spline_, playback);
+      }
+    }
+
+    for (int frame = 0; frame < kNumFrames; ++frame) {
+      reference.AdvanceFrame(1.0f);
+      optimized.AdvanceFrame(1.0f);
+      for (int i = 0; i < kNumIndices; ++i) {
+        EXPECT_EQ(reference.X(i), optimized.X(i));
+        EXPECT_EQ(reference.Y(i), optimized.Y(i));
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
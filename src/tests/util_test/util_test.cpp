@@ -12,14 +12,21 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>
+#include <random>
+
 #include "gtest/gtest.h"
 #include "motive/matrix_anim.h"
 #include "motive/matrix_op.h"
+#include "motive/util/hash.h"
+#include "motive/util/index_allocator.h"
+#include "motive/util/index_bit_set.h"
 #include "motive/util/keyframe_converter.h"
 #include "third_party/motive/include/motive/util/keyframe_converter.h"
 
 using motive::CompactSpline;
 using motive::CompactSplineIndex;
+using motive::IndexBitSet;
 using motive::KeyframeData;
 using motive::MatrixAnim;
 using motive::MatrixOperationInit;
@@ -541,6 +548,219 @@ TEST_F(UtilTests, CubicSplineInterpolation) {
   }
 }
 
+// Iteration should find set and clear bits across word boundaries, and
+// never report bits past the end of the range.
+TEST_F(UtilTests, IndexBitSetIteration) {
+  IndexBitSet bits;
+  bits.Resize(200, false);
+  EXPECT_EQ(200, bits.NextSet(0, 200));
+  EXPECT_EQ(0, bits.NextClear(0, 200));
+
+  bits.Set(3);
+  bits.Set(64);
+  bits.Set(130);
+  EXPECT_EQ(3, bits.NextSet(0, 200));
+  EXPECT_EQ(64, bits.NextSet(4, 200));
+  EXPECT_EQ(130, bits.NextSet(65, 200));
+  EXPECT_EQ(200, bits.NextSet(131, 200));
+  EXPECT_EQ(100, bits.NextSet(65, 100));
+
+  // Growing initializes the new bits. Moving copies bits, as for array data.
+  bits.Resize(300, true);
+  EXPECT_FALSE(bits.Test(199));
+  EXPECT_TRUE(bits.Test(200));
+  EXPECT_EQ(200, bits.NextSet(131, 300));
+  EXPECT_EQ(300, bits.NextClear(200, 300));
+  bits.Move(130, 10, 2);
+  EXPECT_TRUE(bits.Test(10));
+  EXPECT_FALSE(bits.Test(11));
+
+  // Shrinking drops the bits past the end.
+  bits.Resize(64, true);
+  EXPECT_EQ(64, bits.NextSet(11, 64));
+  bits.Resize(128, false);
+  EXPECT_EQ(128, bits.NextSet(11, 128));
+  EXPECT_EQ(2, bits.Count());
+  bits.Resize(70, true);
+  EXPECT_EQ(2, bits.Count());
+  bits.Resize(8, true);
+  EXPECT_EQ(1, bits.Count());
+}
+
+// Moving a range of bits should match moving them one at a time, for ranges
+// that straddle words and overlap in either direction.
+TEST_F(UtilTests, IndexBitSetMoveOverlapping) {
+  static const int kNumBits = 300;
+  static const int kMoves[][3] = {
+      // old_index, new_index, count
+      {70, 3, 200}, {3, 70, 200}, {64, 0, 128}, {10, 11, 150}, {250, 5, 50},
+  };
+  for (size_t m = 0; m < sizeof(kMoves) / sizeof(kMoves[0]); ++m) {
+    const int old_index = kMoves[m][0];
+    const int new_index = kMoves[m][1];
+    const int count = kMoves[m][2];
+
+    IndexBitSet bits;
+    bits.Resize(kNumBits, false);
+    std::vector<bool> expected(kNumBits);
+    for (int i = 0; i < kNumBits; ++i) {
+      expected[i] = (i * 7919) % 5 < 2;
+      bits.Assign(i, expected[i]);
+    }
+    const std::vector<bool> source(expected.begin() + old_index,
+                                   expected.begin() + old_index + count);
+    std::copy(source.begin(), source.end(), expected.begin() + new_index);
+
+    bits.Move(old_index, new_index, count);
+    for (int i = 0; i < kNumBits; ++i) {
+      EXPECT_EQ(expected[i], bits.Test(i));
+    }
+  }
+}
+
+// HashBytes should match the published FNV-1a test vectors, and chaining
+// calls should be the same as hashing the concatenated buffers.
+TEST_F(UtilTests, HashBytesFnv1a) {
+  EXPECT_EQ(motive::kHashSeed, motive::HashBytes("", 0));
+  EXPECT_EQ(0xaf63dc4c8601ec8cULL, motive::HashBytes("a", 1));
+  EXPECT_EQ(0x85944171f73967e8ULL, motive::HashBytes("foobar", 6));
+  EXPECT_EQ(motive::HashBytes("foobar", 6),
+            motive::HashBytes("bar", 3, motive::HashBytes("foo", 3)));
+
+  const float values[] = {1.0f, 2.0f};
+  const float changed[] = {1.0f, 2.0000002f};
+  EXPECT_NE(motive::HashValues(values, 2, motive::kHashSeed),
+            motive::HashValues(changed, 2, motive::kHashSeed));
+}
+
+// Holds one value per index, and counts the indices that IndexAllocator moves.
+class TestIndexCallbacks : public motive::IndexAllocator<int>::CallbackInterface {
+ public:
+  TestIndexCallbacks() : num_moved_(0) {}
+
+  virtual void SetNumIndices(int num_indices) {
+    values_.resize(num_indices, -1);
+  }
+
+  virtual void MoveIndexRange(
+      const motive::IndexAllocator<int>::IndexRange& source, int target) {
+    for (int i = source.start(); i < source.end(); ++i) {
+      values_[target + i - source.start()] = values_[i];
+    }
+    num_moved_ += source.Length();
+  }
+
+  std::vector<int> values_;
+  int num_moved_;
+};
+
+// A budgeted Defragment() should spread the moves over several calls, and end
+// up with the same contiguous indices as an unbudgeted one.
+TEST_F(UtilTests, IndexAllocatorBudgetedDefragment) {
+  static const int kNumIndices = 100;
+  static const int kBudget = 8;
+  TestIndexCallbacks callbacks;
+  motive::IndexAllocator<int> allocator(callbacks);
+  for (int i = 0; i < kNumIndices; ++i) {
+    const int index = allocator.Alloc(1);
+    callbacks.values_[index] = i;
+  }
+
+  // Free every even value. The odd ones have to move down to fill the holes.
+  for (int i = 0; i < kNumIndices; i += 2) {
+    allocator.Free(i);
+  }
+
+  int num_calls = 0;
+  for (bool done = false; !done; ++num_calls) {
+    const int num_moved = callbacks.num_moved_;
+    done = allocator.Defragment(kBudget);
+    EXPECT_LE(callbacks.num_moved_ - num_moved, kBudget);
+    allocator.VerifyInternalState();
+  }
+  EXPECT_LT(1, num_calls);
+  EXPECT_EQ(kNumIndices / 2, allocator.num_indices());
+  EXPECT_EQ(0, allocator.NumUnusedIndices());
+
+  std::vector<int> values(callbacks.values_);
+  std::sort(values.begin(), values.end());
+  for (int i = 0; i < kNumIndices / 2; ++i) {
+    EXPECT_EQ(2 * i + 1, values[i]);
+  }
+}
+
+// Randomly allocate and free blocks of mixed sizes, including sizes too big
+// for the allocator's per-size free lists. Blocks must never overlap, and a
+// final Defragment() must leave exactly the live blocks, contiguous.
+TEST_F(UtilTests, IndexAllocatorMixedSizeChurn) {
+  static const int kNumOps = 100000;
+  static const int kMaxLive = 1000;
+  static const int kStride = 64;
+  static const int kSizes[] = {1, 1, 3, 4, 4, 7, 16, 17, 40};
+  static const int kNumSizes =
+      static_cast<int>(sizeof(kSizes) / sizeof(kSizes[0]));
+
+  TestIndexCallbacks callbacks;
+  motive::IndexAllocator<int> allocator(callbacks);
+  std::mt19937 random(12345);
+  std::vector<int> live_indices;
+  std::vector<int> live_ids;
+  int next_id = 0;
+
+  const auto start_time = std::chrono::steady_clock::now();
+  for (int op = 0; op < kNumOps; ++op) {
+    const bool alloc = live_indices.empty() ||
+                       (static_cast<int>(live_indices.size()) < kMaxLive &&
+                        random() % 2 == 0);
+    if (alloc) {
+      const int count = kSizes[random() % kNumSizes];
+      const int index = allocator.Alloc(count);
+      ASSERT_EQ(count, allocator.CountForIndex(index));
+      for (int i = 0; i < count; ++i) {
+        ASSERT_EQ(-1, callbacks.values_[index + i]);
+        callbacks.values_[index + i] = next_id * kStride + i;
+      }
+      live_indices.push_back(index);
+      live_ids.push_back(next_id++);
+    } else {
+      const size_t j = random() % live_indices.size();
+      const int index = live_indices[j];
+      for (int i = 0; i < allocator.CountForIndex(index); ++i) {
+        callbacks.values_[index + i] = -1;
+      }
+      allocator.Free(index);
+      live_indices[j] = live_indices.back();
+      live_indices.pop_back();
+      live_ids[j] = live_ids.back();
+      live_ids.pop_back();
+    }
+  }
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+                                std::chrono::steady_clock::now() - start_time)
+                                .count();
+  printf("%d mixed-size Alloc/Free calls in %.2f ms\n", kNumOps, elapsed_ms);
+
+  std::vector<int> expected;
+  for (size_t j = 0; j < live_indices.size(); ++j) {
+    for (int i = 0; i < allocator.CountForIndex(live_indices[j]); ++i) {
+      expected.push_back(live_ids[j] * kStride + i);
+    }
+  }
+  const int num_live = static_cast<int>(expected.size());
+  EXPECT_EQ(allocator.num_indices() - num_live, allocator.NumUnusedIndices());
+  allocator.VerifyInternalState();
+
+  allocator.Defragment();
+  allocator.VerifyInternalState();
+  EXPECT_EQ(num_live, allocator.num_indices());
+  EXPECT_EQ(0, allocator.NumUnusedIndices());
+
+  std::vector<int> values(callbacks.values_);
+  std::sort(values.begin(), values.end());
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(expected, values);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();